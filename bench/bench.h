@@ -0,0 +1,45 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+
+// Runs "f" until at least "min_time" has passed, returns average time of a
+// single run in nanoseconds. Result of "f" is accumulated into "sink", so that
+// the work is not optimized away.
+template <typename F>
+double Measure(F f, uint64_t& sink,
+               std::chrono::milliseconds min_time =
+                   std::chrono::milliseconds{200}) {
+  sink += f();  // warm up
+  uint64_t runs = 0;
+  auto start = std::chrono::steady_clock::now();
+  auto elapsed = std::chrono::steady_clock::duration{};
+  do {
+    sink += f();
+    ++runs;
+    elapsed = std::chrono::steady_clock::now() - start;
+  } while (elapsed < min_time);
+  return std::chrono::duration<double, std::nano>(elapsed).count() / runs;
+}
+
+// Prints a row of the results table, throughput is omitted if "bytes" is zero
+inline void Report(const char* name, const char* variant, double ns,
+                   uint64_t bytes = 0) {
+  std::cout << std::left << std::setw(24) << name << std::setw(16) << variant
+            << std::right << std::fixed << std::setprecision(1)
+            << std::setw(14) << ns / 1000 << " us";
+  if (bytes) {
+    std::cout << std::setw(12) << bytes / ns * 1e9 / (1 << 20) << " MB/s";
+  }
+  std::cout << std::defaultfloat << '\n';
+}
+
+// Benchmarks, see main.cpp
+void RunReadBenchmark();
+void RunMethodTableMapBenchmark();
+void RunCountersBenchmark();
+void RunZerosBenchmark();
+void RunMapsBenchmark();
+void RunThreadsBenchmark();
+void RunJsonBenchmark();
@@ -0,0 +1,99 @@
+// JSON output of a large heap (see Format) written by the streaming
+// JsonWriter against building an nlohmann::json tree and dumping it, which
+// is how the output was produced before. The baseline is built only if
+// nlohmann/json is installed.
+#include <random>
+#include <sstream>
+#include <string>
+
+#include "bench.h"
+#include "format.h"
+#ifdef HAVE_NLOHMANN_JSON
+#include <nlohmann/json.hpp>
+#endif
+
+namespace {
+
+// Type names are about as long as those of a real heap, generics included
+HeapStatistics GenerateStatistics(size_t type_count) {
+  std::mt19937_64 random{42};
+  HeapStatistics statistics{};
+  for (size_t i = 0; i < type_count; ++i) {
+    TypeStatistics type{};
+    for (auto gen = 0; gen < DAC_NUMBERGENERATIONS; ++gen) {
+      type.count[gen] = random() % 4 ? random() % 1000 : 0;
+      type.size_total[gen] = type.count[gen] * (24 + random() % 100 * 8);
+      type.count[DAC_NUMBERGENERATIONS] += type.count[gen];
+      type.size_total[DAC_NUMBERGENERATIONS] += type.size_total[gen];
+      statistics.count[gen] += type.count[gen];
+      statistics.size_total[gen] += type.size_total[gen];
+    }
+    statistics.details.emplace_back(0x7f0000000000 + i * 0x100, type);
+    auto& name = statistics.details.back().name;
+    name = random() % 2 ? "System.Collections.Generic.Dictionary`2[[System."
+                          "String, System.Private.CoreLib],[App.Model.Type"
+                        : "App.Services.Handlers.RequestHandler+<Run>d__";
+    name += std::to_string(i);
+    if (random() % 2) {
+      name += ", App.Model]]";
+    }
+  }
+  return statistics;
+}
+
+std::string Streaming(const HeapStatistics& statistics, int indent) {
+  Options options{};
+  options.format = OutputFormat::Json;
+  options.json_indent = indent;
+  std::ostringstream out;
+  out << Format{statistics, options};
+  return out.str();
+}
+
+#ifdef HAVE_NLOHMANN_JSON
+// Format::PrintJsonFormat before the streaming writer
+std::string Dom(const HeapStatistics& statistics, int indent) {
+  nlohmann::json details{};
+  for (auto& item : statistics.details) {
+    details.push_back({
+        {"name", item.name},
+        {"count", item.statistics.count},
+        {"size_total", item.statistics.size_total},
+    });
+  }
+  nlohmann::json j{{"count", statistics.count},
+                   {"size_total", statistics.size_total},
+                   {"details", details}};
+  std::ostringstream out;
+  out << j.dump(indent) << std::endl;
+  return out.str();
+}
+#endif
+
+}  // namespace
+
+void RunJsonBenchmark() {
+  auto sink = uint64_t{};
+  for (auto type_count : {size_t{10000}, size_t{100000}}) {
+    auto statistics = GenerateStatistics(type_count);
+    for (auto indent : {-1, 4}) {
+      auto name = std::to_string(type_count) + " types" +
+                  (indent < 0 ? "" : ", indent");
+      auto bytes = Streaming(statistics, indent).size();
+      auto streaming = Measure(
+          [&] { return Streaming(statistics, indent).size(); }, sink);
+      Report(name.c_str(), "JsonWriter", streaming, bytes);
+#ifdef HAVE_NLOHMANN_JSON
+      if (Dom(statistics, indent) != Streaming(statistics, indent)) {
+        std::cerr << "Output of " << name << " differs\n";
+      }
+      auto dom =
+          Measure([&] { return Dom(statistics, indent).size(); }, sink);
+      Report(name.c_str(), "nlohmann DOM", dom, bytes);
+#endif
+    }
+  }
+#ifndef HAVE_NLOHMANN_JSON
+  std::cout << "nlohmann/json is not installed, baseline skipped\n";
+#endif
+}
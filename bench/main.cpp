@@ -0,0 +1,62 @@
+// Microbenchmarks of the hot paths. Not built unless GCHEAPSTAT_BENCHMARKS is
+// on. Runs the benchmarks named on the command line, all of them otherwise.
+#include <cstring>
+
+#include "bench.h"
+
+int Log::Level;
+std::atomic<int> Log::ErrorCount;
+std::mutex Log::Mutex;
+
+namespace {
+
+struct Benchmark {
+  const char* name;
+  const char* description;
+  void (*run)();
+};
+
+const Benchmark kBenchmarks[] = {
+    {"read", "process_vm_readv vs /proc/<pid>/mem pread of a child process",
+     RunReadBenchmark},
+    {"mtmap", "MethodTableMap vs std::unordered_map counting objects by type",
+     RunMethodTableMapBenchmark},
+    {"counters", "Per-generation TypeCounters vs a record of all generations",
+     RunCountersBenchmark},
+    {"zeros", "FindNonZero scalar vs SSE2 vs AVX2 over zero gaps",
+     RunZerosBenchmark},
+    {"maps", "MemoryMap parse vs getline+sscanf, lookups of a large maps",
+     RunMapsBenchmark},
+    {"threads", "Thread allocation contexts deduplicated by hash set vs scan",
+     RunThreadsBenchmark},
+    {"json", "JSON output of a large heap streamed vs built as a DOM",
+     RunJsonBenchmark},
+};
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  auto found = 0;
+  for (auto& benchmark : kBenchmarks) {
+    auto selected = argc < 2;
+    for (auto i = 1; i < argc && !selected; ++i) {
+      selected = !strcmp(argv[i], benchmark.name);
+    }
+    if (selected) {
+      std::cout << "# " << benchmark.name << ": " << benchmark.description
+                << '\n';
+      benchmark.run();
+      std::cout << '\n';
+      ++found;
+    }
+  }
+  if (!found) {
+    std::cerr << "Benchmarks:\n";
+    for (auto& benchmark : kBenchmarks) {
+      std::cerr << "  " << std::left << std::setw(8) << benchmark.name
+                << benchmark.description << '\n';
+    }
+    return 1;
+  }
+  return 0;
+}
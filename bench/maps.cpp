@@ -0,0 +1,91 @@
+// Parsing of /proc/<pid>/maps at attach (see MemoryMap) on a generated maps
+// file of a large process, against the getline and sscanf scan it replaced,
+// and the lookups done while reading memory. Both find the last module of the
+// file, the way attach finds libcoreclr.so late in real maps.
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "maps.h"
+#include "maps_generator.h"
+
+namespace {
+
+// Dac::Initialize before MemoryMap, over a string stream rather than the file
+// so that only the parsing is measured. Returns the address of the first
+// mapping of the module.
+uint64_t Scan(const std::string& maps, const std::string& module) {
+  std::istringstream stream{maps};
+  uint64_t address{};
+  auto path = std::vector<char>();
+  for (std::string line; std::getline(stream, line);) {
+    if (path.size() < line.size()) {
+      path.resize(line.size());
+    }
+    auto n = sscanf(line.c_str(), "%" SCNx64 "-%*x %*s %*s %*s %*s %s",
+                    &address, &path[0]);
+    if (n == 2) {
+      auto length = strlen(&path[0]);
+      if (module.size() <= length &&
+          strcmp(&path[length - module.size()], module.c_str()) == 0) {
+        return address;
+      }
+    }
+  }
+  return 0;
+}
+
+}  // namespace
+
+void RunMapsBenchmark() {
+  auto sink = uint64_t{};
+  for (auto line_count : {size_t{1000}, size_t{100000}}) {
+    std::vector<MemoryMap::Region> regions;
+    auto maps = GenerateMaps(line_count, regions);
+    auto module = "lib" +
+                  std::to_string((line_count - 1) / kMapsModuleInterval *
+                                 kMapsModuleInterval) +
+                  ".so";
+    auto name = std::to_string(line_count) + " lines";
+    MemoryMap map;
+    auto parse = Measure(
+        [&] {
+          map.Parse(maps.data(), maps.size());
+          return map.FindModule(module)->first;
+        },
+        sink);
+    Report(name.c_str(), "parse", parse, maps.size());
+    if (Scan(maps, module) != map.FindModule(module)->first) {
+      std::cerr << "Module found in " << name << " differs\n";
+    }
+    auto scan = Measure([&] { return Scan(maps, module); }, sink);
+    Report(name.c_str(), "getline+sscanf", scan, maps.size());
+    std::mt19937_64 random{7};
+    std::vector<uint64_t> addresses;
+    for (auto& region : regions) {
+      addresses.push_back(region.first +
+                          random() % (region.last - region.first));
+    }
+    std::shuffle(addresses.begin(), addresses.end(), random);
+    auto find = Measure(
+        [&] {
+          uint64_t found = 0;
+          for (auto address : addresses) {
+            found += map.GetReadableSize(address, 0x1000);
+          }
+          return found;
+        },
+        sink);
+    Report(name.c_str(), "readable size", find);
+    std::cout << std::left << std::setw(24) << "" << std::setw(16)
+              << "ns per lookup" << std::right << std::fixed
+              << std::setprecision(2) << std::setw(10)
+              << find / addresses.size() << std::defaultfloat << '\n';
+  }
+}
@@ -0,0 +1,200 @@
+// Counting objects by type the way the walker does (see SegmentWalker),
+// MethodTableMap against std::unordered_map of the same TypeCounters. Types
+// of the objects walked are either uniform, or heap-like: a few types are
+// most of the objects (Zipf distribution) and come in runs, as strings and
+// their char arrays or the nodes of a collection do.
+//
+// The "counters" benchmark compares the record layouts counted into: the
+// per-generation TypeCounters maps against a single map of the records the
+// walker used to update, holding the sizes and all the generations.
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "bench.h"
+#include "statistics.h"
+
+namespace {
+
+auto constexpr kObjects = 1 << 20;
+
+enum class Stream { Uniform, HeapLike };
+
+// Method table addresses of the objects walked
+std::vector<uintptr_t> GenerateObjects(size_t type_count, Stream stream) {
+  std::mt19937_64 random{42};
+  std::vector<uintptr_t> types(type_count);
+  for (auto& type : types) {
+    type = 0x7f0000000000 + (random() % (uint64_t{1} << 32)) * 8;
+  }
+  std::vector<uintptr_t> objects;
+  objects.reserve(kObjects);
+  if (stream == Stream::Uniform) {
+    while (objects.size() < kObjects) {
+      objects.push_back(types[random() % type_count]);
+    }
+    return objects;
+  }
+  std::vector<double> weights(type_count);
+  for (size_t i = 0; i < type_count; ++i) {
+    weights[i] = 1.0 / (i + 1);
+  }
+  std::discrete_distribution<size_t> type_index{weights.begin(),
+                                                weights.end()};
+  std::geometric_distribution<int> run_length{0.3};
+  while (objects.size() < kObjects) {
+    auto type = types[type_index(random)];
+    for (auto n = run_length(random) + 1; n && objects.size() < kObjects;
+         --n) {
+      objects.push_back(type);
+    }
+  }
+  return objects;
+}
+
+template <typename Map, typename Find, typename Insert>
+uint64_t Count(const std::vector<uintptr_t>& objects, Find find,
+               Insert insert) {
+  Map map;
+  for (auto mt : objects) {
+    auto counters = find(map, mt);
+    if (!counters) {
+      counters = &insert(map, mt, TypeCounters{24, 0, 0, 0});
+    }
+    ++counters->count;
+    counters->size_total += counters->base_size;
+  }
+  return map.size();
+}
+
+// Record the walker updated for every object before TypeCounters
+struct TypeStatisticsRecord {
+  size_t base_size;
+  size_t component_size;
+  std::array<SIZE_T, DAC_NUMBERGENERATIONS + 1> count;
+  std::array<SIZE_T, DAC_NUMBERGENERATIONS + 1> size_total;
+};
+
+// Generation of the object, the walk goes through a segment in address order:
+// gen#2, gen#1, gen#0, then the Large Object Heap
+int Generation(size_t i) {
+  return i < kObjects * 6 / 10 ? 2 : i < kObjects * 3 / 4 ? 1
+                                  : i < kObjects * 9 / 10 ? 0
+                                                          : 3;
+}
+
+}  // namespace
+
+void RunCountersBenchmark() {
+  auto sink = uint64_t{};
+  for (auto type_count : {100, 10000, 100000}) {
+    auto objects = GenerateObjects(type_count, Stream::HeapLike);
+    auto name = std::to_string(type_count) + " types";
+    size_t record_bytes = 0;
+    auto record = Measure(
+        [&objects, &record_bytes] {
+          MethodTableMap<TypeStatisticsRecord> map;
+          for (size_t i = 0; i < objects.size(); ++i) {
+            auto mt = objects[i];
+            auto gen = Generation(i);
+            auto stat = map.Find(mt);
+            if (!stat) {
+              stat = &map.Insert(mt, TypeStatisticsRecord{24, 0, {}, {}});
+            }
+            ++stat->count[gen];
+            ++stat->count[DAC_NUMBERGENERATIONS];
+            stat->size_total[gen] += stat->base_size;
+            stat->size_total[DAC_NUMBERGENERATIONS] += stat->base_size;
+          }
+          record_bytes = map.capacity() * sizeof(*map.begin());
+          return map.size();
+        },
+        sink);
+    size_t counters_bytes = 0;
+    auto counters = Measure(
+        [&objects, &counters_bytes] {
+          GenerationCounters maps;
+          for (size_t i = 0; i < objects.size(); ++i) {
+            auto mt = objects[i];
+            auto gen = Generation(i);
+            auto counters = maps[gen].Find(mt);
+            if (!counters) {
+              // Sizes are taken from the other generations, if any
+              TypeCounters data{24, 0, 0, 0};
+              for (auto& map : maps) {
+                if (auto found = map.Find(mt)) {
+                  data.base_size = found->base_size;
+                  data.component_size = found->component_size;
+                  break;
+                }
+              }
+              counters = &maps[gen].Insert(mt, data);
+            }
+            ++counters->count;
+            counters->size_total += counters->base_size;
+          }
+          counters_bytes = 0;
+          size_t size = 0;
+          for (auto& map : maps) {
+            counters_bytes += map.capacity() * sizeof(*map.begin());
+            size += map.size();
+          }
+          return size;
+        },
+        sink);
+    Report(name.c_str(), "one record", record);
+    Report(name.c_str(), "per generation", counters);
+    std::cout << std::left << std::setw(24) << "" << std::setw(16)
+              << "ns per object" << std::right << std::fixed
+              << std::setprecision(2) << std::setw(10) << record / kObjects
+              << " vs " << counters / kObjects << '\n'
+              << std::left << std::setw(24) << "" << std::setw(16)
+              << "map KB" << std::right << std::setw(10)
+              << record_bytes / 1024.0 << " vs " << counters_bytes / 1024.0
+              << std::defaultfloat << '\n';
+  }
+}
+
+void RunMethodTableMapBenchmark() {
+  auto sink = uint64_t{};
+  for (auto stream : {Stream::Uniform, Stream::HeapLike}) {
+    for (auto type_count : {100, 10000, 100000}) {
+      auto objects = GenerateObjects(type_count, stream);
+      auto name = std::to_string(type_count) + " types" +
+                  (stream == Stream::Uniform ? ", uniform" : ", heap-like");
+      auto flat = Measure(
+          [&objects] {
+            using Map = MethodTableMap<TypeCounters>;
+            return Count<Map>(
+                objects, [](Map& map, uintptr_t mt) { return map.Find(mt); },
+                [](Map& map, uintptr_t mt,
+                   const TypeCounters& value) -> TypeCounters& {
+                  return map.Insert(mt, value);
+                });
+          },
+          sink);
+      auto node = Measure(
+          [&objects] {
+            using Map = std::unordered_map<uintptr_t, TypeCounters>;
+            return Count<Map>(
+                objects,
+                [](Map& map, uintptr_t mt) -> TypeCounters* {
+                  auto it = map.find(mt);
+                  return it == map.end() ? nullptr : &it->second;
+                },
+                [](Map& map, uintptr_t mt,
+                   const TypeCounters& value) -> TypeCounters& {
+                  return map.emplace(mt, value).first->second;
+                });
+          },
+          sink);
+      Report(name.c_str(), "MethodTableMap", flat);
+      Report(name.c_str(), "unordered_map", node);
+      std::cout << std::left << std::setw(24) << "" << std::setw(16)
+                << "ns per object" << std::right << std::fixed
+                << std::setprecision(2) << std::setw(10) << flat / kObjects
+                << " vs " << node / kObjects << std::defaultfloat << '\n';
+    }
+  }
+}
@@ -0,0 +1,174 @@
+// Reads of a child process memory the ways the Linux data target does (see
+// src/linux/dac.cpp): process_vm_readv with up to 1024 ranges per call against
+// pread of "/proc/<pid>/mem" per range.
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+
+namespace {
+
+auto constexpr kMemorySize = size_t{64} << 20;
+auto constexpr kMaxIovecs = 1024;
+auto constexpr kRandomReads = 4096;
+
+// Child process which memory is read, exits when the parent is gone
+class Child final {
+ public:
+  Child() {
+    int address_pipe[2], exit_pipe[2];
+    if (pipe(address_pipe) || pipe(exit_pipe)) {
+      return;
+    }
+    pid_ = fork();
+    if (pid_ == 0) {
+      close(address_pipe[0]);
+      close(exit_pipe[1]);
+      auto memory = static_cast<char*>(
+          mmap(nullptr, kMemorySize, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+      for (size_t i = 0; i < kMemorySize; i += 64) {
+        memory[i] = static_cast<char>(i >> 6);
+      }
+      auto address = reinterpret_cast<uintptr_t>(memory);
+      if (write(address_pipe[1], &address, sizeof(address)) > 0) {
+        char byte;
+        while (read(exit_pipe[0], &byte, 1) > 0)
+          ;
+      }
+      _exit(0);
+    }
+    close(address_pipe[1]);
+    close(exit_pipe[0]);
+    exit_fd_ = exit_pipe[1];
+    if (pid_ < 0 ||
+        read(address_pipe[0], &address_, sizeof(address_)) !=
+            sizeof(address_)) {
+      address_ = 0;
+    }
+    close(address_pipe[0]);
+  }
+
+  ~Child() {
+    close(exit_fd_);
+    if (0 < pid_) {
+      waitpid(pid_, nullptr, 0);
+    }
+  }
+
+  Child(const Child&) = delete;
+  Child(Child&&) = delete;
+  Child& operator=(const Child&) = delete;
+  Child& operator=(Child&&) = delete;
+
+  int Pid() const { return pid_; }
+  uintptr_t Address() const { return address_; }
+
+ private:
+  int pid_{-1};
+  int exit_fd_{-1};
+  uintptr_t address_{};
+};
+
+struct Range {
+  uintptr_t address;
+  size_t size;
+};
+
+// Up to "batch" ranges are read at once as long as they fit the buffer
+uint64_t ReadVm(int pid, const std::vector<Range>& ranges, int batch,
+                std::vector<char>& buffer) {
+  iovec local[kMaxIovecs];
+  iovec remote[kMaxIovecs];
+  uint64_t read = 0;
+  for (size_t i = 0; i < ranges.size();) {
+    auto n = 0;
+    auto offset = size_t{0};
+    for (; n < batch && i < ranges.size() &&
+           (!n || offset + ranges[i].size <= buffer.size());
+         ++n, ++i) {
+      local[n] = {&buffer[offset], ranges[i].size};
+      remote[n] = {reinterpret_cast<void*>(ranges[i].address),
+                   ranges[i].size};
+      offset += ranges[i].size;
+    }
+    auto res = process_vm_readv(pid, local, n, remote, n, 0);
+    read += res < 0 ? 0 : static_cast<uint64_t>(res);
+  }
+  return read;
+}
+
+uint64_t ReadMemFile(int fd, const std::vector<Range>& ranges,
+                     std::vector<char>& buffer) {
+  uint64_t read = 0;
+  for (auto& range : ranges) {
+    auto res = pread(fd, &buffer[0], range.size, range.address);
+    read += res < 0 ? 0 : static_cast<uint64_t>(res);
+  }
+  return read;
+}
+
+}  // namespace
+
+void RunReadBenchmark() {
+  Child child;
+  if (!child.Address()) {
+    std::cerr << "Could not start the child process\n";
+    return;
+  }
+  auto path = "/proc/" + std::to_string(child.Pid()) + "/mem";
+  auto fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    std::cerr << "Could not open " << path << '\n';
+    return;
+  }
+  std::vector<char> buffer(kMaxIovecs * 0x1000);
+  std::mt19937_64 random{42};
+  auto sink = uint64_t{};
+  // Window reads walk the memory sequentially one at a time, as the next
+  // read depends on the objects of the previous one. Header and page reads
+  // are scattered and batched the way the DAC reads are.
+  struct Case {
+    const char* name;
+    size_t size;
+    bool sequential;
+  };
+  const Case kCases[] = {{"window 1 MB", 1 << 20, true},
+                         {"window 64 KB", 64 << 10, true},
+                         {"page 4 KB", 4 << 10, false},
+                         {"header 24 B", 24, false}};
+  for (auto& c : kCases) {
+    std::vector<Range> ranges;
+    if (c.sequential) {
+      for (size_t offset = 0; offset < kMemorySize; offset += c.size) {
+        ranges.push_back({child.Address() + offset, c.size});
+      }
+    } else {
+      for (auto i = 0; i < kRandomReads; ++i) {
+        auto offset = random() % (kMemorySize - c.size);
+        ranges.push_back({child.Address() + (offset & ~size_t{7}), c.size});
+      }
+    }
+    auto bytes = uint64_t{ranges.size() * c.size};
+    auto batch = c.sequential ? 1 : kMaxIovecs;
+    Report(c.name, "vm_readv",
+           Measure(
+               [&] { return ReadVm(child.Pid(), ranges, batch, buffer); },
+               sink),
+           bytes);
+    Report(c.name, "pread",
+           Measure([&] { return ReadMemFile(fd, ranges, buffer); }, sink),
+           bytes);
+  }
+  close(fd);
+  if (!sink) {
+    std::cerr << "Nothing read\n";
+  }
+}
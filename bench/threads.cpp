@@ -0,0 +1,95 @@
+// Collecting the allocation contexts of the threads (see HeapSnapshot::
+// Initialize) from the thread list of a fake DAC, as done at every sample.
+// Threads of a large process share contexts or have none. Contexts are
+// deduplicated with a hash set against the linear scan per thread it
+// replaced, the DAC requests are the same for both.
+#include <algorithm>
+#include <random>
+#include <string>
+
+#include "bench.h"
+#include "fake_dac.h"
+#include "statistics.h"
+
+namespace {
+
+auto constexpr kHeap = CLRDATA_ADDRESS{0x1000};
+
+void AddThreads(FakeSos& sos, size_t thread_count) {
+  sos.heap_data.HeapCount = 1;
+  sos.heap_data.g_max_generation = 2;
+  sos.heaps[kHeap].heapAddr = kHeap;
+  std::mt19937_64 random{42};
+  std::vector<CLRDATA_ADDRESS> contexts(thread_count);
+  for (size_t i = 0; i < thread_count; ++i) {
+    switch (random() % 8) {
+      case 0:
+        // No context
+        break;
+      case 1:
+        // Context of another thread
+        contexts[i] = contexts[random() % (i + 1)];
+        break;
+      default:
+        contexts[i] = 0x10000000 + i * 0x10000;
+    }
+  }
+  std::shuffle(contexts.begin(), contexts.end(), random);
+  for (auto ptr : contexts) {
+    sos.AddThread(ptr, ptr ? ptr + 0x2000 : 0);
+  }
+}
+
+// Thread allocation contexts the way HeapSnapshot::Initialize collected them
+// before the hash set
+size_t LinearScan(ISOSDacInterface* dac) {
+  std::vector<HeapSnapshot::AllocationContext> allocation_contexts;
+  DacpThreadStoreData threadstore_data{};
+  if (FAILED(threadstore_data.Request(dac))) return 0;
+  DacpThreadData thread_data{};
+  for (auto thread = threadstore_data.firstThread; thread;
+       thread = thread_data.nextThread) {
+    if (FAILED(thread_data.Request(dac, thread))) return 0;
+    if (thread_data.allocContextPtr) {
+      auto i = 0u;
+      for (; i < allocation_contexts.size() &&
+             allocation_contexts[i].ptr != thread_data.allocContextPtr;
+           ++i)
+        ;
+      if (i == allocation_contexts.size())
+        allocation_contexts.push_back(
+            {static_cast<uintptr_t>(thread_data.allocContextPtr),
+             static_cast<uintptr_t>(thread_data.allocContextLimit)});
+    }
+  }
+  std::sort(allocation_contexts.begin(), allocation_contexts.end(),
+            [](auto& a, auto& b) { return a.ptr < b.ptr; });
+  return allocation_contexts.size();
+}
+
+}  // namespace
+
+void RunThreadsBenchmark() {
+  auto sink = uint64_t{};
+  for (auto thread_count : {size_t{1000}, size_t{10000}, size_t{30000}}) {
+    FakeDac dac;
+    auto& sos = dac.Sos();
+    AddThreads(sos, thread_count);
+    auto name = std::to_string(thread_count) + " threads";
+    auto initialize = Measure(
+        [&sos] {
+          HeapSnapshot heap{};
+          heap.Initialize(&sos);
+          return heap.allocation_contexts.size();
+        },
+        sink);
+    auto linear = Measure([&sos] { return LinearScan(&sos); }, sink);
+    Report(name.c_str(), "hash set", initialize);
+    Report(name.c_str(), "linear scan", linear);
+    std::cout << std::left << std::setw(24) << "" << std::setw(16)
+              << "ns per thread" << std::right << std::fixed
+              << std::setprecision(2) << std::setw(10)
+              << initialize / thread_count << " vs " << linear / thread_count
+              << std::defaultfloat << '\n';
+  }
+}
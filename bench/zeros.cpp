@@ -0,0 +1,42 @@
+// Scans of zero gaps (see SegmentWalker), FindNonZero implementations against
+// each other over ranges of various sizes.
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "zeros.h"
+
+void RunZerosBenchmark() {
+  using Find = const BYTE* (*)(const BYTE*, const BYTE*);
+  struct Implementation {
+    const char* name;
+    Find find;
+  };
+  std::vector<Implementation> implementations{
+      {"scalar", FindNonZeroScalar}, {"sse2", FindNonZeroSse2}};
+  if (IsAvx2Supported()) {
+    implementations.push_back({"avx2", FindNonZeroAvx2});
+  }
+  auto constexpr kBufferSize = size_t{1} << 20;
+  std::vector<BYTE> buffer(kBufferSize * 2 + 1, 0);
+  auto sink = uint64_t{};
+  // Gaps start at object boundaries, one byte past alignment is the worst case
+  for (auto size : {size_t{64}, size_t{4096}, kBufferSize}) {
+    auto name = "gap " + std::to_string(size) + " B";
+    // Same number of bytes scanned by each run
+    auto count = kBufferSize / size;
+    for (auto& implementation : implementations) {
+      auto ns = Measure(
+          [&] {
+            uint64_t found = 0;
+            for (size_t i = 0; i < count; ++i) {
+              auto first = &buffer[1 + i * size];
+              found += implementation.find(first, first + size) - first;
+            }
+            return found;
+          },
+          sink);
+      Report(name.c_str(), implementation.name, ns, count * size);
+    }
+  }
+}
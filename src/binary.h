@@ -0,0 +1,161 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <string>
+#include <vector>
+
+// Binary output format (/format:binary), a stream of records, one per sample.
+// Integers are little-endian, the byte order of the platforms supported.
+// A record is:
+//
+//   BinaryHeader
+//   BinaryRow[row_count], row_size bytes each
+//   names, UTF-8, not terminated
+//
+// Fields are only ever appended to the header and the rows, so a reader uses
+// header_size and row_size to find what follows and ignores the fields it
+// does not know. Version changes if a field changes its meaning.
+//
+// The header has no dependencies, consumers may copy it.
+
+auto constexpr kBinaryMagic = "GCHS";
+auto constexpr kBinaryVersion = 1;
+// Generations 0 to 2, Large Object Heap, and all of them
+auto constexpr kBinaryGenerations = 5;
+
+struct BinaryHeader {
+  char magic[4];  // "GCHS"
+  uint16_t version;
+  uint16_t header_size;
+  uint64_t size;  // of the whole record, the header included
+  uint64_t time;  // milliseconds since the Unix epoch
+  uint32_t row_size;
+  uint32_t row_count;
+  uint64_t names_size;
+  uint64_t count[kBinaryGenerations];
+  uint64_t size_total[kBinaryGenerations];
+  uint32_t pid;  // zero unless the output is of several targets
+  uint32_t reserved;
+};
+
+struct BinaryRow {
+  uint64_t mt;
+  uint64_t count[kBinaryGenerations];
+  uint64_t size_total[kBinaryGenerations];
+  uint64_t name_offset;  // relative to names
+  uint32_t name_size;
+  uint32_t reserved;
+};
+
+// Reads records from memory, i.e. the whole output of the tool. Records are
+// validated before use, reading stops at the first one not valid.
+//
+//   BinaryReader reader{data, size};
+//   while (reader.Next()) {
+//     for (uint32_t i = 0; i < reader.Header().row_count; ++i) {
+//       auto row = reader.Row(i);
+//       auto name = reader.Name(row);
+//     }
+//   }
+class BinaryReader final {
+ public:
+  BinaryReader(const void* data, size_t size)
+      : data_{static_cast<const char*>(data)}, size_{size} {}
+
+  // Reads a record from the stream, appends it to "buffer". The record is
+  // validated the same way as by Next, its size before it is allocated.
+  // Nothing is appended if the record is not valid.
+  static bool ReadRecord(std::istream& in, std::vector<char>& buffer) {
+    BinaryHeader header{};
+    auto start = buffer.size();
+    buffer.resize(start + kPrefixSize);
+    if (!in.read(&buffer[start], kPrefixSize)) {
+      buffer.resize(start);
+      return false;
+    }
+    memcpy(&header, &buffer[start], kPrefixSize);
+    if (memcmp(header.magic, kBinaryMagic, sizeof(header.magic)) != 0 ||
+        header.version != kBinaryVersion ||
+        header.header_size < offsetof(BinaryHeader, count) ||
+        header.size < header.header_size || kMaxRecordSize < header.size) {
+      buffer.resize(start);
+      return false;
+    }
+    auto size = static_cast<size_t>(header.size);
+    buffer.resize(start + size);
+    if (!in.read(&buffer[start + kPrefixSize],
+                 static_cast<std::streamsize>(size - kPrefixSize)) ||
+        !BinaryReader{&buffer[start], size}.Next()) {
+      buffer.resize(start);
+      return false;
+    }
+    return true;
+  }
+
+  // Moves to the next record, false if there is none or it is not valid
+  bool Next() {
+    offset_ += header_.size;
+    header_ = BinaryHeader{};
+    if (size_ - offset_ < kPrefixSize) {
+      return false;
+    }
+    auto data = data_ + offset_;
+    uint16_t header_size;
+    memcpy(&header_size, data + offsetof(BinaryHeader, header_size),
+           sizeof(header_size));
+    if (header_size < offsetof(BinaryHeader, count) ||
+        size_ - offset_ < header_size) {
+      return false;
+    }
+    memcpy(&header_, data,
+           header_size < sizeof(header_) ? header_size : sizeof(header_));
+    auto rows = static_cast<uint64_t>(header_.row_size) * header_.row_count;
+    if (memcmp(header_.magic, kBinaryMagic, sizeof(header_.magic)) != 0 ||
+        header_.version != kBinaryVersion ||
+        header_.row_size < offsetof(BinaryRow, reserved) ||
+        size_ - offset_ < header_.size || header_.size < header_size ||
+        (header_.size - header_size) < rows ||
+        header_.size - header_size - rows < header_.names_size) {
+      header_ = BinaryHeader{};
+      return false;
+    }
+    rows_ = data + header_size;
+    names_ = rows_ + rows;
+    return true;
+  }
+
+  const BinaryHeader& Header() const { return header_; }
+
+  // Row of the current record, "i" is less than the row count
+  BinaryRow Row(uint32_t i) const {
+    BinaryRow row{};
+    memcpy(&row, rows_ + static_cast<size_t>(i) * header_.row_size,
+           header_.row_size < sizeof(row) ? header_.row_size : sizeof(row));
+    return row;
+  }
+
+  // Empty if the name is out of the names of the record
+  std::string Name(const BinaryRow& row) const {
+    if (header_.names_size < row.name_offset ||
+        header_.names_size - row.name_offset < row.name_size) {
+      return {};
+    }
+    return {names_ + row.name_offset, row.name_size};
+  }
+
+ private:
+  // Header fields up to the record size
+  static auto constexpr kPrefixSize = offsetof(BinaryHeader, time);
+  // Records read from a stream are not larger, 1 GB is about 10 million
+  // types
+  static auto constexpr kMaxRecordSize = uint64_t{1} << 30;
+
+  const char* data_;
+  size_t size_;
+  size_t offset_{};  // of the current record
+  BinaryHeader header_{};
+  const char* rows_{};
+  const char* names_{};
+};
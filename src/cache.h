@@ -0,0 +1,177 @@
+#pragma once
+#include <algorithm>
+#include <unordered_map>
+
+#include "dac.h"
+
+// LRU cache of the target memory pages. DAC reads runtime data structures in
+// small chunks, many times the same, so it makes sense to cache them. Not
+// intended for bulk reads (i.e. segment memory), those go past the cache.
+class PageCache final {
+ public:
+  static auto constexpr kPageSize = 0x1000;
+  static auto constexpr kDefaultCapacity = 4096;  // 16 MB
+  // Reads spanning more pages go directly to the target
+  static auto constexpr kMaxPagesPerRead = 4;
+
+  PageCache(IDac* dac, size_t capacity) : dac_{dac}, capacity_{capacity} {}
+
+  PageCache(const PageCache&) = delete;
+  PageCache(PageCache&&) = delete;
+  PageCache& operator=(const PageCache&) = delete;
+  PageCache& operator=(PageCache&&) = delete;
+
+  // Returns number of bytes read, reading stops at the first unreadable page
+  ULONG32 Read(CLRDATA_ADDRESS address, BYTE* buffer, ULONG32 size) {
+    if (!size) {
+      return 0;
+    }
+    auto first = static_cast<uintptr_t>(address) & ~(kPageSize - 1);
+    auto last =
+        static_cast<uintptr_t>(address + size - 1) & ~(kPageSize - 1);
+    auto count = (last - first) / kPageSize + 1;
+    if (kMaxPagesPerRead < count || capacity_ < kMaxPagesPerRead) {
+      ReadRequest request{address, buffer, size};
+      dac_->ReadMemory(&request, 1);
+      return request.read;
+    }
+    // Lookup pages, read missing ones at once
+    uint32_t slots[kMaxPagesPerRead];
+    bool valid[kMaxPagesPerRead];
+    ReadRequest requests[kMaxPagesPerRead];
+    uint32_t missing_slots[kMaxPagesPerRead];
+    size_t missing = 0;
+    for (size_t i = 0; i < count; ++i) {
+      auto page = first + i * kPageSize;
+      auto it = index_.find(page);
+      valid[i] = it != index_.end();
+      if (valid[i]) {
+        ++statistics_.hits;
+        slots[i] = it->second;
+        Touch(slots[i]);
+      } else {
+        ++statistics_.misses;
+        slots[i] = Allocate(page, slots, i);
+        missing_slots[missing] = slots[i];
+        requests[missing++] = {page, nullptr, kPageSize};
+      }
+    }
+    if (missing) {
+      // Storage might have been reallocated, assign buffers at the very end
+      for (size_t i = 0; i < missing; ++i) {
+        requests[i].buffer = &data_[missing_slots[i] * kPageSize];
+      }
+      dac_->ReadMemory(requests, missing);
+      for (size_t i = 0, j = 0; i < count; ++i) {
+        if (!valid[i] && requests[j++].read == kPageSize) {
+          valid[i] = true;
+        } else if (!valid[i]) {
+          Free(slots[i]);
+        }
+      }
+    }
+    // Copy
+    ULONG32 read = 0;
+    for (size_t i = 0; i < count && valid[i]; ++i) {
+      auto page = first + i * kPageSize;
+      auto from = (std::max)(page, static_cast<uintptr_t>(address));
+      auto to = (std::min)(page + kPageSize,
+                           static_cast<uintptr_t>(address + size));
+      memcpy(buffer + read, &data_[slots[i] * kPageSize + (from - page)],
+             to - from);
+      read += static_cast<ULONG32>(to - from);
+    }
+    return read;
+  }
+
+  const CacheStatistics& GetStatistics() const { return statistics_; }
+
+  // Drops all the pages, memory is kept for reuse
+  void Clear() {
+    slots_.clear();
+    free_.clear();
+    index_.clear();
+    head_ = tail_ = kNone;
+  }
+
+ private:
+  static auto constexpr kNone = ~uint32_t{};
+
+  struct Slot {
+    uintptr_t page;
+    uint32_t prev;  // more recently used
+    uint32_t next;  // less recently used
+  };
+
+  // Returns slot for a new page, evicts the least recently used page if the
+  // cache is full. Slots of the current read are never evicted.
+  uint32_t Allocate(uintptr_t page, const uint32_t* pinned, size_t count) {
+    uint32_t slot;
+    if (!free_.empty()) {
+      slot = free_.back();
+      free_.pop_back();
+    } else if (slots_.size() < capacity_) {
+      slot = static_cast<uint32_t>(slots_.size());
+      slots_.push_back({});
+      data_.resize(slots_.size() * kPageSize);
+    } else {
+      slot = tail_;
+      while (std::find(pinned, pinned + count, slot) != pinned + count) {
+        slot = slots_[slot].prev;
+      }
+      ++statistics_.evictions;
+      index_.erase(slots_[slot].page);
+      Unlink(slot);
+    }
+    slots_[slot].page = page;
+    index_.emplace(page, slot);
+    Link(slot);
+    return slot;
+  }
+
+  // Releases slot of the page which could not be read
+  void Free(uint32_t slot) {
+    index_.erase(slots_[slot].page);
+    Unlink(slot);
+    free_.push_back(slot);
+  }
+
+  void Touch(uint32_t slot) {
+    if (head_ != slot) {
+      Unlink(slot);
+      Link(slot);
+    }
+  }
+
+  void Link(uint32_t slot) {
+    slots_[slot].prev = kNone;
+    slots_[slot].next = head_;
+    if (head_ != kNone) slots_[head_].prev = slot;
+    head_ = slot;
+    if (tail_ == kNone) tail_ = slot;
+  }
+
+  void Unlink(uint32_t slot) {
+    auto& s = slots_[slot];
+    if (s.prev != kNone) {
+      slots_[s.prev].next = s.next;
+    } else {
+      head_ = s.next;
+    }
+    if (s.next != kNone) {
+      slots_[s.next].prev = s.prev;
+    } else {
+      tail_ = s.prev;
+    }
+  }
+
+  IDac* dac_;
+  size_t capacity_;  // in pages
+  std::vector<Slot> slots_;
+  std::vector<BYTE> data_;
+  std::vector<uint32_t> free_;
+  std::unordered_map<uintptr_t, uint32_t> index_;
+  uint32_t head_{kNone};  // most recently used
+  uint32_t tail_{kNone};  // least recently used
+  CacheStatistics statistics_{};
+};
@@ -1,12 +1,49 @@
 #pragma once
 #include <dacprivate.h>
 
+#include <algorithm>
+
+struct ReadRequest {
+  CLRDATA_ADDRESS address;
+  BYTE* buffer;
+  ULONG32 size;
+  ULONG32 read;  // number of bytes read, set on return
+};
+
+struct CacheStatistics {
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t evictions;
+};
+
 struct IDac {
   virtual ~IDac() = default;
   virtual IXCLRDataTarget3* GetXCLRDataTarget3() = 0;
   virtual ISOSDacInterface* GetSOSDacInterface() = 0;
+  // Reads many ranges of the target memory at once. Returns S_OK if all the
+  // bytes requested are read, S_FALSE if some of the ranges are read partially
+  // or not read at all, error code if the target memory can not be accessed.
+  virtual HRESULT ReadMemory(ReadRequest* requests, size_t count) = 0;
+  // Statistics of the page cache serving DAC reads
+  virtual CacheStatistics GetCacheStatistics() = 0;
+  // Returns pointer to "size" bytes of the target memory if they can be
+  // accessed without copying (i.e. mapped from a snapshot file), nullptr
+  // otherwise
+  virtual const BYTE* MapMemory(CLRDATA_ADDRESS address, size_t size) = 0;
+  // Returns number of bytes at "address", up to "size", in readable memory
+  // of the target according to its memory map, "size" if the map is not
+  // known (i.e. the target is a file). The map is cached until refreshed.
+  virtual size_t GetReadableSize(CLRDATA_ADDRESS address, size_t size) = 0;
+  // Reads the memory map of the target again. Not to be called while other
+  // threads read the target.
+  virtual void RefreshMemoryMap() = 0;
+  // Drops target data cached by the DAC and the page cache, next requests
+  // see the current state of the target
+  virtual void Flush() = 0;
 };
 
+// Gets type names from the DAC. Buffers are reused, so resolving many names
+// does not allocate once they are large enough. Not thread safe.
 class TypeNameProvider final {
  public:
   explicit TypeNameProvider(IDac* dac)
@@ -17,27 +54,70 @@ class TypeNameProvider final {
   TypeNameProvider& operator=(const TypeNameProvider&) = delete;
   TypeNameProvider& operator=(TypeNameProvider&&) = delete;
 
-  std::string operator()(CLRDATA_ADDRESS address) {
+  // Returns UTF-8 name, valid until the next call
+  const std::string& operator()(CLRDATA_ADDRESS address) {
     for (auto i = 0;; ++i) {
       uint32_t needed = 0;
-      auto hr = sos_->GetMethodTableName(address, buffer_.size(), &buffer_[0],
-                                         &needed);
+      auto hr = sos_->GetMethodTableName(
+          address, static_cast<unsigned int>(buffer_.size()), &buffer_[0],
+          &needed);
       if (FAILED(hr)) {
         std::ostringstream name{};
         name << " <error getting class name, code " << hr;
-        return name.str();
+        return name_ = name.str();
       }
       if (needed <= buffer_.size() || 0 < i) {
-        return std::wstring_convert<std::codecvt_utf8_utf16<WCHAR>, WCHAR>{}
-            .to_bytes(&buffer_[0]);
+        auto length = std::find(buffer_.cbegin(), buffer_.cend(), WCHAR{}) -
+                      buffer_.cbegin();
+        ToUtf8(&buffer_[0], static_cast<size_t>(length), name_);
+        return name_;
       }
       buffer_.resize(needed);
     }
   }
 
  private:
+  // Unpaired surrogates are replaced with U+FFFD. A UTF-16 code unit takes
+  // at most 3 bytes in UTF-8, a surrogate pair takes 4.
+  static void ToUtf8(const WCHAR* str, size_t length, std::string& out) {
+    out.resize(length * 3);
+    auto dst = &out[0];
+    for (size_t i = 0; i < length; ++i) {
+      uint32_t c = static_cast<uint16_t>(str[i]);
+      if (c < 0x80) {
+        *dst++ = static_cast<char>(c);
+        continue;
+      }
+      if (c < 0x800) {
+        *dst++ = static_cast<char>(0xC0 | c >> 6);
+        *dst++ = static_cast<char>(0x80 | (c & 0x3F));
+        continue;
+      }
+      if (0xD800 <= c && c < 0xE000) {
+        uint32_t low = i + 1 < length ? static_cast<uint16_t>(str[i + 1]) : 0;
+        if (c < 0xDC00 && 0xDC00 <= low && low < 0xE000) {
+          c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+          ++i;
+          *dst++ = static_cast<char>(0xF0 | c >> 18);
+          *dst++ = static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+          *dst++ = static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+          *dst++ = static_cast<char>(0x80 | (c & 0x3F));
+          continue;
+        }
+        c = 0xFFFD;
+      }
+      *dst++ = static_cast<char>(0xE0 | c >> 12);
+      *dst++ = static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+      *dst++ = static_cast<char>(0x80 | (c & 0x3F));
+    }
+    out.resize(static_cast<size_t>(dst - &out[0]));
+  }
+
   ISOSDacInterface* sos_;
   std::vector<WCHAR> buffer_;
+  std::string name_;
 };
 
 std::unique_ptr<IDac> CreateDac(int pid);
+// Target is an ELF core file of a .NET process (i.e. written by createdump)
+std::unique_ptr<IDac> CreateCoreDac(const std::string& path);
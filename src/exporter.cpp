@@ -0,0 +1,200 @@
+#include "exporter.h"
+
+namespace {
+
+// Minimum time between samples unless /interval is given, failed ones too
+auto constexpr kRefreshSeconds = 10u;
+auto constexpr kMaxRequestSize = 8192;
+auto constexpr kContentType =
+    "application/openmetrics-text; version=1.0.0; charset=utf-8";
+
+const char* const kGenerations[] = {"0", "1", "2", "loh"};
+
+// Quotes, backslashes and line breaks are escaped
+void WriteLabel(std::ostream& out, const std::string& value) {
+  out << '"';
+  for (auto c : value) {
+    if (c == '"' || c == '\\') {
+      out << '\\' << c;
+    } else if (c == '\n') {
+      out << "\\n";
+    } else {
+      out << c;
+    }
+  }
+  out << '"';
+}
+
+void WriteFamily(std::ostream& out, const char* name, const char* unit,
+                 const char* help) {
+  out << "# TYPE " << name << " gauge\n";
+  if (unit) {
+    out << "# UNIT " << name << ' ' << unit << '\n';
+  }
+  out << "# HELP " << name << ' ' << help << '\n';
+}
+
+std::string FormatMetrics(const HeapStatistics& statistics,
+                          std::chrono::system_clock::time_point time,
+                          std::chrono::steady_clock::duration duration) {
+  using Counters = std::array<SIZE_T, DAC_NUMBERGENERATIONS + 1>;
+  struct Family {
+    const char* name;
+    const char* unit;
+    const char* help;
+    Counters TypeStatistics::*field;
+  };
+  static const Family kTypeFamilies[] = {
+      {"gcheapstat_type_objects", nullptr,
+       "Objects of the top types by generation.", &TypeStatistics::count},
+      {"gcheapstat_type_size_bytes", "bytes",
+       "Size of the objects of the top types by generation.",
+       &TypeStatistics::size_total}};
+  std::ostringstream out{};
+  auto write_heap = [&out](const char* name, const char* unit,
+                           const char* help, const Counters& counters) {
+    WriteFamily(out, name, unit, help);
+    for (auto gen = 0; gen < DAC_NUMBERGENERATIONS; ++gen) {
+      out << name << "{generation=\"" << kGenerations[gen] << "\"} "
+          << counters[gen] << '\n';
+    }
+  };
+  write_heap("gcheapstat_heap_objects", nullptr,
+             "Objects on the managed heap by generation.", statistics.count);
+  write_heap("gcheapstat_heap_size_bytes", "bytes",
+             "Size of the objects on the managed heap by generation.",
+             statistics.size_total);
+  // Zero values are left out, the number of series is large enough
+  for (auto& family : kTypeFamilies) {
+    WriteFamily(out, family.name, family.unit, family.help);
+    for (auto& item : statistics.details) {
+      auto& counters = item.statistics.*family.field;
+      for (auto gen = 0; gen < DAC_NUMBERGENERATIONS; ++gen) {
+        if (!counters[gen]) {
+          continue;
+        }
+        // Method table tells apart types of the same name
+        out << family.name << "{mt=\"0x" << std::hex
+            << item.method_table_address << std::dec << "\",type=";
+        WriteLabel(out, item.name);
+        out << ",generation=\"" << kGenerations[gen] << "\"} "
+            << counters[gen] << '\n';
+      }
+    }
+  }
+  out << std::fixed << std::setprecision(3);
+  WriteFamily(out, "gcheapstat_sample_duration_seconds", "seconds",
+              "Time the last sample took.");
+  out << "gcheapstat_sample_duration_seconds "
+      << std::chrono::duration<double>(duration).count() << '\n';
+  WriteFamily(out, "gcheapstat_sample_timestamp_seconds", "seconds",
+              "Time the last sample was taken at, since the Unix epoch.");
+  out << "gcheapstat_sample_timestamp_seconds "
+      << std::chrono::duration<double>(time.time_since_epoch()).count()
+      << '\n';
+  out << "# EOF\n";
+  return out.str();
+}
+
+void Respond(IConnection& connection, const char* status,
+             const char* content_type, const std::string& body, bool head) {
+  std::ostringstream response{};
+  response << "HTTP/1.1 " << status << "\r\n"
+           << "Content-Type: " << content_type << "\r\n"
+           << "Content-Length: " << body.size() << "\r\n"
+           << "Connection: close\r\n\r\n";
+  if (!head) {
+    response << body;
+  }
+  auto data = response.str();
+  connection.Send(data.data(), data.size());
+}
+
+}  // namespace
+
+void HeapExporter::Run() {
+  // Never sampled, the target is not a .NET process or not accessible
+  if (!Refresh()) {
+    return;
+  }
+  auto listener = Listen(options_.serve);
+  if (!listener) {
+    return;
+  }
+  Debug() << "Serving metrics at " << options_.serve;
+  while (auto connection = listener->Accept()) {
+    Handle(*connection);
+  }
+}
+
+void HeapExporter::Handle(IConnection& connection) {
+  std::string request;
+  char buffer[1024];
+  while (request.find("\r\n\r\n") == std::string::npos) {
+    auto size = connection.Receive(buffer, sizeof(buffer));
+    if (!size) {
+      return;
+    }
+    request.append(buffer, size);
+    if (kMaxRequestSize < request.size()) {
+      Respond(connection, "431 Request Header Fields Too Large", "text/plain",
+              "Request is too large\n", false);
+      return;
+    }
+  }
+  // Request line is "method target version"
+  auto method_end = request.find(' ');
+  auto target_end = request.find_first_of(" ?\r", method_end + 1);
+  if (method_end == std::string::npos || target_end == std::string::npos) {
+    Respond(connection, "400 Bad Request", "text/plain", "Bad request\n",
+            false);
+    return;
+  }
+  auto method = request.substr(0, method_end);
+  auto target = request.substr(method_end + 1, target_end - method_end - 1);
+  auto head = method == "HEAD";
+  if (method != "GET" && !head) {
+    Respond(connection, "405 Method Not Allowed", "text/plain",
+            "Only GET is supported\n", false);
+    return;
+  }
+  if (target != "/metrics" && target != "/") {
+    Respond(connection, "404 Not Found", "text/plain",
+            "Metrics are at /metrics\n", head);
+    return;
+  }
+  if (!Refresh()) {
+    Respond(connection, "503 Service Unavailable", "text/plain",
+            "Heap statistics could not be taken\n", head);
+    return;
+  }
+  Respond(connection, "200 OK", kContentType, metrics_, head);
+}
+
+bool HeapExporter::Refresh() {
+  auto refresh = std::chrono::seconds{
+      options_.interval ? options_.interval : kRefreshSeconds};
+  auto start = std::chrono::steady_clock::now();
+  if (start < next_sample_) {
+    return !metrics_.empty();
+  }
+  // Target which can not be sampled is not retried on every scrape
+  next_sample_ = start + refresh;
+  auto time = std::chrono::system_clock::now();
+  auto errors = Log::ErrorCount.load();
+  HeapStatistics statistics{};
+  if (!generator_.Run(statistics) ||
+      (options_.strict && errors != Log::ErrorCount)) {
+    Debug() << "Sample failed, next attempt in " << refresh.count() << " s";
+    metrics_.clear();
+    return false;
+  }
+  metrics_ = FormatMetrics(statistics, time,
+                           std::chrono::steady_clock::now() - start);
+  Debug() << "Sample took "
+          << std::chrono::duration_cast<std::chrono::milliseconds>(
+                 std::chrono::steady_clock::now() - start)
+                 .count()
+          << " ms, " << statistics.details.size() << " types exported";
+  return true;
+}
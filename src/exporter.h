@@ -0,0 +1,39 @@
+#pragma once
+#include <chrono>
+
+#include "socket.h"
+#include "statistics.h"
+
+// Serves heap statistics of the target over HTTP in OpenMetrics text format,
+// per generation totals and the top types (see /sort and /limit). The DAC
+// stays attached between scrapes. A scrape takes a new sample unless the last
+// one is younger than the refresh interval, and connections are handled one
+// at a time, so a burst of scrapes never walks the heap concurrently. Once a
+// sample fails, scrapes are answered with 503 until the refresh interval has
+// passed, then the target is sampled again.
+class HeapExporter final {
+ public:
+  explicit HeapExporter(const Options& options)
+      : options_{options}, generator_{options} {}
+
+  HeapExporter(const HeapExporter&) = delete;
+  HeapExporter(HeapExporter&&) = delete;
+  HeapExporter& operator=(const HeapExporter&) = delete;
+  HeapExporter& operator=(HeapExporter&&) = delete;
+
+  // Serves until connections can not be accepted anymore, returns at once if
+  // the target can not be sampled
+  void Run();
+  // Answers the request of the connection
+  void Handle(IConnection& connection);
+
+ private:
+  // Takes a new sample unless the last attempt is recent enough, false if
+  // there are no metrics to serve
+  bool Refresh();
+
+  const Options& options_;
+  HeapStatisticsGenerator generator_;
+  std::string metrics_;  // of the last sample, empty if it failed
+  std::chrono::steady_clock::time_point next_sample_;
+};
@@ -0,0 +1,89 @@
+#include "fleet.h"
+
+#include <atomic>
+#include <future>
+#include <thread>
+
+#include "format.h"
+#include "process.h"
+
+void FleetScan::Run(std::ostream& out) {
+  auto pids = options_.all_pids ? FindDotNetProcesses() : options_.pids;
+  if (pids.empty()) {
+    Error() << "No .NET processes found";
+    return;
+  }
+  auto jobs = (std::min)(static_cast<size_t>(options_.jobs), pids.size());
+  Debug() << "Analyzing " << pids.size() << " process(es), " << jobs
+          << " at a time";
+  std::vector<std::promise<Result>> results(pids.size());
+  std::vector<std::future<Result>> futures;
+  for (auto& result : results) {
+    futures.push_back(result.get_future());
+  }
+  std::atomic<size_t> next{0};
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < jobs; ++i) {
+    workers.emplace_back([this, &pids, &results, &next] {
+      for (size_t i; (i = next++) < pids.size();) {
+        results[i].set_value(Analyze(pids[i]));
+      }
+    });
+  }
+  // JSON output is a single document, an array of the objects of processes
+  auto json = options_.format == OutputFormat::Json;
+  if (json) {
+    out << "[\n";
+  }
+  auto failed = 0;
+  for (size_t i = 0; i < pids.size(); ++i) {
+    auto result = futures[i].get();
+    if (!result.ok) {
+      ++failed;
+      continue;
+    }
+    if (json && i != static_cast<size_t>(failed)) {
+      out << ",\n";
+    }
+    out.write(result.output.data(),
+              static_cast<std::streamsize>(result.output.size()));
+    out.flush();
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  if (json) {
+    out << "]" << std::endl;
+  }
+  if (failed) {
+    Error() << failed << " of " << pids.size()
+            << " process(es) could not be analyzed";
+  }
+}
+
+FleetScan::Result FleetScan::Analyze(int pid) const {
+  auto options = options_;
+  options.pid = pid;
+  options.all_pids = false;
+  options.pids.clear();
+  auto start = std::chrono::steady_clock::now();
+  auto time = std::chrono::system_clock::now();
+  HeapStatistics statistics{};
+  try {
+    if (!HeapStatisticsGenerator::Run(options, statistics)) {
+      Error() << "Process " << pid << " could not be analyzed";
+      return {false, {}};
+    }
+    std::ostringstream output{};
+    output << Format{statistics, options, time, pid};
+    Debug() << "Process " << pid << " analyzed in "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(
+                   std::chrono::steady_clock::now() - start)
+                   .count()
+            << " ms";
+    return {true, output.str()};
+  } catch (std::exception& exception) {
+    Error() << "Process " << pid << ": " << exception.what();
+    return {false, {}};
+  }
+}
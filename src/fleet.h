@@ -0,0 +1,30 @@
+#pragma once
+#include "statistics.h"
+
+// Analyzes several processes, /pid:all or a list of IDs. Every process has
+// its own generator and up to /jobs of them run at once, so the scan takes
+// about as long as the largest process rather than all of them together.
+// Results are printed in the order of process IDs, each as soon as those
+// before it are done. JSON output is an array of the objects of processes,
+// labeled with "pid".
+class FleetScan final {
+ public:
+  explicit FleetScan(const Options& options) : options_{options} {}
+
+  FleetScan(const FleetScan&) = delete;
+  FleetScan(FleetScan&&) = delete;
+  FleetScan& operator=(const FleetScan&) = delete;
+  FleetScan& operator=(FleetScan&&) = delete;
+
+  void Run(std::ostream& out);
+
+ private:
+  struct Result {
+    bool ok;
+    std::string output;  // formatted statistics
+  };
+
+  Result Analyze(int pid) const;
+
+  const Options& options_;
+};
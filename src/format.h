@@ -1,25 +1,50 @@
 #pragma once
-#include <nlohmann/json.hpp>
+#include <algorithm>
+#include <chrono>
 
+#include "binary.h"
+#include "json.h"
 #include "statistics.h"
 
 class Format final {
  public:
-  Format(const HeapStatistics& statistics, const Options& options)
-      : statistics_{statistics}, options_{options} {}
+  // Output is labeled with "pid" unless it is zero, i.e. statistics of one
+  // of several targets
+  Format(const HeapStatistics& statistics, const Options& options,
+         std::chrono::system_clock::time_point time =
+             std::chrono::system_clock::now(),
+         int pid = 0)
+      : statistics_{statistics}, options_{options}, time_{time}, pid_{pid} {}
 
  private:
   void Print(std::ostream& out) const {
-    if (options_.json) {
-      PrintJsonFormat(out);
-    } else {
-      PrintWinDbgFormat(out);
+    switch (options_.format) {
+      case OutputFormat::Json:
+        PrintJsonFormat(out);
+        break;
+      case OutputFormat::NdJson:
+        PrintNdJsonFormat(out);
+        break;
+      case OutputFormat::Binary:
+        PrintBinaryFormat(out);
+        break;
+      default:
+        PrintWinDbgFormat(out);
+    }
+    // Records have no room for it, keep the output parsable
+    if (statistics_.profile.enabled &&
+        (options_.format == OutputFormat::NdJson ||
+         options_.format == OutputFormat::Binary)) {
+      PrintProfile(std::cerr);
     }
   }
 
   void PrintWinDbgFormat(std::ostream& out) const {
     auto first = statistics_.details.cbegin();
     auto last = statistics_.details.cend();
+    if (pid_) {
+      out << "Process " << pid_ << '\n';
+    }
 #ifdef _WIN64
     out << "              MT    Count    TotalSize Class Name\n";
 #else
@@ -48,25 +73,173 @@ class Format final {
         << std::endl;
     out << "Total size " << statistics_.size_total[DAC_NUMBERGENERATIONS]
         << " bytes" << std::endl;
+    if (statistics_.profile.enabled) {
+      PrintProfile(out);
+    }
+    if (pid_) {
+      out << std::endl;
+    }
+  }
+
+  void PrintProfile(std::ostream& out) const {
+    auto& profile = statistics_.profile;
+    if (pid_) {
+      out << "Profile of process " << pid_ << '\n';
+    } else {
+      out << "Profile\n";
+    }
+    out << std::left << std::fixed << std::setprecision(3);
+    for (auto i = 0; i < kPhaseCount; ++i) {
+      out << "  " << std::setw(26) << kPhaseNames[i] << std::right
+          << std::setw(12)
+          << std::chrono::duration<double, std::milli>(profile.time[i]).count()
+          << " ms" << std::left << '\n';
+    }
+    for (auto i = 0; i < kCounterCount; ++i) {
+      out << "  " << std::setw(26) << kCounterNames[i] << std::right
+          << std::setw(12) << profile.counters[i] << std::left << '\n';
+    }
+    out << std::right << std::defaultfloat << std::flush;
   }
 
+  // Keys are in alphabetical order
   void PrintJsonFormat(std::ostream& out) const {
-    nlohmann::json details{};
-    for (auto& item : statistics_.details) {
-      details.push_back({
-          {"name", item.name},
-          {"count", item.statistics.count},
-          {"size_total", item.statistics.size_total},
+    {
+      JsonWriter json{out, options_.json_indent};
+      json.BeginObject();
+      json.Key("count");
+      json.Value(statistics_.count);
+      json.Key("details");
+      json.BeginArray();
+      for (auto& item : statistics_.details) {
+        PrintJsonType(json, item, 0);
+      }
+      json.EndArray();
+      if (pid_) {
+        json.Key("pid");
+        json.Value(static_cast<uint64_t>(pid_));
+      }
+      if (statistics_.profile.enabled) {
+        json.Key("profile");
+        PrintJsonProfile(json);
+      }
+      json.Key("size_total");
+      json.Value(statistics_.size_total);
+      json.EndObject();
+    }
+    out << std::endl;
+  }
+
+  // Phase times are in microseconds
+  void PrintJsonProfile(JsonWriter& json) const {
+    auto& profile = statistics_.profile;
+    auto sorted = [](const char* const* names, int count) {
+      std::vector<int> order(count);
+      for (auto i = 0; i < count; ++i) {
+        order[i] = i;
+      }
+      std::sort(order.begin(), order.end(), [names](int a, int b) {
+        return strcmp(names[a], names[b]) < 0;
       });
+      return order;
+    };
+    json.BeginObject();
+    json.Key("counters");
+    json.BeginObject();
+    for (auto i : sorted(kCounterNames, kCounterCount)) {
+      json.Key(kCounterNames[i]);
+      json.Value(profile.counters[i]);
+    }
+    json.EndObject();
+    json.Key("phases_us");
+    json.BeginObject();
+    for (auto i : sorted(kPhaseNames, kPhaseCount)) {
+      json.Key(kPhaseNames[i]);
+      json.Value(static_cast<uint64_t>(
+          std::chrono::duration_cast<std::chrono::microseconds>(
+              profile.time[i])
+              .count()));
+    }
+    json.EndObject();
+    json.EndObject();
+  }
+
+  // Type per line
+  void PrintNdJsonFormat(std::ostream& out) const {
+    JsonWriter json{out, -1};
+    for (auto& item : statistics_.details) {
+      PrintJsonType(json, item, pid_);
+      json.EndLine();
+    }
+  }
+
+  static void PrintJsonType(JsonWriter& json, const TypeInformation& item,
+                            int pid) {
+    json.BeginObject();
+    json.Key("count");
+    json.Value(item.statistics.count);
+    json.Key("name");
+    json.Value(item.name);
+    if (pid) {
+      json.Key("pid");
+      json.Value(static_cast<uint64_t>(pid));
+    }
+    json.Key("size_total");
+    json.Value(item.statistics.size_total);
+    json.EndObject();
+  }
+
+  // See binary.h
+  void PrintBinaryFormat(std::ostream& out) const {
+    static_assert(kBinaryGenerations == DAC_NUMBERGENERATIONS + 1,
+                  "Generation count mismatch!");
+    auto& details = statistics_.details;
+    BinaryHeader header{};
+    memcpy(header.magic, kBinaryMagic, sizeof(header.magic));
+    header.version = kBinaryVersion;
+    header.header_size = sizeof(header);
+    header.time = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            time_.time_since_epoch())
+            .count());
+    header.row_size = sizeof(BinaryRow);
+    header.row_count = static_cast<uint32_t>(details.size());
+    header.pid = static_cast<uint32_t>(pid_);
+    for (auto& item : details) {
+      header.names_size += item.name.size();
+    }
+    header.size = sizeof(header) + sizeof(BinaryRow) * details.size() +
+                  header.names_size;
+    Copy(statistics_.count, header.count);
+    Copy(statistics_.size_total, header.size_total);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    uint64_t name_offset = 0;
+    for (auto& item : details) {
+      BinaryRow row{item.method_table_address};
+      Copy(item.statistics.count, row.count);
+      Copy(item.statistics.size_total, row.size_total);
+      row.name_offset = name_offset;
+      row.name_size = static_cast<uint32_t>(item.name.size());
+      name_offset += item.name.size();
+      out.write(reinterpret_cast<const char*>(&row), sizeof(row));
+    }
+    for (auto& item : details) {
+      out.write(item.name.data(),
+                static_cast<std::streamsize>(item.name.size()));
+    }
+  }
+
+  static void Copy(const std::array<SIZE_T, DAC_NUMBERGENERATIONS + 1>& from,
+                   uint64_t (&to)[kBinaryGenerations]) {
+    for (auto gen = 0; gen < kBinaryGenerations; ++gen) {
+      to[gen] = from[gen];
     }
-    nlohmann::json j{{"count", statistics_.count},
-                     {"size_total", statistics_.size_total},
-                     {"details", details}};
-    out << j.dump(options_.json_indent) << std::endl;
   }
 
   const HeapStatistics& statistics_;
   const Options& options_;
+  std::chrono::system_clock::time_point time_;
+  int pid_;
   friend std::ostream& operator<<(std::ostream& out, const Format& format);
 };
 
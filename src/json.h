@@ -0,0 +1,175 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Writes JSON as it goes, nothing but the output buffer is kept in memory.
+// Layout is the same as nlohmann::json::dump produces: compact if indent is
+// negative, otherwise every element on its own line. The caller is
+// responsible for the structure to be valid, i.e. a key before each value of
+// an object.
+class JsonWriter final {
+ public:
+  JsonWriter(std::ostream& out, int indent) : out_{out}, indent_{indent} {}
+  ~JsonWriter() { Flush(); }
+
+  JsonWriter(const JsonWriter&) = delete;
+  JsonWriter(JsonWriter&&) = delete;
+  JsonWriter& operator=(const JsonWriter&) = delete;
+  JsonWriter& operator=(JsonWriter&&) = delete;
+
+  void BeginObject() { Begin('{'); }
+  void EndObject() { End('}'); }
+  void BeginArray() { Begin('['); }
+  void EndArray() { End(']'); }
+
+  void Key(const char* key) {
+    Separate();
+    String(key, strlen(key));
+    buffer_ += indent_ < 0 ? ":" : ": ";
+    after_key_ = true;
+  }
+
+  void Value(uint64_t value) {
+    Separate();
+    char digits[20];
+    auto it = std::end(digits);
+    do {
+      *--it = static_cast<char>('0' + value % 10);
+      value /= 10;
+    } while (value);
+    buffer_.append(it, std::end(digits));
+    Written();
+  }
+
+  void Value(const std::string& value) {
+    Separate();
+    String(value.data(), value.size());
+    Written();
+  }
+
+  template <typename T, size_t N>
+  void Value(const std::array<T, N>& values) {
+    BeginArray();
+    for (auto value : values) {
+      Value(static_cast<uint64_t>(value));
+    }
+    EndArray();
+  }
+
+  // Ends a line of the top level values, i.e. JSON Lines
+  void EndLine() {
+    buffer_ += '\n';
+    Written();
+  }
+
+  void Flush() {
+    out_.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+    buffer_.clear();
+  }
+
+ private:
+  static auto constexpr kFlushSize = 0x10000;
+
+  void Begin(char bracket) {
+    Separate();
+    buffer_ += bracket;
+    empty_.push_back(true);
+  }
+
+  void End(char bracket) {
+    auto empty = empty_.back();
+    empty_.pop_back();
+    if (!empty && 0 <= indent_) {
+      NewLine();
+    }
+    buffer_ += bracket;
+    Written();
+  }
+
+  // Comma and line break before an element of an array or an object
+  void Separate() {
+    if (after_key_) {
+      after_key_ = false;
+      return;
+    }
+    if (empty_.empty()) {
+      return;
+    }
+    if (!empty_.back()) {
+      buffer_ += ',';
+    }
+    empty_.back() = false;
+    if (0 <= indent_) {
+      NewLine();
+    }
+  }
+
+  void NewLine() {
+    buffer_ += '\n';
+    buffer_.append(empty_.size() * static_cast<size_t>(indent_), ' ');
+  }
+
+  void Written() {
+    if (kFlushSize <= buffer_.size()) {
+      Flush();
+    }
+  }
+
+  // Control characters, quotes and backslashes are escaped, UTF-8 is copied
+  void String(const char* str, size_t size) {
+    static const char kHex[] = "0123456789abcdef";
+    buffer_ += '"';
+    auto last = str + size;
+    for (auto first = str; first != last;) {
+      auto it = first;
+      for (; it != last && 0x20 <= static_cast<unsigned char>(*it) &&
+             *it != '"' && *it != '\\';
+           ++it)
+        ;
+      buffer_.append(first, it);
+      if (it == last) {
+        break;
+      }
+      auto c = static_cast<unsigned char>(*it);
+      buffer_ += '\\';
+      switch (c) {
+        case '"':
+        case '\\':
+          buffer_ += static_cast<char>(c);
+          break;
+        case '\b':
+          buffer_ += 'b';
+          break;
+        case '\f':
+          buffer_ += 'f';
+          break;
+        case '\n':
+          buffer_ += 'n';
+          break;
+        case '\r':
+          buffer_ += 'r';
+          break;
+        case '\t':
+          buffer_ += 't';
+          break;
+        default:
+          buffer_ += "u00";
+          buffer_ += kHex[c >> 4];
+          buffer_ += kHex[c & 0xF];
+      }
+      first = it + 1;
+    }
+    buffer_ += '"';
+  }
+
+  std::ostream& out_;
+  int indent_;
+  std::string buffer_;
+  std::vector<bool> empty_;  // of the arrays and objects open
+  bool after_key_{false};
+};
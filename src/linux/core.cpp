@@ -0,0 +1,252 @@
+#include "core.h"
+
+#include <elf.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+namespace {
+
+#ifdef __LP64__
+using ElfHeader = Elf64_Ehdr;
+using ElfProgramHeader = Elf64_Phdr;
+using ElfNoteHeader = Elf64_Nhdr;
+auto constexpr kElfClass = ELFCLASS64;
+#else
+using ElfHeader = Elf32_Ehdr;
+using ElfProgramHeader = Elf32_Phdr;
+using ElfNoteHeader = Elf32_Nhdr;
+auto constexpr kElfClass = ELFCLASS32;
+#endif
+
+auto constexpr kNotOpened = -2;
+
+size_t AlignNote(size_t size) { return (size + 3) & ~size_t{3}; }
+
+}  // namespace
+
+std::unique_ptr<CoreFile> CoreFile::Open(const std::string& path) {
+  auto core = std::unique_ptr<CoreFile>(new CoreFile());
+  if (!core->Initialize(path)) {
+    return nullptr;
+  }
+  return core;
+}
+
+CoreFile::~CoreFile() {
+  for (auto fd : fds_) {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+}
+
+bool CoreFile::Initialize(const std::string& path) {
+  mapping_ = MapFile(path);
+  if (!mapping_) {
+    return false;
+  }
+  auto data = mapping_->GetData();
+  auto size = mapping_->GetSize();
+  auto header = reinterpret_cast<const ElfHeader*>(data);
+  if (size < sizeof(ElfHeader) ||
+      memcmp(header->e_ident, ELFMAG, SELFMAG) != 0 ||
+      header->e_ident[EI_CLASS] != kElfClass || header->e_type != ET_CORE) {
+    Error() << path << " is not an ELF core file of a "
+            << sizeof(void*) * 8 << "-bit process";
+    return false;
+  }
+  if (header->e_phentsize != sizeof(ElfProgramHeader) ||
+      size < header->e_phoff ||
+      header->e_phoff % alignof(ElfProgramHeader) != 0 ||
+      (size - header->e_phoff) / sizeof(ElfProgramHeader) <
+          header->e_phnum) {
+    Error() << "Core file " << path << " is corrupted";
+    return false;
+  }
+  auto program_headers =
+      reinterpret_cast<const ElfProgramHeader*>(data + header->e_phoff);
+  uint64_t bytes_missing = 0;
+  for (auto i = 0; i < header->e_phnum; ++i) {
+    auto& program_header = program_headers[i];
+    uint64_t offset = program_header.p_offset;
+    uint64_t filesz = program_header.p_filesz;
+    // Core might be truncated, use what is there
+    auto available = size < offset ? 0 : (std::min)(filesz, size - offset);
+    bytes_missing += filesz - available;
+    if (program_header.p_type == PT_LOAD && available) {
+      segments_.push_back(
+          {program_header.p_vaddr, program_header.p_vaddr + available, offset});
+    } else if (program_header.p_type == PT_NOTE) {
+      ReadNotes(data + offset, static_cast<size_t>(available));
+    }
+  }
+  if (bytes_missing) {
+    Error() << "Core file " << path << " is truncated, " << bytes_missing
+            << " bytes missing";
+  }
+  std::sort(segments_.begin(), segments_.end(),
+            [](auto& a, auto& b) { return a.first < b.first; });
+  std::sort(files_.begin(), files_.end(),
+            [](auto& a, auto& b) { return a.first < b.first; });
+  fds_.assign(paths_.size(), kNotOpened);
+  Debug() << "Core file " << path << ", " << segments_.size()
+          << " segments, " << files_.size() << " file mappings";
+  return true;
+}
+
+void CoreFile::ReadNotes(const BYTE* data, size_t size) {
+  for (size_t pos = 0; sizeof(ElfNoteHeader) <= size - pos;) {
+    ElfNoteHeader note;
+    memcpy(&note, data + pos, sizeof(note));
+    auto name = pos + sizeof(note);
+    auto desc = name + AlignNote(note.n_namesz);
+    auto next = desc + AlignNote(note.n_descsz);
+    if (size < next) {
+      break;
+    }
+    if (note.n_type == NT_FILE && note.n_namesz == sizeof("CORE") &&
+        memcmp(data + name, "CORE", sizeof("CORE")) == 0) {
+      ReadFileNote(data + desc, note.n_descsz);
+    }
+    pos = next;
+  }
+}
+
+void CoreFile::ReadFileNote(const BYTE* data, size_t size) {
+  // count, page size, {start, end, page offset}[count], paths[count]
+  auto word = [&](size_t index) {
+    unsigned long value;
+    memcpy(&value, data + index * sizeof(value), sizeof(value));
+    return static_cast<uint64_t>(value);
+  };
+  if (size < 2 * sizeof(unsigned long)) {
+    return;
+  }
+  auto count = word(0);
+  auto page_size = word(1);
+  if ((size / sizeof(unsigned long) - 2) / 3 < count) {
+    return;
+  }
+  auto path = reinterpret_cast<const char*>(data) +
+              (2 + count * 3) * sizeof(unsigned long);
+  auto end = reinterpret_cast<const char*>(data) + size;
+  for (uint64_t i = 0; i < count && path < end; ++i) {
+    auto length = strnlen(path, static_cast<size_t>(end - path));
+    // Mappings of a file are listed one after another
+    if (paths_.empty() || paths_.back().compare(0, std::string::npos, path,
+                                                length) != 0) {
+      paths_.emplace_back(path, length);
+    }
+    files_.push_back({word(2 + i * 3), word(3 + i * 3),
+                      word(4 + i * 3) * page_size, paths_.size() - 1});
+    path += length + 1;
+  }
+}
+
+bool CoreFile::FindModule(const char* name, CLRDATA_ADDRESS& base,
+                          std::string& path) const {
+  auto length = strlen(name);
+  for (auto& file : files_) {
+    auto& file_path = paths_[file.path];
+    if (length <= file_path.size() &&
+        file_path.compare(file_path.size() - length, length, name) == 0) {
+      base = file.first;
+      path = file_path;
+      return true;
+    }
+  }
+  return false;
+}
+
+HRESULT CoreFile::ReadMemory(ReadRequest* requests, size_t count) {
+  auto hr = S_OK;
+  for (size_t i = 0; i < count; ++i) {
+    auto& request = requests[i];
+    request.read = 0;
+    while (request.read < request.size) {
+      auto addr = request.address + request.read;
+      auto buffer = request.buffer + request.read;
+      auto size = request.size - request.read;
+      auto read = ReadSegments(addr, buffer, size);
+      if (!read) {
+        read = ReadFiles(addr, buffer, size);
+      }
+      if (!read) {
+        hr = S_FALSE;
+        break;
+      }
+      request.read += static_cast<ULONG32>(read);
+    }
+  }
+  return hr;
+}
+
+const BYTE* CoreFile::MapMemory(CLRDATA_ADDRESS address, size_t size) const {
+  auto it = std::upper_bound(
+      segments_.begin(), segments_.end(), static_cast<uint64_t>(address),
+      [](uint64_t addr, auto& segment) { return addr < segment.first; });
+  if (it == segments_.begin()) {
+    return nullptr;
+  }
+  --it;
+  if (it->last < address || it->last - address < size) {
+    return nullptr;
+  }
+  return mapping_->GetData() + it->offset + (address - it->first);
+}
+
+size_t CoreFile::ReadSegments(uint64_t addr, BYTE* buffer,
+                              size_t size) const {
+  auto it = std::upper_bound(
+      segments_.begin(), segments_.end(), addr,
+      [](uint64_t addr, auto& segment) { return addr < segment.first; });
+  if (it == segments_.begin() || (--it)->last <= addr) {
+    return 0;
+  }
+  auto read = static_cast<size_t>((std::min)(
+      static_cast<uint64_t>(size), it->last - addr));
+  memcpy(buffer, mapping_->GetData() + it->offset + (addr - it->first), read);
+  return read;
+}
+
+size_t CoreFile::ReadFiles(uint64_t addr, BYTE* buffer, size_t size) {
+  auto it = std::upper_bound(
+      files_.begin(), files_.end(), addr,
+      [](uint64_t addr, auto& file) { return addr < file.first; });
+  if (it == files_.begin() || (--it)->last <= addr) {
+    return 0;
+  }
+  auto fd = GetFile(it->path);
+  if (fd < 0) {
+    return 0;
+  }
+  // Stop at the next segment dumped, it has the actual content
+  auto last = it->last;
+  auto next = std::upper_bound(
+      segments_.begin(), segments_.end(), addr,
+      [](uint64_t addr, auto& segment) { return addr < segment.first; });
+  if (next != segments_.end()) {
+    last = (std::min)(last, next->first);
+  }
+  auto res = pread(fd, buffer,
+                   static_cast<size_t>((std::min)(
+                       static_cast<uint64_t>(size), last - addr)),
+                   static_cast<off_t>(it->offset + (addr - it->first)));
+  return res < 0 ? 0 : static_cast<size_t>(res);
+}
+
+int CoreFile::GetFile(size_t path) {
+  std::lock_guard<std::mutex> lock{mutex_};
+  if (fds_[path] == kNotOpened) {
+    fds_[path] = open(paths_[path].c_str(), O_RDONLY);
+    if (fds_[path] < 0) {
+      Debug() << "Could not open " << paths_[path] << ", error " << errno
+              << ", memory it is mapped to is not available";
+    }
+  }
+  return fds_[path];
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <mutex>
+
+#include "dac.h"
+#include "mapping.h"
+
+// ELF core file (i.e. written by createdump or gcore) mapped into memory.
+// Memory of the process dumped is served from PT_LOAD segments without
+// copies. Pages not dumped (i.e. read-only file mappings gcore omits by
+// default) are read from the files listed in NT_FILE note if those are
+// around.
+class CoreFile final {
+ public:
+  static std::unique_ptr<CoreFile> Open(const std::string& path);
+  ~CoreFile();
+
+  CoreFile(const CoreFile&) = delete;
+  CoreFile(CoreFile&&) = delete;
+  CoreFile& operator=(const CoreFile&) = delete;
+  CoreFile& operator=(CoreFile&&) = delete;
+
+  // Finds the lowest mapping of a file which name ends with "name"
+  bool FindModule(const char* name, CLRDATA_ADDRESS& base,
+                  std::string& path) const;
+  // Same as IDac::ReadMemory and IDac::MapMemory
+  HRESULT ReadMemory(ReadRequest* requests, size_t count);
+  const BYTE* MapMemory(CLRDATA_ADDRESS address, size_t size) const;
+
+ private:
+  struct Segment {
+    uint64_t first;  // dumped part of the segment only
+    uint64_t last;
+    uint64_t offset;
+  };
+
+  struct MappedFile {
+    uint64_t first;
+    uint64_t last;
+    uint64_t offset;
+    size_t path;  // index into paths
+  };
+
+  CoreFile() = default;
+  bool Initialize(const std::string& path);
+  void ReadNotes(const BYTE* data, size_t size);
+  void ReadFileNote(const BYTE* data, size_t size);
+
+  // Both return number of bytes read starting at "addr", zero if the address
+  // is not mapped
+  size_t ReadSegments(uint64_t addr, BYTE* buffer, size_t size) const;
+  size_t ReadFiles(uint64_t addr, BYTE* buffer, size_t size);
+  int GetFile(size_t path);
+
+  std::unique_ptr<IFileMapping> mapping_;
+  std::vector<Segment> segments_;   // sorted by address
+  std::vector<MappedFile> files_;  // sorted by address
+  std::vector<std::string> paths_;
+  std::vector<int> fds_;  // opened on the first read, -1 if failed
+  std::mutex mutex_;      // guards fds
+};
@@ -1,22 +1,37 @@
 #include "dac.h"
 
 #include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>  // process_vm_readv
 #include <unistd.h>
 
 #include <cinttypes>
-#include <fstream>
 #include <locale>
+#include <map>
+#include <mutex>
 #include <sstream>
 
+#include "cache.h"
+#include "core.h"
+#include "maps.h"
+#include "runtime.h"
+
 class Dac final : public IDac, IXCLRDataTarget3 {
  public:
   bool Initialize(int pid);
+  bool Initialize(const std::string& core);
   ~Dac() override;
 
  private:
   // IDac
   IXCLRDataTarget3* GetXCLRDataTarget3() override;
   ISOSDacInterface* GetSOSDacInterface() override;
+  HRESULT ReadMemory(ReadRequest* requests, size_t count) override;
+  CacheStatistics GetCacheStatistics() override;
+  const BYTE* MapMemory(CLRDATA_ADDRESS address, size_t size) override;
+  size_t GetReadableSize(CLRDATA_ADDRESS address, size_t size) override;
+  void RefreshMemoryMap() override;
+  void Flush() override;
   // clang-format off
   // IUnknown
   STDMETHOD(QueryInterface)(REFIID riid, void** ppvObject) override;
@@ -43,82 +58,173 @@ class Dac final : public IDac, IXCLRDataTarget3 {
 
   static void Release2(IUnknown* ptr) { ptr->Release(); }
 
+  // DAC of the runtime deleted while mapped, matched by version
+  bool FindDeletedRuntimeDac(const std::string& runtime,
+                             const std::string& version);
+  bool LoadDac();
+  bool OpenProcessMemory();
+  HRESULT ReadProcessVm(ReadRequest* requests, size_t count);
+  void ReadProcessVmPages(ReadRequest& request);
+  HRESULT ReadProcessMemFile(ReadRequest* requests, size_t count);
+
+  // Max number of iovec entries passed to process_vm_readv at once
+  static auto constexpr kMaxIovecs = 1024;
+  // Mappings of libcoreclr.so span less
+  static auto constexpr kMaxRuntimeSize = uint64_t{64} << 20;
+
   int refcount_{1};
-  int fdmem_{};
+  int pid_{};
+  uintptr_t pagesize_{};
+  bool vm_readv_{true};  // process_vm_readv or "/proc/<pid>/mem" otherwise
+  int fdmem_{-1};
+  MemoryMap maps_;                  // of the process
+  std::unique_ptr<CoreFile> core_;  // reads core file instead of the process
+  PageCache cache_{this, PageCache::kDefaultCapacity};
   std::u16string clrname_{u"libcoreclr.so"};
   std::string clrpath_;
+  std::string dacpath_;  // next to the runtime unless it was deleted
   CLRDATA_ADDRESS clrbase_{};
-  std::unique_ptr<void, decltype(&dlclose)> dac_{nullptr, dlclose};
+  std::shared_ptr<void> dac_;  // shared by the targets of the same runtime
+  std::unique_ptr<IXCLRDataProcess, decltype(&Release2)> xclrdataprocess_{
+      nullptr, Release2};
   std::unique_ptr<ISOSDacInterface, decltype(&Release2)> sos_{nullptr,
                                                               Release2};
 };
 
 bool Dac::Initialize(int pid) {
-  // Open process memory file for reading
-  auto stream = std::ostringstream{};
-  stream << "/proc/" << pid << "/mem";
-  auto mem_path = stream.str();
-  fdmem_ = open(mem_path.c_str(), O_RDONLY);
-  if (fdmem_ < 0) {
-    Error() << "Could not open " << mem_path;
+  pid_ = pid;
+  pagesize_ = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+  if (pagesize_ == 0 || (pagesize_ & (pagesize_ - 1)) != 0) {
+    Error() << "Memory page size must be a power of two!";
     return false;
   }
   // Find CLR
-  std::ostringstream{}.swap(stream);
-  stream << "/proc/" << pid << "/maps";
-  auto maps_path = stream.str();
-  std::ifstream maps{maps_path};
-  if (!maps.is_open()) {
-    Error() << "Could not open " << maps_path;
+  if (!maps_.Read(pid)) {
+    Error() << "Could not read /proc/" << pid << "/maps, error " << errno;
     return false;
   }
-  CLRDATA_ADDRESS addr{};
-  auto path = std::vector<char>();
-  auto clrfound = false;
-  auto clrlenth = strlen("libcoreclr.so");
-  for (std::string line; std::getline(maps, line);) {
-    if (path.size() < line.size()) {
-      path.resize(line.size());
-    }
-    auto n =
-        sscanf(line.c_str(), "%tx-%*tx %*s %*s %*s %*s %s", &addr, &path[0]);
-    if (n == 2) {
-      auto pathlen = strlen(&path[0]);
-      if (clrlenth <= pathlen &&
-          strcmp(&path[pathlen - clrlenth], "libcoreclr.so") == 0) {
-        clrfound = true;
-        clrbase_ = addr;
-        clrpath_.assign(&path[0], pathlen);
-        break;
+  auto clr = maps_.FindModule("libcoreclr.so");
+  if (!clr) {
+    Error() << "CLR module not found";
+    return false;
+  }
+  clrbase_ = clr->first;
+  // Path is in the mount namespace of the process (e.g. a container), the
+  // root of the process leads to the same files from ours
+  auto path = maps_.GetPath(*clr);
+  auto deleted = StripDeleted(path);
+  clrpath_ = "/proc/" + std::to_string(pid) + "/root" + path;
+  // Choose the way to read process memory
+  if (!OpenProcessMemory()) {
+    return false;
+  }
+  if (deleted) {
+    std::string version;
+    for (auto& region : maps_.GetRegions()) {
+      if (version.empty() && region.path == clr->path &&
+          (region.protection & MemoryMap::kRead)) {
+        version = ReadRuntimeVersion(*this, region.first, region.last);
       }
     }
+    if (!FindDeletedRuntimeDac(path, version)) {
+      return false;
+    }
   }
-  if (!clrfound) {
-    Error() << "CLR module not found";
+  return LoadDac();
+}
+
+bool Dac::Initialize(const std::string& core) {
+  core_ = CoreFile::Open(core);
+  if (!core_) {
     return false;
   }
-  // Load DAC
-  std::string dacpath{clrpath_.substr(0, clrpath_.find_last_of('/')) +
-                      "/libmscordaccore.so"};
-  dac_.reset(dlopen(dacpath.c_str(), RTLD_NOW));
-  if (!dac_) {
-    Error() << "Error loading " << dacpath;
-    Error() << dlerror();
+  if (!core_->FindModule("libcoreclr.so", clrbase_, clrpath_)) {
+    Error() << "CLR module not found in " << core;
     return false;
   }
+  // Mappings of the module are not known, the version is looked for up to
+  // the first page not dumped
+  if (StripDeleted(clrpath_) &&
+      !FindDeletedRuntimeDac(
+          clrpath_, ReadRuntimeVersion(*this, clrbase_,
+                                       clrbase_ + kMaxRuntimeSize))) {
+    return false;
+  }
+  return LoadDac();
+}
+
+namespace {
+
+// Several targets of the same runtime version (i.e. /pid:all) share the DAC
+// library loaded, its PAL is initialized once. DAC instances serialize the
+// calls into the library on their own. Libraries are told apart by the file,
+// the paths to it differ from one target (mount namespace) to another.
+std::shared_ptr<void> LoadDacLibrary(const std::string& path) {
+  struct stat file {};
+  if (stat(path.c_str(), &file) != 0) {
+    Error() << "Could not find " << path << ", error " << errno;
+    return nullptr;
+  }
+  static std::mutex mutex;
+  static std::map<std::pair<dev_t, ino_t>, std::weak_ptr<void>> libraries;
+  std::lock_guard<std::mutex> lock{mutex};
+  auto& loaded = libraries[{file.st_dev, file.st_ino}];
+  if (auto library = loaded.lock()) {
+    return library;
+  }
+  auto handle = dlopen(path.c_str(), RTLD_NOW);
+  if (!handle) {
+    Error() << "Error loading " << path;
+    Error() << dlerror();
+    return nullptr;
+  }
+  std::shared_ptr<void> library{handle, dlclose};
   // Initialize PAL
-  auto pfn = dlsym(dac_.get(), "DAC_PAL_InitializeDLL");
+  auto pfn = dlsym(handle, "DAC_PAL_InitializeDLL");
   if (!pfn) {
     Error() << "DAC_PAL_InitializeDLL not found";
-    return false;
+    return nullptr;
   }
   auto res = reinterpret_cast<int(PALAPI*)()>(pfn)();
   if (res != 0) {
     Error() << "Error initializing DAC_PAL";
+    return nullptr;
+  }
+  loaded = library;
+  return library;
+}
+
+}  // namespace
+
+bool Dac::FindDeletedRuntimeDac(const std::string& runtime,
+                                 const std::string& version) {
+  // The DAC next to a runtime updated in place is of the new version, reading
+  // the process with it would give garbage
+  dacpath_ = FindDac(clrpath_.substr(0, clrpath_.find_last_of('/')), version);
+  if (dacpath_.empty()) {
+    Error() << "Runtime " << runtime
+            << " was deleted while in use (i.e. updated), no DAC of its "
+            << (version.empty() ? "version" : version)
+            << " found, restart the process to analyze it";
+    return false;
+  }
+  Debug() << "Runtime " << runtime << " was deleted while in use, DAC of "
+          << version << " found at " << dacpath_;
+  return true;
+}
+
+bool Dac::LoadDac() {
+  // Load DAC
+  if (dacpath_.empty()) {
+    dacpath_ = clrpath_.substr(0, clrpath_.find_last_of('/')) +
+               "/libmscordaccore.so";
+  }
+  dac_ = LoadDacLibrary(dacpath_);
+  if (!dac_) {
     return false;
   }
   // Query ISOSDacInterface
-  pfn = dlsym(dac_.get(), "CLRDataCreateInstance");
+  auto pfn = dlsym(dac_.get(), "CLRDataCreateInstance");
   if (pfn == nullptr) {
     Error() << "CLRDataCreateInstance not found";
     return false;
@@ -131,8 +237,7 @@ bool Dac::Initialize(int pid) {
     Error() << "Could not create IXCLRDataProcess instance";
     return false;
   }
-  std::unique_ptr<IXCLRDataProcess, decltype(&Release2)> xclrdataprocess_scope{
-      xclrdataprocess, Release2};
+  xclrdataprocess_.reset(xclrdataprocess);
   ISOSDacInterface* sos{};
   hr = xclrdataprocess->QueryInterface(__uuidof(ISOSDacInterface),
                                        reinterpret_cast<void**>(&sos));
@@ -145,13 +250,153 @@ bool Dac::Initialize(int pid) {
 }
 
 Dac::~Dac() {
-  if (fdmem_ != 0) {
+  if (fdmem_ != -1) {
     close(fdmem_);
   }
 }
 
+bool Dac::OpenProcessMemory() {
+  // Prefer process_vm_readv, it reads many ranges in a single syscall. It
+  // might be unavailable though (i.e. blocked by seccomp policy), fallback to
+  // "/proc/<pid>/mem" then.
+  BYTE byte{};
+  iovec local{&byte, 1};
+  iovec remote{reinterpret_cast<void*>(clrbase_), 1};
+  if (process_vm_readv(pid_, &local, 1, &remote, 1, 0) == 1) {
+    return true;
+  }
+  Debug() << "process_vm_readv failed, error " << errno << ", fallback to /proc/"
+          << pid_ << "/mem";
+  vm_readv_ = false;
+  auto stream = std::ostringstream{};
+  stream << "/proc/" << pid_ << "/mem";
+  auto mem_path = stream.str();
+  fdmem_ = open(mem_path.c_str(), O_RDONLY);
+  if (fdmem_ < 0) {
+    Error() << "Could not open " << mem_path;
+    return false;
+  }
+  return true;
+}
+
 IXCLRDataTarget3* Dac::GetXCLRDataTarget3() { return this; }
 ISOSDacInterface* Dac::GetSOSDacInterface() { return sos_.get(); }
+CacheStatistics Dac::GetCacheStatistics() { return cache_.GetStatistics(); }
+
+const BYTE* Dac::MapMemory(CLRDATA_ADDRESS address, size_t size) {
+  return core_ ? core_->MapMemory(address, size) : nullptr;
+}
+
+size_t Dac::GetReadableSize(CLRDATA_ADDRESS address, size_t size) {
+  // Core file reads serve what is dumped on their own
+  if (core_ || maps_.GetRegions().empty()) {
+    return size;
+  }
+  return static_cast<size_t>(maps_.GetReadableSize(address, size));
+}
+
+void Dac::RefreshMemoryMap() {
+  if (!core_ && !maps_.Read(pid_)) {
+    Debug() << "Could not read /proc/" << pid_ << "/maps again, error "
+            << errno;
+  }
+}
+
+void Dac::Flush() {
+  cache_.Clear();
+  xclrdataprocess_->Flush();
+}
+
+HRESULT Dac::ReadMemory(ReadRequest* requests, size_t count) {
+  if (core_) {
+    return core_->ReadMemory(requests, count);
+  }
+  for (size_t i = 0; i < count; ++i) {
+    requests[i].read = 0;
+  }
+  return vm_readv_ ? ReadProcessVm(requests, count)
+                   : ReadProcessMemFile(requests, count);
+}
+
+HRESULT Dac::ReadProcessVm(ReadRequest* requests, size_t count) {
+  iovec local[kMaxIovecs];
+  iovec remote[kMaxIovecs];
+  auto hr = S_OK;
+  for (size_t i = 0; i < count;) {
+    auto last = i + (std::min)(count - i, static_cast<size_t>(kMaxIovecs));
+    for (auto j = i; j < last; ++j) {
+      local[j - i] = {requests[j].buffer, requests[j].size};
+      remote[j - i] = {reinterpret_cast<void*>(requests[j].address),
+                       requests[j].size};
+    }
+    auto res = process_vm_readv(pid_, local, last - i, remote, last - i, 0);
+    if (res < 0) {
+      if (errno != EFAULT) {
+        Error() << "Error " << errno << " reading process memory";
+        return E_FAIL;
+      }
+      res = 0;
+    }
+    auto remaining = static_cast<size_t>(res);
+    for (; i < last && requests[i].size <= remaining; ++i) {
+      requests[i].read = requests[i].size;
+      remaining -= requests[i].size;
+    }
+    if (i < last) {
+      // Transfer stops at the first range not readable in full, read what is
+      // available of it and proceed with the rest
+      ReadProcessVmPages(requests[i++]);
+      hr = S_FALSE;
+    }
+  }
+  return hr;
+}
+
+void Dac::ReadProcessVmPages(ReadRequest& request) {
+  // Partial transfers apply at the granularity of iovec elements, so split the
+  // range at page boundaries to get everything readable
+  iovec remote[kMaxIovecs];
+  auto addr = static_cast<uintptr_t>(request.address);
+  auto end = addr + request.size;
+  while (addr < end) {
+    auto first = addr;
+    auto n = 0;
+    for (; n < kMaxIovecs && addr < end; ++n) {
+      auto next = (std::min)((addr & ~(pagesize_ - 1)) + pagesize_, end);
+      remote[n] = {reinterpret_cast<void*>(addr), next - addr};
+      addr = next;
+    }
+    iovec local{request.buffer + (first - request.address), addr - first};
+    auto res = process_vm_readv(pid_, &local, 1, remote, n, 0);
+    if (res <= 0) {
+      return;
+    }
+    request.read += static_cast<ULONG32>(res);
+    if (static_cast<size_t>(res) < addr - first) {
+      return;
+    }
+  }
+}
+
+HRESULT Dac::ReadProcessMemFile(ReadRequest* requests, size_t count) {
+  auto hr = S_OK;
+  for (size_t i = 0; i < count; ++i) {
+    auto& request = requests[i];
+    while (request.read < request.size) {
+      auto res = pread(fdmem_, request.buffer + request.read,
+                       request.size - request.read,
+                       request.address + request.read);
+      if (res <= 0) {
+        break;
+      }
+      request.read += static_cast<ULONG32>(res);
+    }
+    if (request.read < request.size) {
+      hr = S_FALSE;
+    }
+  }
+  return hr;
+}
 
 HRESULT Dac::QueryInterface(REFIID riid, void** ppvObject) {
   if (IsEqualIID(riid, __uuidof(ICLRDataTarget)) ||
@@ -193,14 +438,14 @@ HRESULT Dac::GetImageBase(PCWSTR imagePath, CLRDATA_ADDRESS* baseAddress) {
 
 HRESULT Dac::ReadVirtual(CLRDATA_ADDRESS address, BYTE* buffer,
                          ULONG32 bytesRequested, ULONG32* bytesRead) {
-  auto res = pread(fdmem_, buffer, bytesRequested, address);
-  if (res < 0) {
-    Error() << "Error " << errno << " reading process memory at 0x" << std::hex
-            << address << " (requested " << bytesRequested << ")";
+  auto read = cache_.Read(address, buffer, bytesRequested);
+  if (read == 0 && bytesRequested != 0) {
+    Error() << "Error reading process memory at 0x" << std::hex << address
+            << " (requested " << std::dec << bytesRequested << ")";
     return E_FAIL;
   }
 
-  *bytesRead = static_cast<ULONG32>(res);
+  *bytesRead = read;
   return S_OK;
 }
 
@@ -272,3 +517,11 @@ std::unique_ptr<IDac> CreateDac(int pid) {
   }
   return dac;
 }
+
+std::unique_ptr<IDac> CreateCoreDac(const std::string& path) {
+  auto dac = std::make_unique<Dac>();
+  if (!dac->Initialize(path)) {
+    return nullptr;
+  }
+  return dac;
+}
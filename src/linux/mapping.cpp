@@ -0,0 +1,71 @@
+#include "mapping.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+
+class FileMapping final : public IFileMapping {
+ public:
+  FileMapping() = default;
+  ~FileMapping() override;
+
+  FileMapping(const FileMapping&) = delete;
+  FileMapping(FileMapping&&) = delete;
+  FileMapping& operator=(const FileMapping&) = delete;
+  FileMapping& operator=(FileMapping&&) = delete;
+
+  bool Initialize(const std::string& path);
+
+ private:
+  // IFileMapping
+  const BYTE* GetData() const override { return data_; }
+  size_t GetSize() const override { return size_; }
+
+  const BYTE* data_{};
+  size_t size_{};
+};
+
+FileMapping::~FileMapping() {
+  if (data_) {
+    munmap(const_cast<BYTE*>(data_), size_);
+  }
+}
+
+bool FileMapping::Initialize(const std::string& path) {
+  auto fd = open(path.c_str(), O_RDONLY);
+  if (fd == -1) {
+    Error() << "Error opening " << path << ", error " << errno;
+    return false;
+  }
+  struct stat st {};
+  if (fstat(fd, &st) == -1) {
+    Error() << "Error getting size of " << path << ", error " << errno;
+    close(fd);
+    return false;
+  }
+  size_ = static_cast<size_t>(st.st_size);
+  if (!size_) {
+    Error() << "File " << path << " is empty";
+    close(fd);
+    return false;
+  }
+  auto data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    Error() << "Error mapping " << path << ", error " << errno;
+    return false;
+  }
+  data_ = static_cast<const BYTE*>(data);
+  return true;
+}
+
+std::unique_ptr<IFileMapping> MapFile(const std::string& path) {
+  auto mapping = std::make_unique<FileMapping>();
+  if (!mapping->Initialize(path)) {
+    return nullptr;
+  }
+  return mapping;
+}
@@ -0,0 +1,188 @@
+#include "maps.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+namespace {
+
+// The kernel fills as many lines as fit into the buffer passed to read()
+auto constexpr kInitialReadSize = size_t{1} << 20;
+// Appended to the path of a file deleted (e.g. replaced by an update) while
+// it is mapped
+const char kDeletedSuffix[] = " (deleted)";
+auto constexpr kDeletedSuffixLength = sizeof(kDeletedSuffix) - 1;
+
+// Returns the position of the first character not a hex digit
+const char* ParseHex(const char* p, const char* end, uint64_t& value) {
+  value = 0;
+  for (; p < end; ++p) {
+    auto c = static_cast<unsigned char>(*p);
+    uint64_t digit;
+    if ('0' <= c && c <= '9') {
+      digit = c - '0';
+    } else if ('a' <= c && c <= 'f') {
+      digit = c - 'a' + 10;
+    } else if ('A' <= c && c <= 'F') {
+      digit = c - 'A' + 10;
+    } else {
+      break;
+    }
+    value = value << 4 | digit;
+  }
+  return p;
+}
+
+const char* SkipField(const char* p, const char* end) {
+  while (p < end && *p != ' ') ++p;
+  while (p < end && *p == ' ') ++p;
+  return p;
+}
+
+}  // namespace
+
+bool MemoryMap::Read(int pid) {
+  auto path = "/proc/" + std::to_string(pid) + "/maps";
+  auto fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  // Size of procfs files is not known in advance
+  std::vector<char> buffer(kInitialReadSize);
+  size_t size = 0;
+  for (;;) {
+    if (size == buffer.size()) {
+      buffer.resize(buffer.size() * 2);
+    }
+    auto res = read(fd, &buffer[size], buffer.size() - size);
+    if (res < 0 && errno == EINTR) {
+      continue;
+    }
+    if (res < 0) {
+      close(fd);
+      return false;
+    }
+    if (res == 0) {
+      break;
+    }
+    size += static_cast<size_t>(res);
+  }
+  close(fd);
+  Parse(buffer.data(), size);
+  return true;
+}
+
+// Line is "first-last perms offset dev inode [path]", path might contain
+// spaces and ends with the line
+void MemoryMap::Parse(const char* data, size_t size) {
+  regions_.clear();
+  paths_.clear();
+  modules_.clear();
+  auto end = data + size;
+  for (auto p = data; p < end;) {
+    auto eol = static_cast<const char*>(
+        memchr(p, '\n', static_cast<size_t>(end - p)));
+    if (!eol) {
+      eol = end;
+    }
+    Region region{};
+    auto q = ParseHex(p, eol, region.first);
+    if (q == p || q == eol || *q != '-') {
+      p = eol + 1;
+      continue;
+    }
+    auto last = q + 1;
+    q = ParseHex(last, eol, region.last);
+    if (q == last || eol - q < 6 || *q != ' ') {
+      p = eol + 1;
+      continue;
+    }
+    region.protection = (q[1] == 'r' ? kRead : 0) |
+                        (q[2] == 'w' ? kWrite : 0) |
+                        (q[3] == 'x' ? kExecute : 0);
+    q = SkipField(q + 1, eol);
+    q = ParseHex(q, eol, region.offset);
+    q = SkipField(q, eol);  // to dev
+    q = SkipField(q, eol);  // to inode
+    q = SkipField(q, eol);  // to path
+    region.path = kNoPath;
+    if (q < eol) {
+      // Regions of a module are adjacent, compare with the last path first
+      auto length = static_cast<size_t>(eol - q);
+      if (!paths_.empty() && paths_.back().size() == length &&
+          !memcmp(paths_.back().data(), q, length)) {
+        region.path = static_cast<uint32_t>(paths_.size() - 1);
+      } else {
+        region.path = static_cast<uint32_t>(paths_.size());
+        paths_.emplace_back(q, length);
+      }
+    }
+    regions_.push_back(region);
+    p = eol + 1;
+  }
+  auto by_address = [](const Region& a, const Region& b) {
+    return a.first < b.first;
+  };
+  if (!std::is_sorted(regions_.begin(), regions_.end(), by_address)) {
+    std::stable_sort(regions_.begin(), regions_.end(), by_address);
+  }
+  // The first region of a module is the lowest one
+  for (size_t i = 0; i < regions_.size(); ++i) {
+    if (regions_[i].path == kNoPath ||
+        (i && regions_[i - 1].path == regions_[i].path)) {
+      continue;
+    }
+    auto& path = paths_[regions_[i].path];
+    if (path.front() != '/') {
+      continue;
+    }
+    auto name = path.substr(path.rfind('/') + 1);
+    StripDeleted(name);
+    modules_.emplace(std::move(name), i);
+  }
+}
+
+const MemoryMap::Region* MemoryMap::Find(uint64_t address) const {
+  auto it = std::upper_bound(
+      regions_.begin(), regions_.end(), address,
+      [](uint64_t address, const Region& region) {
+        return address < region.first;
+      });
+  if (it == regions_.begin() || (--it)->last <= address) {
+    return nullptr;
+  }
+  return &*it;
+}
+
+uint64_t MemoryMap::GetReadableSize(uint64_t address, uint64_t size) const {
+  auto end = address;
+  auto last = regions_.data() + regions_.size();
+  for (auto region = Find(address);
+       region && region != last && region->first <= end &&
+       (region->protection & kRead);
+       ++region) {
+    end = region->last;
+    if (size <= end - address) {
+      return size;
+    }
+  }
+  return end - address;
+}
+
+const MemoryMap::Region* MemoryMap::FindModule(const std::string& name) const {
+  auto it = modules_.find(name);
+  return it == modules_.end() ? nullptr : &regions_[it->second];
+}
+
+bool StripDeleted(std::string& path) {
+  if (path.size() <= kDeletedSuffixLength ||
+      path.compare(path.size() - kDeletedSuffixLength, kDeletedSuffixLength,
+                   kDeletedSuffix) != 0) {
+    return false;
+  }
+  path.resize(path.size() - kDeletedSuffixLength);
+  return true;
+}
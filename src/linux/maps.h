@@ -0,0 +1,64 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Memory map of a process, /proc/<pid>/maps read at once and parsed in
+// place. Regions are indexed by address and file mappings by module name,
+// so that attach, module lookup and read validation do not scan the text
+// again. Large heaps and JIT code heaps make 100k+ regions common.
+class MemoryMap final {
+ public:
+  // Protection bits
+  static auto constexpr kRead = 1u;
+  static auto constexpr kWrite = 2u;
+  static auto constexpr kExecute = 4u;
+
+  struct Region {
+    uint64_t first;
+    uint64_t last;    // exclusive
+    uint64_t offset;  // in the file mapped
+    uint32_t protection;  // kRead, kWrite, kExecute
+    uint32_t path;  // index into paths, kNoPath if anonymous
+  };
+
+  static auto constexpr kNoPath = UINT32_MAX;
+
+  MemoryMap() = default;
+
+  MemoryMap(const MemoryMap&) = delete;
+  MemoryMap(MemoryMap&&) = delete;
+  MemoryMap& operator=(const MemoryMap&) = delete;
+  MemoryMap& operator=(MemoryMap&&) = delete;
+
+  // Reads /proc/<pid>/maps, false if it can not be read
+  bool Read(int pid);
+  // Parses the content of a maps file, malformed lines are skipped
+  void Parse(const char* data, size_t size);
+
+  // Region containing the address, nullptr if it is not mapped
+  const Region* Find(uint64_t address) const;
+  // Number of bytes at "address", up to "size", in adjacent readable
+  // regions, zero if the address is not mapped or not readable
+  uint64_t GetReadableSize(uint64_t address, uint64_t size) const;
+  // Lowest mapping of the file named "name" (i.e. "libcoreclr.so"), nullptr
+  // if it is not mapped. Files deleted while mapped are found by their name.
+  const Region* FindModule(const std::string& name) const;
+
+  const std::vector<Region>& GetRegions() const { return regions_; }
+  // Pseudo paths such as "[heap]" and " (deleted)" suffixes are kept as they
+  // are
+  const std::string& GetPath(const Region& region) const {
+    return paths_[region.path];
+  }
+
+ private:
+  std::vector<Region> regions_;  // sorted by address
+  std::vector<std::string> paths_;
+  std::unordered_map<std::string, size_t> modules_;  // name to region index
+};
+
+// Removes the " (deleted)" suffix the kernel appends to the path of a file
+// deleted while mapped, false if the path has none
+bool StripDeleted(std::string& path);
@@ -0,0 +1,58 @@
+#include "process.h"
+
+#include <dirent.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+#include "maps.h"
+
+uint64_t GetProcessStartTime(int pid) {
+  std::ostringstream path{};
+  path << "/proc/" << pid << "/stat";
+  std::ifstream stat{path.str()};
+  std::string line;
+  if (!std::getline(stat, line)) {
+    return 0;
+  }
+  // Process name might contain spaces and parentheses, fields are counted
+  // from the last ')'. Start time is the 22nd field, the state is the 3rd.
+  auto pos = line.rfind(')');
+  if (pos == std::string::npos) {
+    return 0;
+  }
+  std::istringstream fields{line.substr(pos + 1)};
+  std::string field;
+  for (auto i = 3; i < 22 && fields >> field; ++i)
+    ;
+  uint64_t start_time = 0;
+  fields >> start_time;
+  return start_time;
+}
+
+std::vector<int> FindDotNetProcesses() {
+  std::vector<int> pids;
+  std::unique_ptr<DIR, decltype(&closedir)> proc{opendir("/proc"), closedir};
+  if (!proc) {
+    Error() << "Could not open /proc";
+    return pids;
+  }
+  auto self = getpid();
+  MemoryMap maps;
+  while (auto entry = readdir(proc.get())) {
+    char* end = nullptr;
+    auto pid = strtol(entry->d_name, &end, 10);
+    if (*end || pid <= 0 || pid == self) {
+      continue;
+    }
+    // Maps of the processes not accessible are empty
+    if (maps.Read(static_cast<int>(pid)) && maps.FindModule("libcoreclr.so")) {
+      pids.push_back(static_cast<int>(pid));
+    }
+  }
+  std::sort(pids.begin(), pids.end());
+  return pids;
+}
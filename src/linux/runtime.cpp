@@ -0,0 +1,93 @@
+#include "runtime.h"
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "mapping.h"
+
+namespace {
+
+auto constexpr kVersionPrefix = "@(#)Version ";
+// Longer strings are not taken for a version
+auto constexpr kMaxVersionLength = size_t{256};
+// Target memory is read in chunks overlapping by the longest version
+auto constexpr kChunkSize = uint64_t{1} << 20;
+auto constexpr kDacName = "libmscordaccore.so";
+
+}  // namespace
+
+std::string FindRuntimeVersion(const char* data, size_t size) {
+  auto end = data + size;
+  auto prefix_end = kVersionPrefix + strlen(kVersionPrefix);
+  auto first = std::search(data, end, kVersionPrefix, prefix_end);
+  auto limit = first + (std::min)(kMaxVersionLength,
+                                  static_cast<size_t>(end - first));
+  auto last = std::find(first, limit, '\0');
+  return last == limit ? std::string{} : std::string{first, last};
+}
+
+std::string ReadRuntimeVersion(IDac& target, uint64_t first, uint64_t last) {
+  std::vector<char> buffer;
+  for (auto address = first; address < last;
+       address += kChunkSize - kMaxVersionLength) {
+    auto size = (std::min)(kChunkSize, last - address);
+    buffer.resize(static_cast<size_t>(size));
+    ReadRequest request{static_cast<CLRDATA_ADDRESS>(address),
+                        reinterpret_cast<BYTE*>(buffer.data()),
+                        static_cast<ULONG32>(size)};
+    target.ReadMemory(&request, 1);
+    auto version = FindRuntimeVersion(buffer.data(), request.read);
+    if (!version.empty() || request.read < size || address + size == last) {
+      return version;
+    }
+  }
+  return {};
+}
+
+std::string ReadRuntimeVersion(const std::string& path) {
+  struct stat file {};
+  if (stat(path.c_str(), &file) != 0 || !S_ISREG(file.st_mode)) {
+    return {};
+  }
+  auto mapping = MapFile(path);
+  if (!mapping) {
+    return {};
+  }
+  return FindRuntimeVersion(reinterpret_cast<const char*>(mapping->GetData()),
+                            mapping->GetSize());
+}
+
+std::string FindDac(const std::string& directory, const std::string& version) {
+  if (version.empty()) {
+    return {};
+  }
+  // The directory first, then the others in order
+  std::vector<std::string> directories;
+  auto slash = directory.find_last_of('/');
+  if (slash != std::string::npos) {
+    auto parent = directory.substr(0, slash);
+    if (auto dir = opendir(parent.empty() ? "/" : parent.c_str())) {
+      while (auto entry = readdir(dir)) {
+        auto path = parent + '/' + entry->d_name;
+        if (strcmp(entry->d_name, ".") != 0 &&
+            strcmp(entry->d_name, "..") != 0 && path != directory) {
+          directories.push_back(std::move(path));
+        }
+      }
+      closedir(dir);
+    }
+  }
+  std::sort(directories.begin(), directories.end());
+  directories.insert(directories.begin(), directory);
+  for (auto& candidate : directories) {
+    auto path = candidate + '/' + kDacName;
+    if (ReadRuntimeVersion(path) == version) {
+      return path;
+    }
+  }
+  return {};
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <string>
+
+#include "dac.h"
+
+// Native libraries of the runtime embed the version of the build, i.e.
+// "@(#)Version 8.0.1 @Commit: ...", the DAC is of the same build as the
+// runtime it reads. A runtime replaced while the process runs (e.g. updated
+// in place) has a DAC of another version next to it, the DAC of its own
+// version is found by the string.
+
+// Version string found in the data, empty if there is none
+std::string FindRuntimeVersion(const char* data, size_t size);
+// Version in the target memory at [first, last), read up to the first byte
+// not readable
+std::string ReadRuntimeVersion(IDac& target, uint64_t first, uint64_t last);
+// Version of the library file, empty if it can not be read
+std::string ReadRuntimeVersion(const std::string& path);
+// DAC of the version in the directory, or in one next to it (i.e. another
+// install under shared/Microsoft.NETCore.App), empty if there is none
+std::string FindDac(const std::string& directory, const std::string& version);
@@ -0,0 +1,173 @@
+#include "socket.h"
+
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+namespace {
+
+auto constexpr kTimeoutSeconds = 5;
+auto constexpr kBacklog = 16;
+
+// Files put at the path of a socket meanwhile are not removed
+bool IsSocket(const std::string& path) {
+  struct stat st;
+  return lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode);
+}
+
+class Connection final : public IConnection {
+ public:
+  explicit Connection(int fd) : fd_{fd} {}
+  ~Connection() override { close(fd_); }
+
+  Connection(const Connection&) = delete;
+  Connection(Connection&&) = delete;
+  Connection& operator=(const Connection&) = delete;
+  Connection& operator=(Connection&&) = delete;
+
+  size_t Receive(char* buffer, size_t size) override {
+    for (;;) {
+      auto res = recv(fd_, buffer, size, 0);
+      if (0 <= res) {
+        return static_cast<size_t>(res);
+      }
+      if (errno != EINTR) {
+        return 0;
+      }
+    }
+  }
+
+  bool Send(const char* data, size_t size) override {
+    while (size) {
+      // The peer might be gone, no SIGPIPE
+      auto res = send(fd_, data, size, MSG_NOSIGNAL);
+      if (res < 0 && errno == EINTR) {
+        continue;
+      }
+      if (res <= 0) {
+        return false;
+      }
+      data += res;
+      size -= static_cast<size_t>(res);
+    }
+    return true;
+  }
+
+ private:
+  int fd_;
+};
+
+class Listener final : public IListener {
+ public:
+  Listener(int fd, const std::string& path) : fd_{fd}, path_{path} {}
+  ~Listener() override {
+    close(fd_);
+    if (!path_.empty() && IsSocket(path_)) {
+      unlink(path_.c_str());
+    }
+  }
+
+  Listener(const Listener&) = delete;
+  Listener(Listener&&) = delete;
+  Listener& operator=(const Listener&) = delete;
+  Listener& operator=(Listener&&) = delete;
+
+  std::unique_ptr<IConnection> Accept() override {
+    for (;;) {
+      auto fd = accept(fd_, nullptr, nullptr);
+      if (fd < 0 && (errno == EINTR || errno == ECONNABORTED)) {
+        continue;
+      }
+      if (fd < 0) {
+        Error() << "Error accepting connection, error " << errno;
+        return nullptr;
+      }
+      timeval timeout{kTimeoutSeconds, 0};
+      setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+      setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+      return std::make_unique<Connection>(fd);
+    }
+  }
+
+ private:
+  int fd_;
+  std::string path_;  // of Unix domain socket
+};
+
+int ListenTcp(const std::string& host, const std::string& port) {
+  addrinfo hints{};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE | AI_NUMERICSERV;
+  addrinfo* info = nullptr;
+  auto res = getaddrinfo(host.c_str(), port.c_str(), &hints, &info);
+  if (res != 0) {
+    Error() << "Could not resolve " << host << ", " << gai_strerror(res);
+    return -1;
+  }
+  auto fd = -1;
+  for (auto it = info; it && fd < 0; it = it->ai_next) {
+    fd = socket(it->ai_family, it->ai_socktype, it->ai_protocol);
+    if (fd < 0) {
+      continue;
+    }
+    auto reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (bind(fd, it->ai_addr, it->ai_addrlen) != 0 ||
+        listen(fd, kBacklog) != 0) {
+      Error() << "Could not listen on " << host << ":" << port << ", error "
+              << errno;
+      close(fd);
+      fd = -1;
+    }
+  }
+  freeaddrinfo(info);
+  return fd;
+}
+
+int ListenUnix(const std::string& path) {
+  sockaddr_un addr{};
+  if (sizeof(addr.sun_path) <= path.size()) {
+    Error() << "Socket path " << path << " is too long";
+    return -1;
+  }
+  struct stat st;
+  if (lstat(path.c_str(), &st) == 0) {
+    if (!S_ISSOCK(st.st_mode)) {
+      Error() << "Could not listen on " << path << ", it is not a socket";
+      return -1;
+    }
+    unlink(path.c_str());
+  }
+  addr.sun_family = AF_UNIX;
+  memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+  auto fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    Error() << "Could not create socket, error " << errno;
+    return -1;
+  }
+  if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+      listen(fd, kBacklog) != 0) {
+    Error() << "Could not listen on " << path << ", error " << errno;
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+}  // namespace
+
+std::unique_ptr<IListener> Listen(const std::string& address) {
+  std::string host, port;
+  if (SplitHostPort(address, host, port)) {
+    auto fd = ListenTcp(host, port);
+    return fd < 0 ? nullptr : std::make_unique<Listener>(fd, std::string{});
+  }
+  auto fd = ListenUnix(address);
+  return fd < 0 ? nullptr : std::make_unique<Listener>(fd, address);
+}
@@ -1,20 +1,21 @@
 #pragma once
+#include <atomic>
 #include <codecvt>
 #include <locale>
+#include <mutex>
 
+// Line is buffered and written at once, so that lines logged by different
+// threads do not interleave
 class LogLine final {
  public:
-  LogLine(LogLine&& other) noexcept : visible_{other.visible_} {
+  LogLine(LogLine&& other) noexcept
+      : visible_{other.visible_}, line_{std::move(other.line_)} {
     if (visible_) {
       other.visible_ = false;
     }
   }
 
-  ~LogLine() {
-    if (visible_) {
-      std::cerr << std::endl;
-    }
-  }
+  ~LogLine();
 
   LogLine(const LogLine& other) = delete;
   LogLine& operator=(const LogLine&) = delete;
@@ -23,7 +24,7 @@ class LogLine final {
   template <typename T>
   LogLine& operator<<(T&& t) {
     if (visible_) {
-      std::cerr << std::forward<T>(t);
+      line_ << std::forward<T>(t);
     }
     return *this;
   }
@@ -32,12 +33,14 @@ class LogLine final {
   explicit LogLine(bool visible) : visible_{visible} {}
 
   bool visible_;
+  std::ostringstream line_;
   friend struct Log;
 };
 
 struct Log final {
   static int Level;
-  static int ErrorCount;
+  static std::atomic<int> ErrorCount;
+  static std::mutex Mutex;
 
   static LogLine Error() {
     ++ErrorCount;
@@ -45,8 +48,17 @@ struct Log final {
   }
 
   static LogLine Debug() { return LogLine{1 <= Level}; }
+
+  static LogLine Discard() { return LogLine{false}; }
 };
 
+inline LogLine::~LogLine() {
+  if (visible_) {
+    std::lock_guard<std::mutex> lock{Log::Mutex};
+    std::cerr << line_.str() << std::endl;
+  }
+}
+
 inline LogLine Error() { return Log::Error(); }
 inline LogLine Debug() { return Log::Debug(); }
 
@@ -0,0 +1,129 @@
+#include "lz4.h"
+
+#include <cstring>
+
+namespace {
+
+auto constexpr kMinMatch = 4;
+auto constexpr kLastLiterals = 5;  // block ends with literals
+auto constexpr kMatchLimit = 12;   // no match starts closer to the end
+auto constexpr kMaxOffset = 0xFFFF;
+auto constexpr kHashBits = 14;
+
+uint32_t Read32(const BYTE* p) {
+  uint32_t value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+uint32_t Hash(uint32_t sequence) {
+  return (sequence * 2654435761u) >> (32 - kHashBits);
+}
+
+// Writes length extension bytes
+BYTE* WriteLength(BYTE* op, size_t length) {
+  for (; 255 <= length; length -= 255) {
+    *op++ = 255;
+  }
+  *op++ = static_cast<BYTE>(length);
+  return op;
+}
+
+bool ReadLength(const BYTE*& ip, const BYTE* end, size_t& length) {
+  for (BYTE b = 255; b == 255; length += b) {
+    if (ip == end) return false;
+    b = *ip++;
+  }
+  return true;
+}
+
+}  // namespace
+
+size_t Lz4CompressBound(size_t size) { return size + size / 255 + 16; }
+
+size_t Lz4Compress(const BYTE* src, size_t size, BYTE* dst, size_t capacity) {
+  uint32_t table[1 << kHashBits]{};
+  auto op = dst;
+  auto dst_end = dst + capacity;
+  size_t anchor = 0;
+  // Emits literals [anchor, ip) followed by the match if any
+  auto emit = [&](size_t ip, size_t offset, size_t match) {
+    auto literals = ip - anchor;
+    auto needed = 1 + literals / 255 + 1 + literals + 2 + match / 255 + 1;
+    if (static_cast<size_t>(dst_end - op) < needed) return false;
+    auto token = op++;
+    *token = static_cast<BYTE>((literals < 15 ? literals : 15) << 4);
+    if (15 <= literals) op = WriteLength(op, literals - 15);
+    if (literals) memcpy(op, src + anchor, literals);
+    op += literals;
+    if (match) {
+      *op++ = static_cast<BYTE>(offset);
+      *op++ = static_cast<BYTE>(offset >> 8);
+      match -= kMinMatch;
+      *token |= static_cast<BYTE>(match < 15 ? match : 15);
+      if (15 <= match) op = WriteLength(op, match - 15);
+    }
+    return true;
+  };
+  if (kMatchLimit < size) {
+    for (size_t ip = 0; ip < size - kMatchLimit;) {
+      auto sequence = Read32(src + ip);
+      auto& entry = table[Hash(sequence)];
+      size_t ref = entry;
+      entry = static_cast<uint32_t>(ip);
+      if (ref < ip && ip - ref <= kMaxOffset && Read32(src + ref) == sequence) {
+        size_t match = kMinMatch;
+        for (; ip + match < size - kLastLiterals &&
+               src[ref + match] == src[ip + match];
+             ++match)
+          ;
+        if (!emit(ip, ip - ref, match)) return 0;
+        ip += match;
+        anchor = ip;
+      } else {
+        ++ip;
+      }
+    }
+  }
+  anchor = anchor < size ? anchor : size;
+  if (!emit(size, 0, 0)) return 0;
+  return static_cast<size_t>(op - dst);
+}
+
+bool Lz4Decompress(const BYTE* src, size_t src_size, BYTE* dst, size_t size) {
+  auto ip = src;
+  auto end = src + src_size;
+  auto op = dst;
+  auto dst_end = dst + size;
+  while (ip < end) {
+    auto token = *ip++;
+    size_t literals = token >> 4;
+    if (literals == 15 && !ReadLength(ip, end, literals)) return false;
+    if (static_cast<size_t>(end - ip) < literals ||
+        static_cast<size_t>(dst_end - op) < literals)
+      return false;
+    if (literals) memcpy(op, ip, literals);
+    ip += literals;
+    op += literals;
+    if (ip == end) break;  // last sequence has no match
+    if (end - ip < 2) return false;
+    size_t offset = ip[0] | (ip[1] << 8);
+    ip += 2;
+    size_t match = token & 15;
+    if (match == 15 && !ReadLength(ip, end, match)) return false;
+    match += kMinMatch;
+    if (!offset || static_cast<size_t>(op - dst) < offset ||
+        static_cast<size_t>(dst_end - op) < match)
+      return false;
+    auto ref = op - offset;
+    if (offset == 1) {
+      memset(op, *ref, match);
+    } else if (match <= offset) {
+      memcpy(op, ref, match);
+    } else {
+      for (size_t i = 0; i < match; ++i) op[i] = ref[i];
+    }
+    op += match;
+  }
+  return op == dst_end;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+// LZ4 block format (https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md)
+// codec. Blocks produced can be decompressed by the reference implementation
+// and vice versa.
+
+// Maximum size of the compressed data
+size_t Lz4CompressBound(size_t size);
+
+// Returns size of the compressed data or zero if it does not fit "capacity"
+size_t Lz4Compress(const BYTE* src, size_t size, BYTE* dst, size_t capacity);
+
+// Returns false unless exactly "size" bytes are decompressed
+bool Lz4Decompress(const BYTE* src, size_t src_size, BYTE* dst, size_t size);
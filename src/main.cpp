@@ -1,8 +1,17 @@
-﻿#include "format.h"
+﻿#include "exporter.h"
+#include "fleet.h"
+#include "format.h"
+#include "monitor.h"
 #include "statistics.h"
 
+#ifdef _MSC_VER
+#include <fcntl.h>
+#include <io.h>
+#endif
+
 int Log::Level;
-int Log::ErrorCount;
+std::atomic<int> Log::ErrorCount;
+std::mutex Log::Mutex;
 
 int main(int argc, char* argv[]) {
   Options options{};
@@ -25,17 +34,70 @@ int main(int argc, char* argv[]) {
     }
   }
 
-  if (!options.pid) {
+  Log::Level = options.verbose ? 1 : 0;
+
+  auto fleet = options.all_pids || !options.pids.empty();
+  if (!options.load.empty()) {
+    if (options.pid || fleet || !options.core.empty() ||
+        !options.save.empty() || !options.capture.empty()) {
+      Error() << "/load option should not be used with /pid, /core, /save or "
+                 "/capture";
+    }
+  } else if (!options.core.empty()) {
+    if (options.pid || fleet) {
+      Error() << "/core option should not be used with /pid";
+    }
+  } else if (!options.pid && !fleet) {
     Error() << "/pid option is not provided";
   }
+  if (fleet && (!options.save.empty() || !options.capture.empty() ||
+                options.interval || !options.serve.empty())) {
+    Error() << "Several processes should not be analyzed with /save, "
+               "/capture, /interval or /serve";
+  }
+  if (!options.save.empty() && !options.capture.empty()) {
+    Error() << "/save option should not be used with /capture";
+  }
+  if (!options.mtcache.empty() && !options.pid) {
+    Error() << "/mtcache option should be used with /pid only";
+  }
+  if ((options.interval || !options.serve.empty()) &&
+      (!options.load.empty() || !options.core.empty() ||
+       !options.save.empty() || !options.capture.empty())) {
+    Error() << "/interval and /serve options should not be used with /load, "
+               "/core, /save or /capture";
+  }
+  // Every type of a large heap makes too many series
+  if (!options.serve.empty() &&
+      options.limit == (std::numeric_limits<std::size_t>::max)()) {
+    options.limit = 100;
+  }
 
   if (Log::ErrorCount != 0) {
     std::cerr << "See `" << GetProgramName(argv[0]) << " /help`";
     return Log::ErrorCount;
   }
 
+#ifdef _MSC_VER
+  if (options.format == OutputFormat::Binary) {
+    _setmode(_fileno(stdout), _O_BINARY);
+  }
+#endif
+
   try {
-    HeapStatistics statistics;
+    if (fleet) {
+      FleetScan{options}.Run(std::cout);
+      return Log::ErrorCount;
+    }
+    if (!options.serve.empty()) {
+      HeapExporter{options}.Run();
+      return Log::ErrorCount;
+    }
+    if (options.interval) {
+      HeapMonitor{options}.Run(std::cout);
+      return Log::ErrorCount;
+    }
+    HeapStatistics statistics{};
     if (HeapStatisticsGenerator::Run(options, statistics) &&
         (Log::ErrorCount == 0 || !options.strict)) {
       std::cout << Format{statistics, options};
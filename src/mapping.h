@@ -0,0 +1,12 @@
+#pragma once
+#include <memory>
+#include <string>
+
+// Read-only view of a whole file
+struct IFileMapping {
+  virtual ~IFileMapping() = default;
+  virtual const BYTE* GetData() const = 0;
+  virtual size_t GetSize() const = 0;
+};
+
+std::unique_ptr<IFileMapping> MapFile(const std::string& path);
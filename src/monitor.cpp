@@ -0,0 +1,88 @@
+#include "monitor.h"
+
+#include <ctime>
+#include <string>
+#include <thread>
+
+#include "format.h"
+
+namespace {
+
+// Monitor gives up after that many samples in a row failed
+auto constexpr kMaxFailures = 3;
+
+std::tm ToUtc(std::chrono::system_clock::time_point time) {
+  auto t = std::chrono::system_clock::to_time_t(time);
+  std::tm tm{};
+#ifdef _MSC_VER
+  gmtime_s(&tm, &t);
+#else
+  gmtime_r(&t, &tm);
+#endif
+  return tm;
+}
+
+// Signed difference of two totals
+std::string Change(SIZE_T from, SIZE_T to) {
+  return from <= to ? "+" + std::to_string(to - from)
+                    : "-" + std::to_string(from - to);
+}
+
+}  // namespace
+
+void HeapMonitor::Run(std::ostream& out) {
+  auto interval = std::chrono::seconds{options_.interval};
+  auto next = std::chrono::steady_clock::now();
+  for (auto failures = 0; failures < kMaxFailures;) {
+    if (Sample(out)) {
+      failures = 0;
+    } else if (history_.empty()) {
+      // Never sampled, the target is not a .NET process or not accessible
+      return;
+    } else {
+      ++failures;
+    }
+    // Keep the schedule, samples which could not be taken in time are skipped
+    next += interval;
+    auto now = std::chrono::steady_clock::now();
+    if (next < now) {
+      Debug() << "Sampling takes longer than the interval";
+      next += (now - next) / interval * interval + interval;
+    }
+    std::this_thread::sleep_until(next);
+  }
+  Error() << "Giving up after " << kMaxFailures << " failed samples in a row";
+}
+
+bool HeapMonitor::Sample(std::ostream& out) {
+  auto start = std::chrono::steady_clock::now();
+  auto time = std::chrono::system_clock::now();
+  auto errors = Log::ErrorCount.load();
+  HeapStatistics statistics{};
+  if (!generator_.Run(statistics) ||
+      (options_.strict && errors != Log::ErrorCount)) {
+    return false;
+  }
+  if (options_.format == OutputFormat::Text) {
+    auto tm = ToUtc(time);
+    out << "Sample taken at " << std::put_time(&tm, "%Y-%m-%dT%H:%M:%SZ")
+        << '\n';
+  }
+  out << Format{statistics, options_, time};
+  auto count = statistics.count[DAC_NUMBERGENERATIONS];
+  auto size = statistics.size_total[DAC_NUMBERGENERATIONS];
+  if (options_.format == OutputFormat::Text && !history_.empty()) {
+    auto& oldest = history_[0];
+    auto tm = ToUtc(oldest.time);
+    out << "Change over the last " << history_.size() << " sample(s) since "
+        << std::put_time(&tm, "%Y-%m-%dT%H:%M:%SZ") << ": "
+        << Change(oldest.count, count) << " objects, "
+        << Change(oldest.size, size) << " bytes\n";
+  }
+  out << std::flush;
+  auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start);
+  Debug() << "Sample took " << elapsed.count() << " ms";
+  history_.Add(time, statistics);
+  return true;
+}
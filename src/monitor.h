@@ -0,0 +1,69 @@
+#pragma once
+#include <chrono>
+
+#include "statistics.h"
+
+// Heap totals of the last samples taken, the oldest sample is overwritten
+// when the history is full. Statistics of the types are not kept, so memory
+// used does not depend on the number of types.
+class HeapHistory final {
+ public:
+  struct Sample {
+    std::chrono::system_clock::time_point time;
+    SIZE_T count;
+    SIZE_T size;
+  };
+
+  explicit HeapHistory(size_t capacity) : samples_(capacity) {}
+
+  HeapHistory(const HeapHistory&) = delete;
+  HeapHistory(HeapHistory&&) = delete;
+  HeapHistory& operator=(const HeapHistory&) = delete;
+  HeapHistory& operator=(HeapHistory&&) = delete;
+
+  void Add(std::chrono::system_clock::time_point time,
+           const HeapStatistics& statistics) {
+    samples_[next_] = {time, statistics.count[DAC_NUMBERGENERATIONS],
+                       statistics.size_total[DAC_NUMBERGENERATIONS]};
+    next_ = (next_ + 1) % samples_.size();
+    size_ = (std::min)(size_ + 1, samples_.size());
+  }
+
+  // Zero is the oldest sample
+  const Sample& operator[](size_t i) const {
+    return samples_[(next_ + samples_.size() - size_ + i) % samples_.size()];
+  }
+
+  size_t size() const { return size_; }
+  bool empty() const { return !size_; }
+
+ private:
+  std::vector<Sample> samples_;
+  size_t next_{};
+  size_t size_{};
+};
+
+// Samples the target periodically and prints statistics of every sample,
+// followed in text output by the change of the heap totals over the history.
+// The DAC is loaded once, method tables and names resolved are reused by
+// the next samples.
+class HeapMonitor final {
+ public:
+  explicit HeapMonitor(const Options& options)
+      : options_{options}, generator_{options}, history_{options.history} {}
+
+  HeapMonitor(const HeapMonitor&) = delete;
+  HeapMonitor(HeapMonitor&&) = delete;
+  HeapMonitor& operator=(const HeapMonitor&) = delete;
+  HeapMonitor& operator=(HeapMonitor&&) = delete;
+
+  // Returns when the target can not be sampled anymore, i.e. it has exited
+  void Run(std::ostream& out);
+
+ private:
+  bool Sample(std::ostream& out);
+
+  const Options& options_;
+  HeapStatisticsGenerator generator_;
+  HeapHistory history_;
+};
@@ -0,0 +1,209 @@
+#include "mtcache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include "statistics.h"
+
+namespace {
+
+auto constexpr kMagic = "GCHMTAB";
+
+}  // namespace
+
+void MethodTableCache::Load() {
+  header_ = nullptr;
+  entries_ = nullptr;
+  names_ = nullptr;
+  valid_.clear();
+  mapping_.reset();
+  if (!std::ifstream{path_}) {
+    Debug() << "Method table cache " << path_ << " not found";
+    return;
+  }
+  auto mapping = MapFile(path_);
+  if (!mapping) {
+    return;
+  }
+  auto data = mapping->GetData();
+  auto size = mapping->GetSize() - sizeof(MethodTableCacheHeader);
+  auto header = reinterpret_cast<const MethodTableCacheHeader*>(data);
+  if (mapping->GetSize() < sizeof(MethodTableCacheHeader) ||
+      memcmp(header->magic, kMagic, sizeof(header->magic)) != 0 ||
+      header->version != kVersion ||
+      header->pointer_size != sizeof(void*) ||
+      size / sizeof(MethodTableCacheEntry) < header->count ||
+      size - header->count * sizeof(MethodTableCacheEntry) <
+          header->names_size) {
+    Debug() << "Method table cache " << path_ << " is not valid, rebuilt";
+    return;
+  }
+  if (header->pid != static_cast<uint64_t>(pid_) ||
+      header->start_time != start_time_) {
+    Debug() << "Method table cache " << path_
+            << " is of another process, rebuilt";
+    return;
+  }
+  header_ = header;
+  entries_ = reinterpret_cast<const MethodTableCacheEntry*>(header + 1);
+  names_ = reinterpret_cast<const char*>(entries_ + header->count);
+  valid_.assign(static_cast<size_t>(header->count), false);
+  mapping_ = std::move(mapping);
+  Debug() << "Method table cache " << path_ << ", " << header->count
+          << " method tables";
+}
+
+bool MethodTableCache::Find(uintptr_t mt, DWORD& base_size,
+                            DWORD& component_size) {
+  auto entry = FindEntry(mt);
+  if (!entry) {
+    ++misses_;
+    return false;
+  }
+  MethodTableHeader header{};
+  ReadRequest request{static_cast<CLRDATA_ADDRESS>(mt),
+                      reinterpret_cast<BYTE*>(&header), sizeof(header)};
+  if (dac_->ReadMemory(&request, 1) != S_OK ||
+      header.base_size != entry->base_size || header.token != entry->token ||
+      (header.flags & kHasComponentSize ? header.flags & 0xFFFF : 0) !=
+          entry->component_size) {
+    ++stale_;
+    return false;
+  }
+  ++hits_;
+  valid_[entry - entries_] = true;
+  base_size = entry->base_size;
+  component_size = entry->component_size;
+  return true;
+}
+
+bool MethodTableCache::FindName(uintptr_t mt, std::string& name) const {
+  auto entry = FindEntry(mt);
+  return entry && valid_[entry - entries_] && GetName(*entry, name);
+}
+
+bool MethodTableCache::Save(MethodTableResolver& resolver,
+                            TypeNameResolver& names) {
+  std::vector<MethodTableCacheEntry> entries;
+  std::string text;
+  auto add_name = [&text](MethodTableCacheEntry& entry, const char* data,
+                          size_t size) {
+    entry.name_offset = text.size();
+    entry.name_size = static_cast<uint32_t>(size);
+    text.append(data, size);
+  };
+  std::string name;
+  TypeName type_name;
+  resolver.ForEach([&](uintptr_t mt, DWORD base_size, DWORD component_size) {
+    MethodTableCacheEntry entry{mt, base_size, component_size};
+    entry.name_size = kNoName;
+    if (names.Find(mt, type_name)) {
+      add_name(entry, type_name.data, type_name.size);
+    } else if (FindName(mt, name)) {
+      add_name(entry, name.data(), name.size());
+    }
+    entries.push_back(entry);
+  });
+  ReadTokens(entries);
+  std::sort(entries.begin(), entries.end(),
+            [](auto& a, auto& b) { return a.mt < b.mt; });
+  // Entries not used this time, the process might allocate those types later
+  auto count = entries.size();
+  for (uint64_t i = 0; header_ && i < header_->count; ++i) {
+    auto entry = entries_[i];
+    auto used = std::binary_search(
+        entries.begin(), entries.begin() + count, entry,
+        [](auto& a, auto& b) { return a.mt < b.mt; });
+    if (!used) {
+      auto known = GetName(entry, name);
+      entry.name_size = kNoName;
+      if (known) {
+        add_name(entry, name.data(), name.size());
+      }
+      entries.push_back(entry);
+    }
+  }
+  std::sort(entries.begin(), entries.end(),
+            [](auto& a, auto& b) { return a.mt < b.mt; });
+  // Write next to the file and replace it, the file might be read by another
+  // instance meanwhile
+  MethodTableCacheHeader header{};
+  memcpy(header.magic, kMagic, sizeof(header.magic));
+  header.version = kVersion;
+  header.pointer_size = sizeof(void*);
+  header.pid = static_cast<uint64_t>(pid_);
+  header.start_time = start_time_;
+  header.count = entries.size();
+  header.names_size = text.size();
+  auto path = path_ + ".tmp";
+  {
+    std::ofstream file{path, std::ios::binary | std::ios::trunc};
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(entries.data()),
+               entries.size() * sizeof(MethodTableCacheEntry));
+    file.write(text.data(), text.size());
+    file.close();
+    if (!file) {
+      Error() << "Error writing " << path;
+      std::remove(path.c_str());
+      return false;
+    }
+  }
+  mapping_.reset();
+#ifdef _MSC_VER
+  std::remove(path_.c_str());
+#endif
+  if (std::rename(path.c_str(), path_.c_str()) != 0) {
+    Error() << "Error replacing " << path_;
+    std::remove(path.c_str());
+    return false;
+  }
+  Debug() << "Method table cache " << path_ << " saved, " << entries.size()
+          << " method tables";
+  Load();
+  return true;
+}
+
+const MethodTableCacheEntry* MethodTableCache::FindEntry(uintptr_t mt) const {
+  if (!header_) {
+    return nullptr;
+  }
+  auto last = entries_ + header_->count;
+  auto it = std::lower_bound(entries_, last, static_cast<uint64_t>(mt),
+                             [](auto& a, uint64_t mt) { return a.mt < mt; });
+  return it != last && it->mt == mt ? it : nullptr;
+}
+
+bool MethodTableCache::GetName(const MethodTableCacheEntry& entry,
+                               std::string& name) const {
+  if (entry.name_size == kNoName || header_->names_size < entry.name_offset ||
+      header_->names_size - entry.name_offset < entry.name_size) {
+    return false;
+  }
+  name.assign(names_ + entry.name_offset, entry.name_size);
+  return true;
+}
+
+void MethodTableCache::ReadTokens(
+    std::vector<MethodTableCacheEntry>& entries) {
+  // All at once, it is a single system call for many method tables
+  std::vector<MethodTableHeader> headers(entries.size());
+  std::vector<ReadRequest> requests(entries.size());
+  for (size_t i = 0; i < entries.size(); ++i) {
+    requests[i] = {static_cast<CLRDATA_ADDRESS>(entries[i].mt),
+                   reinterpret_cast<BYTE*>(&headers[i]),
+                   sizeof(MethodTableHeader)};
+  }
+  dac_->ReadMemory(requests.data(), requests.size());
+  // Entries which can not be checked next time are not saved
+  size_t count = 0;
+  for (size_t i = 0; i < entries.size(); ++i) {
+    if (requests[i].read == sizeof(MethodTableHeader) &&
+        headers[i].base_size == entries[i].base_size) {
+      entries[count] = entries[i];
+      entries[count++].token = headers[i].token;
+    }
+  }
+  entries.resize(count);
+}
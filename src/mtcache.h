@@ -0,0 +1,95 @@
+#pragma once
+#include "dac.h"
+#include "mapping.h"
+#include "mtmap.h"
+
+class MethodTableResolver;
+class TypeNameResolver;
+
+// File layout, offsets are from the beginning of the file:
+//
+//   MethodTableCacheHeader
+//   MethodTableCacheEntry[count], sorted by address
+//   names, UTF-8
+struct MethodTableCacheHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t pointer_size;
+  uint64_t pid;
+  uint64_t start_time;  // of the process, see GetProcessStartTime
+  uint64_t count;
+  uint64_t names_size;
+};
+
+struct MethodTableCacheEntry {
+  uint64_t mt;
+  uint32_t base_size;
+  uint32_t component_size;
+  uint16_t token;  // low bits of the type definition token
+  uint16_t reserved;
+  uint32_t name_size;  // kNoName if not resolved
+  uint64_t name_offset;
+};
+
+// Method tables and names resolved in the previous runs against the same
+// process, kept in a file mapped into memory. Method table addresses are
+// only valid while the process lives, so the cache is dropped once the
+// process ID or start time differs. A method table might still be unloaded
+// (i.e. of a collectible assembly) and its memory reused by another type,
+// so an entry is used only if base size, component size and token read from
+// the method table in the target are the same.
+class MethodTableCache final {
+ public:
+  static auto constexpr kVersion = 1;
+  static auto constexpr kNoName = ~uint32_t{};
+
+  MethodTableCache(IDac* dac, const std::string& path, int pid,
+                   uint64_t start_time)
+      : dac_{dac}, path_{path}, pid_{pid}, start_time_{start_time} {}
+
+  MethodTableCache(const MethodTableCache&) = delete;
+  MethodTableCache(MethodTableCache&&) = delete;
+  MethodTableCache& operator=(const MethodTableCache&) = delete;
+  MethodTableCache& operator=(MethodTableCache&&) = delete;
+
+  // Maps the file, empty cache if there is none or it is not valid
+  void Load();
+  // Entry of the method table if it is still valid
+  bool Find(uintptr_t mt, DWORD& base_size, DWORD& component_size);
+  // Name of the method table found before
+  bool FindName(uintptr_t mt, std::string& name) const;
+  // Writes method tables resolved and names known along with the entries
+  // not used this time, those might be on the heap next time
+  bool Save(MethodTableResolver& resolver, TypeNameResolver& names);
+
+  uint64_t Hits() const { return hits_; }
+  uint64_t Misses() const { return misses_; }
+  uint64_t Stale() const { return stale_; }
+
+ private:
+  struct MethodTableHeader {
+    uint32_t flags;  // component size in low bits if the high bit is set
+    uint32_t base_size;
+    uint16_t flags2;
+    uint16_t token;
+  };
+
+  static auto constexpr kHasComponentSize = 0x80000000u;
+
+  const MethodTableCacheEntry* FindEntry(uintptr_t mt) const;
+  bool GetName(const MethodTableCacheEntry& entry, std::string& name) const;
+  void ReadTokens(std::vector<MethodTableCacheEntry>& entries);
+
+  IDac* dac_;
+  std::string path_;
+  int pid_;
+  uint64_t start_time_;
+  std::unique_ptr<IFileMapping> mapping_;
+  const MethodTableCacheHeader* header_{};
+  const MethodTableCacheEntry* entries_{};
+  const char* names_{};
+  std::vector<bool> valid_;  // entry checked against the target
+  uint64_t hits_{};
+  uint64_t misses_{};
+  uint64_t stale_{};
+};
@@ -0,0 +1,167 @@
+#pragma once
+#include <cstdint>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+// Hash map keyed by method table address. Open addressing with linear probing
+// keeps entries in a single flat array, so a lookup touches one or two cache
+// lines instead of chasing list nodes. Method table addresses are aligned and
+// never zero, zero key marks an empty slot.
+//
+// Consecutive objects often are of the same type, so the slots of recently
+// found method tables are remembered in a small direct-mapped front cache,
+// which is checked before probing.
+template <typename T>
+class MethodTableMap final {
+ public:
+  struct Entry {
+    uintptr_t first;  // method table address
+    T second;
+  };
+
+  template <typename E>
+  class Iterator final {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = Entry;
+    using difference_type = std::ptrdiff_t;
+    using pointer = E*;
+    using reference = E&;
+
+    Iterator(E* it, E* end) : it_{it}, end_{end} { Skip(); }
+
+    E& operator*() const { return *it_; }
+    E* operator->() const { return it_; }
+    Iterator& operator++() {
+      ++it_;
+      Skip();
+      return *this;
+    }
+    bool operator==(const Iterator& other) const { return it_ == other.it_; }
+    bool operator!=(const Iterator& other) const { return it_ != other.it_; }
+
+   private:
+    void Skip() {
+      for (; it_ != end_ && !it_->first; ++it_)
+        ;
+    }
+
+    E* it_;
+    E* end_;
+  };
+
+  using iterator = Iterator<Entry>;
+  using const_iterator = Iterator<const Entry>;
+
+  MethodTableMap() { Clear(); }
+
+  // Returns nullptr if not found, "mt" must not be zero
+  T* Find(uintptr_t mt) {
+    auto& front = front_[(mt / sizeof(uintptr_t)) & (kFrontSize - 1)];
+    if (front.mt == mt) {
+      return &slots_[front.slot].second;
+    }
+    for (auto i = Hash(mt);; i = (i + 1) & mask_) {
+      auto& slot = slots_[i];
+      if (slot.first == mt) {
+        front = {mt, i};
+        return &slot.second;
+      }
+      if (!slot.first) {
+        return nullptr;
+      }
+    }
+  }
+
+  // Method table must not be in the map yet
+  T& Insert(uintptr_t mt, const T& value) {
+    if (slots_.size() < (size_ + 1) * 2) {
+      Rehash(slots_.size() * 2);
+    }
+    auto i = Hash(mt);
+    for (; slots_[i].first; i = (i + 1) & mask_)
+      ;
+    slots_[i] = {mt, value};
+    ++size_;
+    return slots_[i].second;
+  }
+
+  // Returns existing entry or inserts a value initialized one
+  T& operator[](uintptr_t mt) {
+    auto value = Find(mt);
+    return value ? *value : Insert(mt, T{});
+  }
+
+  void Clear() {
+    slots_.assign(kInitialCapacity, Entry{});
+    mask_ = kInitialCapacity - 1;
+    shift_ = 64 - kInitialBits;
+    size_ = 0;
+    ResetFront();
+  }
+
+  size_t size() const { return size_; }
+  bool empty() const { return !size_; }
+  // Number of slots, i.e. the memory taken is capacity() * sizeof(Entry)
+  size_t capacity() const { return slots_.size(); }
+
+  iterator begin() { return {slots_.data(), slots_.data() + slots_.size()}; }
+  iterator end() {
+    return {slots_.data() + slots_.size(), slots_.data() + slots_.size()};
+  }
+  const_iterator begin() const {
+    return {slots_.data(), slots_.data() + slots_.size()};
+  }
+  const_iterator end() const {
+    return {slots_.data() + slots_.size(), slots_.data() + slots_.size()};
+  }
+  const_iterator cbegin() const { return begin(); }
+  const_iterator cend() const { return end(); }
+
+ private:
+  static auto constexpr kInitialBits = 6;
+  static auto constexpr kInitialCapacity = size_t{1} << kInitialBits;
+  static auto constexpr kFrontSize = 16;
+
+  struct Front {
+    uintptr_t mt;
+    size_t slot;
+  };
+
+  // Fibonacci hashing, high bits of the product are the best mixed ones
+  size_t Hash(uintptr_t mt) const {
+    return static_cast<size_t>(
+        (static_cast<uint64_t>(mt) * 0x9E3779B97F4A7C15ull) >> shift_);
+  }
+
+  void Rehash(size_t capacity) {
+    std::vector<Entry> slots(capacity);
+    std::swap(slots_, slots);
+    mask_ = capacity - 1;
+    for (shift_ = 64; capacity > 1; capacity /= 2) {
+      --shift_;
+    }
+    for (auto& slot : slots) {
+      if (slot.first) {
+        auto i = Hash(slot.first);
+        for (; slots_[i].first; i = (i + 1) & mask_)
+          ;
+        slots_[i] = std::move(slot);
+      }
+    }
+    ResetFront();
+  }
+
+  void ResetFront() {
+    for (auto& front : front_) {
+      front = {0, 0};
+    }
+  }
+
+  std::vector<Entry> slots_;
+  size_t mask_;
+  int shift_;
+  size_t size_;
+  Front front_[kFrontSize];
+};
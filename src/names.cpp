@@ -0,0 +1,130 @@
+#include "names.h"
+
+size_t NameArena::Hash::operator()(const TypeName& name) const {
+  uint64_t hash = 0xCBF29CE484222325ull;
+  for (size_t i = 0; i < name.size; ++i) {
+    hash = (hash ^ static_cast<unsigned char>(name.data[i])) *
+           0x100000001B3ull;
+  }
+  return static_cast<size_t>(hash);
+}
+
+TypeName NameArena::Intern(const char* data, size_t size) {
+  auto it = names_.find({data, size});
+  if (it != names_.end()) {
+    return *it;
+  }
+  char* copy;
+  if (kBlockSize / 4 < size) {
+    // Large name takes a block of its own, the last block is still filled
+    blocks_.emplace(blocks_.begin(), new char[size]);
+    copy = blocks_.front().get();
+  } else {
+    if (kBlockSize - used_ < size) {
+      blocks_.emplace_back(new char[kBlockSize]);
+      used_ = 0;
+    }
+    copy = blocks_.back().get() + used_;
+    used_ += size;
+  }
+  memcpy(copy, data, size);
+  TypeName name{copy, size};
+  names_.insert(name);
+  return name;
+}
+
+void TypeNameResolver::Push(uintptr_t mt) {
+  std::lock_guard<std::mutex> lock{mutex_};
+  queue_.push_back(mt);
+  if (!thread_.joinable()) {
+    thread_ = std::thread{&TypeNameResolver::Run, this};
+  }
+  queued_.notify_one();
+}
+
+void TypeNameResolver::Add(uintptr_t mt, const std::string& name) {
+  std::lock_guard<std::mutex> lock{mutex_};
+  Insert(mt, name);
+}
+
+TypeName TypeNameResolver::Get(uintptr_t mt) {
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    if (auto known = names_.Find(mt)) {
+      return *known;
+    }
+  }
+  std::unique_lock<std::mutex> dac_lock{dac_mutex_};
+  auto& name = inline_nameof_(mt);
+  dac_lock.unlock();
+  std::lock_guard<std::mutex> lock{mutex_};
+  ++on_demand_count_;
+  return Insert(mt, name);
+}
+
+bool TypeNameResolver::Find(uintptr_t mt, TypeName& name) {
+  std::lock_guard<std::mutex> lock{mutex_};
+  auto known = names_.Find(mt);
+  if (known) {
+    name = *known;
+  }
+  return known != nullptr;
+}
+
+void TypeNameResolver::Stop() {
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    stopping_ = true;
+    queued_.notify_one();
+  }
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+  queue_.clear();
+  stopping_ = false;
+}
+
+uint64_t TypeNameResolver::BackgroundCount() {
+  std::lock_guard<std::mutex> lock{mutex_};
+  return background_count_;
+}
+
+uint64_t TypeNameResolver::OnDemandCount() {
+  std::lock_guard<std::mutex> lock{mutex_};
+  return on_demand_count_;
+}
+
+void TypeNameResolver::Run() {
+  std::vector<uintptr_t> batch;
+  std::unique_lock<std::mutex> lock{mutex_};
+  for (;;) {
+    queued_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+    if (stopping_) {
+      return;
+    }
+    batch.swap(queue_);
+    for (auto mt : batch) {
+      if (stopping_) {
+        return;
+      }
+      if (names_.Find(mt)) {
+        continue;
+      }
+      lock.unlock();
+      std::unique_lock<std::mutex> dac_lock{dac_mutex_};
+      auto& name = nameof_(mt);
+      dac_lock.unlock();
+      lock.lock();
+      ++background_count_;
+      Insert(mt, name);
+    }
+    batch.clear();
+  }
+}
+
+TypeName TypeNameResolver::Insert(uintptr_t mt, const std::string& name) {
+  if (auto known = names_.Find(mt)) {
+    return *known;
+  }
+  return names_.Insert(mt, arena_.Intern(name.data(), name.size()));
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+
+#include "dac.h"
+#include "mtmap.h"
+
+// Name stored in the arena, never moved or freed while the arena lives
+struct TypeName {
+  const char* data;
+  size_t size;
+
+  std::string str() const { return {data, size}; }
+};
+
+// Names are copied into large blocks, so that many names take few
+// allocations. Equal names are stored once.
+class NameArena final {
+ public:
+  NameArena() = default;
+
+  NameArena(const NameArena&) = delete;
+  NameArena(NameArena&&) = delete;
+  NameArena& operator=(const NameArena&) = delete;
+  NameArena& operator=(NameArena&&) = delete;
+
+  TypeName Intern(const char* data, size_t size);
+
+ private:
+  static auto constexpr kBlockSize = 0x10000;
+
+  struct Hash {
+    size_t operator()(const TypeName& name) const;
+  };
+
+  struct Equal {
+    bool operator()(const TypeName& a, const TypeName& b) const {
+      return a.size == b.size && memcmp(a.data, b.data, a.size) == 0;
+    }
+  };
+
+  std::vector<std::unique_ptr<char[]>> blocks_;
+  size_t used_{kBlockSize};  // of the last block
+  std::unordered_set<TypeName, Hash, Equal> names_;
+};
+
+// Resolves type names on a dedicated thread while segments are walked.
+// Method tables are queued as the walk discovers them, so most of the names
+// are known by the time the walk is over. Names not resolved yet are resolved
+// on the thread asking for them. Calls to the DAC are serialized with the
+// mutex given, the DAC is not thread safe.
+class TypeNameResolver final {
+ public:
+  TypeNameResolver(IDac* dac, std::mutex& dac_mutex)
+      : nameof_{dac}, inline_nameof_{dac}, dac_mutex_{dac_mutex} {}
+  ~TypeNameResolver() { Stop(); }
+
+  TypeNameResolver(const TypeNameResolver&) = delete;
+  TypeNameResolver(TypeNameResolver&&) = delete;
+  TypeNameResolver& operator=(const TypeNameResolver&) = delete;
+  TypeNameResolver& operator=(TypeNameResolver&&) = delete;
+
+  // Queues the method table, the thread is started on the first call
+  void Push(uintptr_t mt);
+  // Adds the name known beforehand (i.e. cached)
+  void Add(uintptr_t mt, const std::string& name);
+  // Returns the name, resolving it if needed. Not to be called concurrently.
+  TypeName Get(uintptr_t mt);
+  // Returns false if the name is not resolved yet
+  bool Find(uintptr_t mt, TypeName& name);
+  // Drops the method tables queued and waits for the thread to exit, the DAC
+  // is not used in the background afterwards
+  void Stop();
+
+  // Number of names resolved with the DAC so far, by the thread and on
+  // demand
+  uint64_t BackgroundCount();
+  uint64_t OnDemandCount();
+
+ private:
+  void Run();
+  // Adds the name unless it is there already
+  TypeName Insert(uintptr_t mt, const std::string& name);
+
+  TypeNameProvider nameof_;         // used by the thread
+  TypeNameProvider inline_nameof_;  // used by Get
+  std::mutex& dac_mutex_;
+  std::mutex mutex_;  // guards the members below
+  std::condition_variable queued_;
+  std::vector<uintptr_t> queue_;
+  bool stopping_{false};
+  std::thread thread_;
+  NameArena arena_;
+  MethodTableMap<TypeName> names_;
+  uint64_t background_count_{};
+  uint64_t on_demand_count_{};
+};
@@ -1,5 +1,6 @@
 #include "options.h"
 
+#include <algorithm>
 #include <cstring>
 
 #include "version.h"
@@ -18,6 +19,72 @@ inline bool DirectorySeparatorChar(char ch) { return ch == '/' || ch == '\\'; }
 inline bool DirectorySeparatorChar(char ch) { return ch == '/'; }
 #endif
 
+// Parses comma separated keys, {+|-}{size|count}[:gen] each. Order and
+// generation omitted are taken from the previous key, the first key takes
+// them from the first key parsed before. Sole order sign changes the order
+// of the first key.
+bool ParseSortKeys(char* val, std::vector<SortKey>& keys) {
+  std::vector<SortKey> parsed;
+  auto key = keys.front();
+  for (auto next = val; next;) {
+    auto token = next;
+    next = strchr(token, ',');
+    if (next) *next++ = 0;
+    if (token[0] == '-' || token[0] == '+') {
+      key.order = token[0] == '+' ? Order::Asc : Order::Desc;
+      ++token;
+    }
+    if (auto res = strchr(token, ':')) {
+      auto gen = res + 1;
+      if (*gen && (sscanf(gen, "%d", &key.gen) != 1 || key.gen < 0 ||
+                   DAC_NUMBERGENERATIONS < key.gen)) {
+        Error() << "Invalid generation number for /sort option";
+        return false;
+      }
+      *res = 0;
+    }
+    if (!strcasecmp(token, "size") || !strcasecmp(token, "s"))
+      key.orderby = OrderBy::TotalSize;
+    else if (!strcasecmp(token, "count") || !strcasecmp(token, "c"))
+      key.orderby = OrderBy::Count;
+    else if (*token || next || !parsed.empty()) {
+      Error() << "Invalid column name for /sort option";
+      return false;
+    }
+    parsed.push_back(key);
+  }
+  keys = std::move(parsed);
+  return true;
+}
+
+// Parses "all" or comma separated process IDs. Single ID is kept in "pid",
+// so that the options of a single target stay the same.
+bool ParsePids(char* val, int& pid, std::vector<int>& pids, bool& all) {
+  if (!strcasecmp(val, "all")) {
+    all = true;
+    return true;
+  }
+  std::vector<int> parsed;
+  for (auto next = val; next;) {
+    auto token = next;
+    next = strchr(token, ',');
+    if (next) *next++ = 0;
+    auto id = 0;
+    if (sscanf(token, "%d", &id) != 1 || id <= 0) {
+      return false;
+    }
+    parsed.push_back(id);
+  }
+  std::sort(parsed.begin(), parsed.end());
+  parsed.erase(std::unique(parsed.begin(), parsed.end()), parsed.end());
+  if (parsed.size() == 1) {
+    pid = parsed.front();
+  } else {
+    pids = std::move(parsed);
+  }
+  return true;
+}
+
 }  // namespace
 
 bool Options::ParseCommandLine(int argc, char* argv[]) {
@@ -31,7 +98,7 @@ bool Options::ParseCommandLine(int argc, char* argv[]) {
       *res = 0;
     }
     if (!strcasecmp(argv[i], "/pid") || !strcasecmp(argv[i], "/p")) {
-      if (!val || sscanf(val, "%d", &pid) != 1) {
+      if (!val || !ParsePids(val, pid, pids, all_pids)) {
         Error() << "Invalid or missing value for /pid option";
         break;
       }
@@ -44,27 +111,7 @@ bool Options::ParseCommandLine(int argc, char* argv[]) {
       if (!val)
         // default sorting options apply
         continue;
-      if (val[0] == '-' || val[0] == '+') {
-        order = val[0] == '+' ? Order::Asc : Order::Desc;
-        ++val;
-        if (*val == 0)
-          // just sort order
-          continue;
-      }
-      if (auto res = strchr(val, ':')) {
-        auto next = res + 1;
-        if (*next && sscanf(next, "%d", &orderby_gen) != 1) {
-          Error() << "Invalid generation number for /sort option";
-          break;
-        }
-        *res = 0;
-      }
-      if (!strcasecmp(val, "size") || !strcasecmp(val, "s"))
-        orderby = OrderBy::TotalSize;
-      else if (!strcasecmp(val, "count") || !strcasecmp(val, "c"))
-        orderby = OrderBy::Count;
-      else {
-        Error() << "Invalid column name for /sort option";
+      if (!ParseSortKeys(val, sort)) {
         break;
       }
     } else if (!strcasecmp(argv[i], "/statistics") ||
@@ -73,6 +120,83 @@ bool Options::ParseCommandLine(int argc, char* argv[]) {
         Error() << "Invalid or missing value for /statistics option";
         break;
       }
+    } else if (!strcasecmp(argv[i], "/window") || !strcasecmp(argv[i], "/w")) {
+      std::size_t megabytes = 0;
+      if (!val || sscanf(val, "%zu", &megabytes) != 1 || megabytes == 0 ||
+          1024 < megabytes) {
+        Error() << "Invalid or missing value for /window option";
+        break;
+      }
+      window_size = megabytes << 20;
+    } else if (!strcasecmp(argv[i], "/threads") ||
+               !strcasecmp(argv[i], "/t")) {
+      if (!val || sscanf(val, "%u", &threads) != 1) {
+        Error() << "Invalid or missing value for /threads option";
+        break;
+      }
+    } else if (!strcasecmp(argv[i], "/chunk") || !strcasecmp(argv[i], "/c")) {
+      std::size_t megabytes = 0;
+      if (!val || sscanf(val, "%zu", &megabytes) != 1 || 1024 < megabytes) {
+        Error() << "Invalid or missing value for /chunk option";
+        break;
+      }
+      chunk_size = megabytes << 20;
+    } else if (!strcasecmp(argv[i], "/save")) {
+      if (!val) {
+        Error() << "Missing file name for /save option";
+        break;
+      }
+      save = val;
+    } else if (!strcasecmp(argv[i], "/capture")) {
+      if (!val) {
+        Error() << "Missing file name for /capture option";
+        break;
+      }
+      capture = val;
+    } else if (!strcasecmp(argv[i], "/load")) {
+      if (!val) {
+        Error() << "Missing file name for /load option";
+        break;
+      }
+      load = val;
+    } else if (!strcasecmp(argv[i], "/core")) {
+      if (!val) {
+        Error() << "Missing file name for /core option";
+        break;
+      }
+      core = val;
+    } else if (!strcasecmp(argv[i], "/mtcache")) {
+      if (!val) {
+        Error() << "Missing file name for /mtcache option";
+        break;
+      }
+      mtcache = val;
+    } else if (!strcasecmp(argv[i], "/interval")) {
+      if (!val || sscanf(val, "%u", &interval) != 1 || interval == 0) {
+        Error() << "Invalid or missing value for /interval option";
+        break;
+      }
+    } else if (!strcasecmp(argv[i], "/history")) {
+      if (!val || sscanf(val, "%zu", &history) != 1 || history == 0) {
+        Error() << "Invalid or missing value for /history option";
+        break;
+      }
+    } else if (!strcasecmp(argv[i], "/serve")) {
+      if (!val) {
+        Error() << "Missing address for /serve option";
+        break;
+      }
+      serve = val;
+    } else if (!strcasecmp(argv[i], "/full")) {
+      if (!val || sscanf(val, "%u", &full) != 1) {
+        Error() << "Invalid or missing value for /full option";
+        break;
+      }
+    } else if (!strcasecmp(argv[i], "/jobs") || !strcasecmp(argv[i], "/j")) {
+      if (!val || sscanf(val, "%u", &jobs) != 1 || jobs == 0) {
+        Error() << "Invalid or missing value for /jobs option";
+        break;
+      }
     } else if (!strcasecmp(argv[i], "/help") || !strcasecmp(argv[i], "/h") ||
                !strcasecmp(argv[i], "/?"))
       help = true;
@@ -83,14 +207,30 @@ bool Options::ParseCommandLine(int argc, char* argv[]) {
         Error() << "Invalid value for /verbose option";
         break;
       }
+    } else if (!strcasecmp(argv[i], "/format") ||
+               !strcasecmp(argv[i], "/f")) {
+      if (val && !strcasecmp(val, "text"))
+        format = OutputFormat::Text;
+      else if (val && !strcasecmp(val, "json"))
+        format = OutputFormat::Json;
+      else if (val && !strcasecmp(val, "ndjson"))
+        format = OutputFormat::NdJson;
+      else if (val && !strcasecmp(val, "binary"))
+        format = OutputFormat::Binary;
+      else {
+        Error() << "Invalid or missing value for /format option";
+        break;
+      }
     } else if (!strcasecmp(argv[i], "/json")) {
-      json = true;
+      format = OutputFormat::Json;
       if (val && sscanf(val, "%d", &json_indent) != 1) {
         Error() << "Invalid indentation value for /json option";
         break;
       }
     } else if (!strcasecmp(argv[i], "/strict")) {
       strict = true;
+    } else if (!strcasecmp(argv[i], "/profile")) {
+      profile = true;
     } else if (!strcasecmp(argv[i], "/version") || !strcmp(argv[i], "/v")) {
       version = true;
     } else {
@@ -107,19 +247,70 @@ void PrintHelp(char* argv0) {
   std::cout << DESCRIPTION "\n\n";
   std::cout << "Usage:\n";
   // clang-format off
-  std::cout << pname << " [/version] [/help] [/verbose] [/sort:{+|-}{size|count}[:gen]]\n";
+  std::cout << pname << " [/version] [/help] [/verbose] [/profile] [/sort:{+|-}{size|count}[:gen][,...]]\n";
+  for (auto _ : pname) std::cout << " ";
+  std::cout << " [/limit:n] [/statistics:n] [/format:text|json|ndjson|binary]\n";
+  for (auto _ : pname) std::cout << " ";
+  std::cout << " [/window:n] [/threads:n] [/chunk:n] [/save:file|/capture:file]\n";
+  for (auto _ : pname) std::cout << " ";
+  std::cout << " [/interval:n [/history:n] [/full:n]] [/mtcache:file]\n";
+  for (auto _ : pname) std::cout << " ";
+  std::cout << " [/serve:{port|host:port|path} [/interval:n]] [/jobs:n]\n";
   for (auto _ : pname) std::cout << " ";
-  std::cout << " [/limit:n] [/statistics:n] [/format:text|json] /pid:n\n\n";
+  std::cout << " {/pid:n[,...]|/pid:all|/load:file|/core:file}\n\n";
   std::cout << "  help     Display usage information\n";
   std::cout << "  verbose  Display warnings. Only errors are displayed by default\n";
+  std::cout << "  profile  Time the phases of the run and count the work done (reads, objects,\n";
+  std::cout << "           DAC requests, cache hits). Printed after the statistics, as \"profile\"\n";
+  std::cout << "           object of json output, to stderr with ndjson and binary output\n";
   std::cout << "  sort     Sort output by either total size or count, ascending '+' or\n";
   std::cout << "           descending '-'. You can also specify generation to sort on (refer to\n";
-  std::cout << "           `statistics` option description)\n";
+  std::cout << "           `statistics` option description). Types equal by the first key are\n";
+  std::cout << "           sorted by the next one, i.e. /sort:-size,count. The order and the\n";
+  std::cout << "           generation omitted are those of the previous key\n";
   std::cout << "  limit    Limit the number of rows to output\n";
+  std::cout << "  format   Output format, text (the same as WinDbg/SOS, default), json, or\n";
+  std::cout << "           ndjson (JSON object of a type per line), or binary (records described\n";
+  std::cout << "           in binary.h, for programs reading the output)\n";
   std::cout << "  statistics      Count only objects of the generation specified. Valid values are\n";
   std::cout << "           0 to 2 (first, second the third generations respectevely) and 3 for\n";
   std::cout << "           Large Object Heap. The same is for statistics parameter of `sort` option\n";
-  std::cout << "  pid      Target process ID\n\n";
+  std::cout << "  window   Size of the segment read window in megabytes, 1 to 1024 (default 4).\n";
+  std::cout << "           Segments are read through the window, objects larger than the\n";
+  std::cout << "           window are not read beyond the header\n";
+  std::cout << "  threads  Number of threads walking heap segments, 0 for the number of\n";
+  std::cout << "           processors (default 1)\n";
+  std::cout << "  chunk    Size in megabytes of the chunks larger segments are split into to\n";
+  std::cout << "           be walked by several threads, 0 to disable splitting (default 64)\n";
+  std::cout << "  save     Save heap snapshot of the target process to the file specified\n";
+  std::cout << "  capture  Save heap snapshot compressed in blocks on all the threads, smaller\n";
+  std::cout << "           and faster to save if disk bound, loaded the same way\n";
+  std::cout << "  load     Analyze heap snapshot saved instead of a live process\n";
+  std::cout << "  core     Analyze ELF core file of a process (i.e. createdump or gcore output)\n";
+  std::cout << "           instead of a live process, Linux only\n";
+  std::cout << "  interval Sample the target every n seconds until it exits. The DAC is\n";
+  std::cout << "           loaded once, types resolved are reused by the next samples\n";
+  std::cout << "  history  Number of the last samples which heap totals are kept in memory\n";
+  std::cout << "           (default 60), text output reports their change over them\n";
+  std::cout << "  full     Walk all the segments every n-th sample (default 10). Other samples\n";
+  std::cout << "           reuse statistics of the small object segments of the older\n";
+  std::cout << "           generations if there has been no GC since the previous sample and\n";
+  std::cout << "           their bounds and sampled content have not changed. 1 to walk\n";
+  std::cout << "           everything every time, 0 to reuse as long as nothing changes\n";
+  std::cout << "  serve    Serve heap statistics over HTTP in OpenMetrics format at /metrics on\n";
+  std::cout << "           the port of the loopback interface, host:port, or Unix domain\n";
+  std::cout << "           socket (Linux only). Per generation totals and the top types (see\n";
+  std::cout << "           sort and limit, default 100 types) are exported. Scrapes take a new\n";
+  std::cout << "           sample if the last one is older than the interval (default 10),\n";
+  std::cout << "           failed samples are retried after the interval as well\n";
+  std::cout << "  mtcache  Keep method tables and names resolved in the file, the next runs\n";
+  std::cout << "           against the same process resolve them without the DAC\n";
+  std::cout << "  jobs     Number of processes analyzed at once with several targets, each\n";
+  std::cout << "           walked by `threads` threads (default 4)\n";
+  std::cout << "  pid      Target process ID. Several comma separated IDs or `all` for every .NET\n";
+  std::cout << "           process accessible analyze them concurrently (see jobs), results are\n";
+  std::cout << "           printed per process in the order of IDs, json output is an array of\n";
+  std::cout << "           the objects of processes\n\n";
   std::cout << "Zero status code on success, non-zero otherwise\n";
   // clang-format on
 }
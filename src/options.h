@@ -1,21 +1,46 @@
 #pragma once
 #include <limits>
+#include <vector>
 
 enum class Order { Asc, Desc };
 enum class OrderBy { TotalSize, Count };
+enum class OutputFormat { Text, Json, NdJson, Binary };
+
+struct SortKey {
+  Order order;
+  OrderBy orderby;
+  int gen;
+};
 
 struct Options final {
   int pid{0};
-  Order order{Order::Asc};
-  OrderBy orderby{OrderBy::TotalSize};
-  int orderby_gen{DAC_NUMBERGENERATIONS};
+  // Several targets, /pid:all or a list of IDs, "pid" is zero then
+  bool all_pids{false};
+  std::vector<int> pids;
+  unsigned jobs{4};  // targets analyzed at once
+  // Types are ordered by the first key, those equal by the next one
+  std::vector<SortKey> sort{
+      {Order::Asc, OrderBy::TotalSize, DAC_NUMBERGENERATIONS}};
   std::size_t limit{(std::numeric_limits<std::size_t>::max)()};
   int gen{-1};
+  std::size_t window_size{4 << 20};
+  unsigned threads{1};
+  std::size_t chunk_size{64 << 20};
+  std::string save;
+  std::string capture;
+  std::string load;
+  std::string core;
+  std::string mtcache;
+  unsigned interval{0};  // seconds, zero to sample once
+  std::size_t history{60};
+  unsigned full{10};  // walk all the segments every "full" samples
+  std::string serve;  // port, host:port or Unix domain socket path
   bool help{false};
   bool verbose{false};
   bool version{false};
   bool strict{false};
-  bool json;
+  bool profile{false};  // time phases of the samples, count work done
+  OutputFormat format{OutputFormat::Text};
   int json_indent{-1};
 
   bool ParseCommandLine(int argc, char* argv[]);
@@ -0,0 +1,12 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// Creation time of the process in platform specific units, zero if the
+// process is not found. Tells a process from the one which had the same ID
+// before.
+uint64_t GetProcessStartTime(int pid);
+
+// IDs of the processes the CLR is loaded into, in ascending order. Processes
+// which modules can not be listed (i.e. of other users) are left out.
+std::vector<int> FindDotNetProcesses();
@@ -0,0 +1,102 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+// Phases of a sample timed with /profile. Method table requests are made
+// during the walk, their time is summed over the walker threads.
+enum class Phase {
+  Attach,
+  HeapData,
+  Save,
+  Walk,
+  MethodTables,
+  Sort,
+  Names,
+};
+auto constexpr kPhaseCount = 7;
+
+// Work done by a sample, counted with /profile
+enum class Counter {
+  Objects,
+  BytesWalked,
+  BytesSkipped,
+  BytesRead,
+  ReadCalls,
+  SegmentsWalked,
+  SegmentsReused,
+  Chunks,
+  ChunksWalkedAgain,
+  DacHeapRequests,
+  DacSegmentRequests,
+  DacThreadRequests,
+  DacMethodTableRequests,
+  DacNameRequests,
+  MethodTableCacheHits,
+  PageCacheHits,
+  PageCacheMisses,
+};
+auto constexpr kCounterCount = 17;
+
+// Names printed, in the order of the enumerators
+const char* const kPhaseNames[kPhaseCount] = {
+    "attach", "heap_data", "save", "walk", "method_tables", "sort", "names"};
+const char* const kCounterNames[kCounterCount] = {
+    "objects",
+    "bytes_walked",
+    "bytes_skipped",
+    "bytes_read",
+    "read_calls",
+    "segments_walked",
+    "segments_reused",
+    "chunks",
+    "chunks_walked_again",
+    "dac_heap_requests",
+    "dac_segment_requests",
+    "dac_thread_requests",
+    "dac_method_table_requests",
+    "dac_name_requests",
+    "method_table_cache_hits",
+    "page_cache_hits",
+    "page_cache_misses"};
+
+// Time spent in the phases of a sample and the work done. Nothing is timed
+// or counted unless it is enabled.
+struct Profile {
+  bool enabled{false};
+  std::array<std::chrono::steady_clock::duration, kPhaseCount> time{};
+  std::array<uint64_t, kCounterCount> counters{};
+
+  std::chrono::steady_clock::duration& operator[](Phase phase) {
+    return time[static_cast<size_t>(phase)];
+  }
+  uint64_t& operator[](Counter counter) {
+    return counters[static_cast<size_t>(counter)];
+  }
+};
+
+// Adds the time spent in the scope to the phase if the profile is enabled
+class PhaseTimer final {
+ public:
+  PhaseTimer(Profile& profile, Phase phase)
+      : profile_{profile.enabled ? &profile : nullptr}, phase_{phase} {
+    if (profile_) {
+      start_ = std::chrono::steady_clock::now();
+    }
+  }
+  ~PhaseTimer() {
+    if (profile_) {
+      (*profile_)[phase_] += std::chrono::steady_clock::now() - start_;
+    }
+  }
+
+  PhaseTimer(const PhaseTimer&) = delete;
+  PhaseTimer(PhaseTimer&&) = delete;
+  PhaseTimer& operator=(const PhaseTimer&) = delete;
+  PhaseTimer& operator=(PhaseTimer&&) = delete;
+
+ private:
+  Profile* profile_;
+  Phase phase_;
+  std::chrono::steady_clock::time_point start_;
+};
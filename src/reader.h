@@ -0,0 +1,117 @@
+#pragma once
+#include "dac.h"
+
+// Reads target memory through a fixed-size window. The window buffer is
+// allocated once and reused for all the segments walked, so memory footprint
+// does not depend on the size of the heap.
+//
+// Read size adapts to the object density. When the walk continues into the
+// next window, read size is doubled up to the window capacity, 64 KB at least.
+// When the walk jumps beyond the window (i.e. skips a large object payload),
+// only the page containing the next object header is read.
+class SegmentReader final {
+ public:
+  SegmentReader(IDac* dac, size_t capacity)
+      : dac_{dac}, buffer_(capacity) {}
+
+  SegmentReader(const SegmentReader&) = delete;
+  SegmentReader(SegmentReader&&) = delete;
+  SegmentReader& operator=(const SegmentReader&) = delete;
+  SegmentReader& operator=(SegmentReader&&) = delete;
+
+  // Returns pointer to "size" bytes at "addr" or nullptr on error. Window is
+  // refilled starting at "addr" if the range requested is not cached, it never
+  // extends beyond "limit".
+  const BYTE* Fetch(uintptr_t addr, size_t size, uintptr_t limit) {
+    if (first_ <= addr && addr + size <= last_) {
+      return data_ + (addr - first_);
+    }
+    return Read(addr, size, limit);
+  }
+
+  // Number of bytes cached starting at "addr", valid after successful Fetch
+  size_t Available(uintptr_t addr) const {
+    return static_cast<size_t>(last_ - addr);
+  }
+
+  size_t Capacity() const { return buffer_.size(); }
+  // Do not report read errors
+  void SetQuiet(bool quiet) { quiet_ = quiet; }
+  uint64_t BytesRead() const { return bytes_read_; }
+  uint64_t ReadCount() const { return read_count_; }
+
+ private:
+  static auto constexpr kPageSize = 0x1000;
+  // Read size a dense region starts at, i.e. a page read up to the end of
+  // the page might be a few bytes only
+  static auto constexpr kMinDenseReadSize = 0x10000;
+
+  LogLine Report() const { return quiet_ ? Log::Discard() : Log::Error(); }
+
+  const BYTE* Read(uintptr_t addr, size_t size, uintptr_t limit) {
+    // Memory mapped, no need to copy
+    if (auto data = dac_->MapMemory(addr, static_cast<size_t>(limit - addr))) {
+      data_ = data;
+      first_ = addr;
+      last_ = limit;
+      return data_;
+    }
+    if (first_ <= addr && addr <= last_ && first_ != last_) {
+      // Dense objects, read more
+      read_size_ = (std::min)(
+          (std::max)(read_size_ * 2, size_t{kMinDenseReadSize}),
+          buffer_.size());
+    } else {
+      // Payload skipped, read up to the end of the page
+      read_size_ = kPageSize - (addr & (kPageSize - 1));
+      if (read_size_ < size) read_size_ += kPageSize;
+    }
+    auto capacity = (std::min)(
+        (std::max)(read_size_, size),
+        (std::min)(buffer_.size(), static_cast<size_t>(limit - addr)));
+    if (capacity < size) {
+      Report() << "Read of " << size << " bytes at 0x" << std::hex << addr
+               << std::dec << " does not fit the window";
+      return nullptr;
+    }
+    // Memory not mapped anymore (i.e. the segment is freed) is not read
+    capacity = dac_->GetReadableSize(addr, capacity);
+    if (capacity < size) {
+      Report() << "Segment memory at 0x" << std::hex << addr << std::dec
+               << " is not mapped";
+      return nullptr;
+    }
+    first_ = last_ = 0;
+    ReadRequest request{static_cast<CLRDATA_ADDRESS>(addr), &buffer_[0],
+                        static_cast<ULONG32>(capacity)};
+    auto hr = dac_->ReadMemory(&request, 1);
+    auto read = request.read;
+    if (FAILED(hr)) {
+      Report() << "Error reading segment memory at 0x" << std::hex << addr
+               << std::dec << ", code " << hr;
+      return nullptr;
+    }
+    if (read < size) {
+      Report() << "Incomplete segment memory read at 0x" << std::hex << addr
+               << std::dec << ", bytes requested " << capacity << ", read "
+               << read;
+      return nullptr;
+    }
+    ++read_count_;
+    bytes_read_ += read;
+    data_ = &buffer_[0];
+    first_ = addr;
+    last_ = addr + read;
+    return data_;
+  }
+
+  IDac* dac_;
+  std::vector<BYTE> buffer_;
+  const BYTE* data_{};
+  uintptr_t first_{};  // window start address
+  uintptr_t last_{};   // window end address (exclusive)
+  size_t read_size_{};
+  bool quiet_{false};
+  uint64_t bytes_read_{};
+  uint64_t read_count_{};
+};
@@ -0,0 +1,529 @@
+#include "snapshot.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#include "lz4.h"
+#include "statistics.h"
+
+namespace {
+
+auto constexpr kMagic = "GCHSNAP";
+auto constexpr kPageSize = 0x1000;
+
+}  // namespace
+
+bool SnapshotWriter::WriteHeap(IDac* dac, const HeapSnapshot& heap,
+                               size_t buffer_size) {
+  file_.open(path_, std::ios::binary | std::ios::trunc);
+  if (!file_) {
+    Error() << "Error creating " << path_;
+    return false;
+  }
+  // Metadata
+  std::vector<SnapshotSegment> segments;
+  for (size_t i = 0; i < heap.segments.size(); ++i) {
+    for (auto& segment : heap.segments[i]) {
+      SnapshotSegment item{};
+      item.addr = segment.addr;
+      item.heap = static_cast<uint32_t>(segment.heap - &heap.details[0]);
+      item.large = static_cast<uint32_t>(i);
+      item.data = segment.data;
+      item.first = segment.data.mem;
+      item.last =
+          (std::max)(item.first, static_cast<uint64_t>(segment.End()));
+      segments.push_back(item);
+    }
+  }
+  std::vector<SnapshotAllocationContext> allocation_contexts;
+  for (auto& allocation_context : heap.allocation_contexts) {
+    allocation_contexts.push_back(
+        {allocation_context.ptr, allocation_context.limit});
+  }
+  auto start = std::chrono::steady_clock::now();
+  memcpy(header_.magic, kMagic, sizeof(header_.magic));
+  header_.version = kVersion;
+  header_.pointer_size = sizeof(void*);
+  header_.data = heap.data;
+  header_.globals = heap.globals;
+  header_.heap_count = static_cast<uint32_t>(heap.details.size());
+  header_.segment_count = static_cast<uint32_t>(segments.size());
+  header_.allocation_context_count =
+      static_cast<uint32_t>(allocation_contexts.size());
+  uint64_t offset = sizeof(SnapshotHeader) +
+                    sizeof(DacpGcHeapDetails) * heap.details.size() +
+                    sizeof(SnapshotSegment) * segments.size() +
+                    sizeof(SnapshotAllocationContext) *
+                        allocation_contexts.size();
+  for (auto& segment : segments) {
+    if (compress_) {
+      segment.offset = header_.block_count;
+      header_.block_count += static_cast<uint32_t>(
+          (segment.last - segment.first + kBlockSize - 1) / kBlockSize);
+    } else {
+      segment.offset = Align<kPageSize>(offset);
+      offset = segment.offset + (segment.last - segment.first);
+    }
+  }
+  header_.block_size = compress_ ? kBlockSize : 0;
+  Write(&header_, 1);
+  for (auto& details : heap.details) {
+    Write(static_cast<const DacpGcHeapDetails*>(&details), 1);
+  }
+  Write(segments.data(), segments.size());
+  Write(allocation_contexts.data(), allocation_contexts.size());
+  // Memory
+  uint64_t bytes_saved = 0;
+  for (auto& segment : segments) {
+    bytes_saved += segment.last - segment.first;
+  }
+  if (!compress_) {
+    std::vector<BYTE> buffer(buffer_size);
+    for (auto& segment : segments) {
+      Pad(segment.offset);
+      if (!CopyMemory(dac, segment, buffer)) {
+        return false;
+      }
+    }
+  } else if (!CompressMemory(dac, segments)) {
+    return false;
+  }
+  if (compress_) {
+    header_.blocks_offset =
+        Align<sizeof(SnapshotBlock)>(static_cast<uintptr_t>(file_.tellp()));
+    Pad(header_.blocks_offset);
+    Write(blocks_.data(), blocks_.size());
+  }
+  // Header once again, the file is opened for walking before it is complete
+  auto file_size = static_cast<uint64_t>(file_.tellp());
+  file_.seekp(0);
+  Write(&header_, 1);
+  file_.seekp(0, std::ios::end);
+  file_.flush();
+  if (!file_) {
+    Error() << "Error writing " << path_;
+    return false;
+  }
+  auto seconds = std::chrono::duration<double>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+  Debug() << "Saved " << bytes_saved << " bytes of segment memory to "
+          << path_ << " in " << file_size << " bytes, ratio " << std::fixed
+          << std::setprecision(2)
+          << (bytes_saved ? static_cast<double>(file_size) / bytes_saved : 1)
+          << ", " << (seconds ? bytes_saved / seconds / (1 << 20) : 0)
+          << " MB/s";
+  return true;
+}
+
+void SnapshotWriter::Pad(uint64_t offset) {
+  std::vector<char> padding(
+      static_cast<size_t>(offset - static_cast<uint64_t>(file_.tellp())));
+  file_.write(padding.data(), padding.size());
+}
+
+void SnapshotWriter::ReadMemory(IDac* dac, uint64_t addr, BYTE* buffer,
+                                ULONG32 size) {
+  ReadRequest request{static_cast<CLRDATA_ADDRESS>(addr), buffer, size};
+  auto hr = dac->ReadMemory(&request, 1);
+  if (FAILED(hr) || request.read < size) {
+    // Keep file layout, the walker reports the garbage
+    Error() << "Error reading segment memory at 0x" << std::hex << addr
+            << std::dec << ", " << size - request.read
+            << " bytes saved as zeros";
+    memset(buffer + request.read, 0, size - request.read);
+  }
+}
+
+bool SnapshotWriter::CompressMemory(
+    IDac* dac, const std::vector<SnapshotSegment>& segments) {
+  auto count = (std::max)(1u, threads_);
+  auto bound = Lz4CompressBound(kBlockSize);
+  for (auto& batch : batches_) {
+    batch.buffer.resize(count * kBlockSize);
+    batch.output.resize(count * bound);
+    batch.raw_sizes.resize(count);
+    batch.sizes.resize(count);
+  }
+  auto segment = segments.cbegin();
+  auto addr = segment != segments.cend() ? segment->first : 0;
+  Batch* compressing = nullptr;
+  for (auto i = 0;; i ^= 1) {
+    // Read blocks sequentially while the previous ones are compressed, blocks
+    // of a batch may belong to different segments
+    auto& batch = batches_[i];
+    batch.count = 0;
+    while (batch.count < count && segment != segments.cend()) {
+      if (addr == segment->last) {
+        if (++segment != segments.cend()) {
+          addr = segment->first;
+        }
+        continue;
+      }
+      auto& raw_size = batch.raw_sizes[batch.count];
+      raw_size = static_cast<uint32_t>(
+          (std::min)(static_cast<uint64_t>(kBlockSize), segment->last - addr));
+      ReadMemory(dac, addr, &batch.buffer[batch.count * kBlockSize], raw_size);
+      addr += raw_size;
+      ++batch.count;
+    }
+    if (compressing) {
+      WaitCompressed();
+      if (!WriteBlocks(*compressing)) {
+        StopWorkers();
+        return false;
+      }
+    }
+    if (!batch.count) {
+      break;
+    }
+    Compress(batch);
+    compressing = &batch;
+  }
+  StopWorkers();
+  return true;
+}
+
+bool SnapshotWriter::WriteBlocks(const Batch& batch) {
+  // Blocks which do not compress are stored as is
+  auto bound = batch.output.size() / batch.raw_sizes.size();
+  for (size_t i = 0; i < batch.count; ++i) {
+    auto size = batch.sizes[i];
+    auto raw_size = batch.raw_sizes[i];
+    blocks_.push_back({static_cast<uint64_t>(file_.tellp()), size, raw_size});
+    auto data = size < raw_size ? &batch.output[i * bound]
+                                : &batch.buffer[i * kBlockSize];
+    file_.write(reinterpret_cast<const char*>(data), size);
+  }
+  if (!file_) {
+    Error() << "Error writing " << path_;
+    return false;
+  }
+  return true;
+}
+
+void SnapshotWriter::Compress(Batch& batch) {
+  std::lock_guard<std::mutex> lock{mutex_};
+  if (workers_.empty()) {
+    stopping_ = false;
+    for (auto i = (std::max)(1u, threads_); i; --i) {
+      workers_.emplace_back(&SnapshotWriter::RunWorker, this);
+    }
+  }
+  batch_ = &batch;
+  next_ = 0;
+  done_ = 0;
+  queued_.notify_all();
+}
+
+void SnapshotWriter::WaitCompressed() {
+  std::unique_lock<std::mutex> lock{mutex_};
+  compressed_.wait(lock, [this] { return done_ == batch_->count; });
+  batch_ = nullptr;
+}
+
+void SnapshotWriter::StopWorkers() {
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    stopping_ = true;
+  }
+  queued_.notify_all();
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+  workers_.clear();
+}
+
+void SnapshotWriter::RunWorker() {
+  auto bound = Lz4CompressBound(kBlockSize);
+  std::unique_lock<std::mutex> lock{mutex_};
+  for (;;) {
+    queued_.wait(lock, [this] {
+      return stopping_ || (batch_ && next_ < batch_->count);
+    });
+    if (stopping_) {
+      return;
+    }
+    auto& batch = *batch_;
+    auto i = next_++;
+    lock.unlock();
+    auto raw_size = batch.raw_sizes[i];
+    auto size = Lz4Compress(&batch.buffer[i * kBlockSize], raw_size,
+                            &batch.output[i * bound], bound);
+    batch.sizes[i] =
+        size && size < raw_size ? static_cast<uint32_t>(size) : raw_size;
+    lock.lock();
+    if (++done_ == batch.count) {
+      compressed_.notify_one();
+    }
+  }
+}
+
+bool SnapshotWriter::CopyMemory(IDac* dac, const SnapshotSegment& segment,
+                                std::vector<BYTE>& buffer) {
+  for (auto addr = segment.first; addr < segment.last;) {
+    auto size = static_cast<ULONG32>(
+        (std::min)(static_cast<uint64_t>(buffer.size()), segment.last - addr));
+    ReadMemory(dac, addr, &buffer[0], size);
+    file_.write(reinterpret_cast<const char*>(&buffer[0]), size);
+    if (!file_) {
+      Error() << "Error writing " << path_;
+      return false;
+    }
+    addr += size;
+  }
+  return true;
+}
+
+bool SnapshotWriter::WriteMethodTables(MethodTableResolver& resolver,
+                                       TypeNameResolver& names) {
+  std::vector<SnapshotMethodTable> method_tables;
+  std::string text;
+  resolver.ForEach([&](uintptr_t mt, DWORD base_size, DWORD component_size) {
+    auto name = names.Get(mt);
+    method_tables.push_back(
+        {mt, base_size, component_size, text.size(), name.size});
+    text.append(name.data, name.size);
+  });
+  std::sort(method_tables.begin(), method_tables.end(),
+            [](auto& a, auto& b) { return a.mt < b.mt; });
+  file_.seekp(0, std::ios::end);
+  header_.method_table_count = static_cast<uint32_t>(method_tables.size());
+  header_.method_tables_offset = Align<sizeof(SnapshotMethodTable::mt)>(
+      static_cast<uintptr_t>(file_.tellp()));
+  Pad(header_.method_tables_offset);
+  Write(method_tables.data(), method_tables.size());
+  header_.names_offset = static_cast<uint64_t>(file_.tellp());
+  header_.names_size = text.size();
+  file_.write(text.data(), text.size());
+  file_.seekp(0);
+  Write(&header_, 1);
+  file_.close();
+  if (!file_) {
+    Error() << "Error writing " << path_;
+    return false;
+  }
+  return true;
+}
+
+bool Snapshot::IsValid(const SnapshotSegment& segment) const {
+  auto size = segment.last - segment.first;
+  if (!header_->block_size) {
+    return At<BYTE>(segment.offset, size) != nullptr;
+  }
+  auto count = (size + header_->block_size - 1) / header_->block_size;
+  if (header_->block_count < segment.offset ||
+      header_->block_count - segment.offset < count) {
+    return false;
+  }
+  for (uint64_t i = 0; i < count; ++i) {
+    auto& block = blocks_[segment.offset + i];
+    auto raw_size = (std::min)(static_cast<uint64_t>(header_->block_size),
+                               size - i * header_->block_size);
+    if (block.raw_size != raw_size || raw_size < block.size ||
+        !At<BYTE>(block.offset, block.size)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::unique_ptr<Snapshot> Snapshot::Open(const std::string& path) {
+  std::unique_ptr<Snapshot> snapshot{new Snapshot{}};
+  if (!snapshot->Initialize(path)) {
+    return nullptr;
+  }
+  return snapshot;
+}
+
+bool Snapshot::Initialize(const std::string& path) {
+  static std::atomic<uint64_t> last_id{0};
+  id_ = ++last_id;
+  mapping_ = MapFile(path);
+  if (!mapping_) {
+    return false;
+  }
+  header_ = At<SnapshotHeader>(0, 1);
+  if (!header_ || memcmp(header_->magic, kMagic, sizeof(header_->magic))) {
+    Error() << path << " is not a heap snapshot file";
+    return false;
+  }
+  if (header_->version != SnapshotWriter::kVersion ||
+      header_->pointer_size != sizeof(void*)) {
+    Error() << "Heap snapshot version " << header_->version << " ("
+            << header_->pointer_size * 8 << "-bit) is not supported";
+    return false;
+  }
+  uint64_t offset = sizeof(SnapshotHeader);
+  details_ = At<DacpGcHeapDetails>(offset, header_->heap_count);
+  offset += sizeof(DacpGcHeapDetails) * header_->heap_count;
+  segments_ = At<SnapshotSegment>(offset, header_->segment_count);
+  offset += sizeof(SnapshotSegment) * header_->segment_count;
+  allocation_contexts_ = At<SnapshotAllocationContext>(
+      offset, header_->allocation_context_count);
+  method_tables_ = At<SnapshotMethodTable>(header_->method_tables_offset,
+                                           header_->method_table_count);
+  names_ = At<char>(header_->names_offset, header_->names_size);
+  blocks_ = At<SnapshotBlock>(header_->blocks_offset, header_->block_count);
+  if (!details_ || !segments_ || !allocation_contexts_ || !method_tables_ ||
+      !names_ || !blocks_) {
+    Error() << "Heap snapshot " << path << " is truncated";
+    return false;
+  }
+  for (uint32_t i = 0; i < header_->segment_count; ++i) {
+    auto& segment = segments_[i];
+    if (segment.last < segment.first || header_->heap_count <= segment.heap ||
+        !IsValid(segment)) {
+      Error() << "Heap snapshot " << path << " is corrupted";
+      return false;
+    }
+    index_.push_back(&segment);
+  }
+  for (uint32_t i = 0; i < header_->method_table_count; ++i) {
+    auto& method_table = method_tables_[i];
+    if (header_->names_size < method_table.name_offset ||
+        header_->names_size - method_table.name_offset <
+            method_table.name_size) {
+      Error() << "Heap snapshot " << path << " is corrupted";
+      return false;
+    }
+  }
+  std::sort(index_.begin(), index_.end(),
+            [](auto a, auto b) { return a->first < b->first; });
+  return true;
+}
+
+void Snapshot::Read(HeapSnapshot& heap) const {
+  heap.data = header_->data;
+  heap.globals = header_->globals;
+  heap.details.resize(header_->heap_count);
+  for (uint32_t i = 0; i < header_->heap_count; ++i) {
+    static_cast<DacpGcHeapDetails&>(heap.details[i]) = details_[i];
+  }
+  for (uint32_t i = 0; i < header_->segment_count; ++i) {
+    auto& segment = segments_[i];
+    heap.segments[segment.large ? 1 : 0].push_back(
+        {static_cast<uintptr_t>(segment.addr), &heap.details[segment.heap],
+         segment.data});
+  }
+  for (uint32_t i = 0; i < header_->allocation_context_count; ++i) {
+    heap.allocation_contexts.push_back(
+        {static_cast<uintptr_t>(allocation_contexts_[i].ptr),
+         static_cast<uintptr_t>(allocation_contexts_[i].limit)});
+  }
+}
+
+void Snapshot::Read(MethodTableResolver& resolver) const {
+  for (uint32_t i = 0; i < header_->method_table_count; ++i) {
+    auto& method_table = method_tables_[i];
+    resolver.Add(static_cast<uintptr_t>(method_table.mt),
+                 method_table.base_size, method_table.component_size);
+  }
+}
+
+std::string Snapshot::GetName(uintptr_t mt) const {
+  auto first = method_tables_;
+  auto last = method_tables_ + header_->method_table_count;
+  auto it = std::lower_bound(
+      first, last, mt, [](auto& a, uintptr_t mt) { return a.mt < mt; });
+  if (it == last || it->mt != mt) {
+    return {};
+  }
+  return {names_ + it->name_offset, static_cast<size_t>(it->name_size)};
+}
+
+const SnapshotSegment* Snapshot::FindSegment(CLRDATA_ADDRESS address,
+                                             size_t size) const {
+  auto it = std::upper_bound(
+      index_.cbegin(), index_.cend(), static_cast<uint64_t>(address),
+      [](uint64_t address, auto segment) { return address < segment->first; });
+  if (it == index_.cbegin()) {
+    return nullptr;
+  }
+  auto segment = *--it;
+  if (segment->last < address || segment->last - address < size) {
+    return nullptr;
+  }
+  return segment;
+}
+
+HRESULT Snapshot::ReadMemory(ReadRequest* requests, size_t count) {
+  auto hr = S_OK;
+  for (size_t i = 0; i < count; ++i) {
+    auto& request = requests[i];
+    request.read = 0;
+    auto segment = FindSegment(request.address, request.size);
+    if (!segment) {
+      hr = S_FALSE;
+      continue;
+    }
+    if (header_->block_size) {
+      if (!ReadBlocks(*segment, request)) {
+        hr = S_FALSE;
+      }
+      continue;
+    }
+    memcpy(request.buffer,
+           mapping_->GetData() + segment->offset +
+               (request.address - segment->first),
+           request.size);
+    request.read = request.size;
+  }
+  return hr;
+}
+
+const BYTE* Snapshot::MapMemory(CLRDATA_ADDRESS address, size_t size) {
+  auto segment = header_->block_size ? nullptr : FindSegment(address, size);
+  if (!segment) {
+    return nullptr;
+  }
+  return mapping_->GetData() + segment->offset + (address - segment->first);
+}
+
+bool Snapshot::ReadBlocks(const SnapshotSegment& segment,
+                          ReadRequest& request) const {
+  auto offset = request.address - segment.first;
+  while (request.read < request.size) {
+    auto index = segment.offset + offset / header_->block_size;
+    auto skip = static_cast<size_t>(offset % header_->block_size);
+    auto data = GetBlock(index);
+    if (!data) {
+      return false;
+    }
+    auto size = (std::min)(blocks_[index].raw_size - skip,
+                           static_cast<size_t>(request.size - request.read));
+    memcpy(request.buffer + request.read, data + skip, size);
+    request.read += static_cast<ULONG32>(size);
+    offset += size;
+  }
+  return true;
+}
+
+const BYTE* Snapshot::GetBlock(uint64_t index) const {
+  auto& block = blocks_[index];
+  auto data = mapping_->GetData() + block.offset;
+  if (block.size == block.raw_size) {
+    return data;
+  }
+  // Last block decompressed by the thread
+  struct Cache {
+    uint64_t id;
+    uint64_t index;
+    std::vector<BYTE> data;
+  };
+  static thread_local Cache cache{};
+  if (cache.id == id_ && cache.index == index) {
+    return cache.data.data();
+  }
+  cache.id = 0;
+  cache.data.resize(header_->block_size);
+  if (!Lz4Decompress(data, block.size, cache.data.data(), block.raw_size)) {
+    Error() << "Error decompressing heap snapshot block " << index;
+    return nullptr;
+  }
+  cache.id = id_;
+  cache.index = index;
+  return cache.data.data();
+}
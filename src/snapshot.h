@@ -0,0 +1,216 @@
+#pragma once
+#include <array>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <thread>
+
+#include "dac.h"
+#include "mapping.h"
+
+struct HeapSnapshot;
+class MethodTableResolver;
+class TypeNameResolver;
+
+// Snapshot file layout, all offsets are from the beginning of the file:
+//
+//   SnapshotHeader
+//   DacpGcHeapDetails[heap_count]
+//   SnapshotSegment[segment_count]
+//   SnapshotAllocationContext[allocation_context_count]
+//   segment memory, each segment starts at a page boundary
+//   SnapshotBlock[block_count], compressed snapshots only, 8-byte aligned
+//   SnapshotMethodTable[method_table_count], sorted by address, 8-byte
+//   aligned
+//   method table names, UTF-8
+//
+// Segment memory of a compressed snapshot (captured) is split into blocks of
+// block_size bytes, compressed independently in LZ4 block format. Block index
+// lets the reader decompress only the blocks needed, on many threads.
+//
+// Method tables are written once segments are walked, a snapshot without them
+// is incomplete.
+struct SnapshotHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t pointer_size;
+  DacpGcHeapData data;
+  DacpUsefulGlobalsData globals;
+  uint32_t heap_count;
+  uint32_t segment_count;
+  uint32_t allocation_context_count;
+  uint32_t method_table_count;
+  uint32_t block_size;  // zero if not compressed
+  uint32_t block_count;
+  uint64_t blocks_offset;
+  uint64_t method_tables_offset;
+  uint64_t names_offset;
+  uint64_t names_size;
+};
+
+struct SnapshotSegment {
+  uint64_t addr;
+  uint32_t heap;   // index into heap details
+  uint32_t large;  // non-zero for Large Object Heap segments
+  DacpHeapSegmentData data;
+  uint64_t first;  // memory range saved
+  uint64_t last;
+  uint64_t offset;  // or index of the first block if compressed
+};
+
+struct SnapshotBlock {
+  uint64_t offset;
+  uint32_t size;      // stored uncompressed if equal to raw size
+  uint32_t raw_size;  // less than block size for the last block of a segment
+};
+
+struct SnapshotAllocationContext {
+  uint64_t ptr;
+  uint64_t limit;
+};
+
+struct SnapshotMethodTable {
+  uint64_t mt;
+  uint32_t base_size;
+  uint32_t component_size;
+  uint64_t name_offset;  // relative to names
+  uint64_t name_size;
+};
+
+// Writes heap snapshot of the target. Heap metadata and segment memory are
+// copied in one sequential pass, method tables are appended once resolved.
+// Compressed snapshot blocks are compressed on "threads" worker threads,
+// while the next blocks are read from the target.
+class SnapshotWriter final {
+ public:
+  static auto constexpr kVersion = 2;
+  static auto constexpr kBlockSize = 1 << 20;
+
+  SnapshotWriter(const std::string& path, bool compress, unsigned threads)
+      : path_{path}, compress_{compress}, threads_{threads} {}
+  ~SnapshotWriter() { StopWorkers(); }
+
+  SnapshotWriter(const SnapshotWriter&) = delete;
+  SnapshotWriter(SnapshotWriter&&) = delete;
+  SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+  SnapshotWriter& operator=(SnapshotWriter&&) = delete;
+
+  bool WriteHeap(IDac* dac, const HeapSnapshot& heap, size_t buffer_size);
+  bool WriteMethodTables(MethodTableResolver& resolver,
+                         TypeNameResolver& names);
+
+ private:
+  template <typename T>
+  void Write(const T* data, size_t count) {
+    file_.write(reinterpret_cast<const char*>(data), sizeof(T) * count);
+  }
+
+  // Writes zeros up to the offset
+  void Pad(uint64_t offset);
+  // Blocks read from the target and compressed at once
+  struct Batch {
+    std::vector<BYTE> buffer;  // raw blocks, block size apart
+    std::vector<BYTE> output;  // compressed blocks, compress bound apart
+    std::vector<uint32_t> raw_sizes;
+    std::vector<uint32_t> sizes;
+    size_t count;
+  };
+
+  bool CopyMemory(IDac* dac, const SnapshotSegment& segment,
+                  std::vector<BYTE>& buffer);
+  bool CompressMemory(IDac* dac, const std::vector<SnapshotSegment>& segments);
+  bool WriteBlocks(const Batch& batch);
+  // Reads target memory, unreadable bytes are zeroed
+  void ReadMemory(IDac* dac, uint64_t addr, BYTE* buffer, ULONG32 size);
+  // Hands the batch over to the workers, started on the first call
+  void Compress(Batch& batch);
+  // Waits for the workers to compress the batch handed over
+  void WaitCompressed();
+  void StopWorkers();
+  void RunWorker();
+
+  std::string path_;
+  bool compress_;
+  unsigned threads_;
+  std::ofstream file_;
+  SnapshotHeader header_{};
+  std::vector<SnapshotBlock> blocks_;
+  std::array<Batch, 2> batches_{};  // one is read while the other compressed
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;  // guards the members below
+  std::condition_variable queued_;
+  std::condition_variable compressed_;
+  Batch* batch_{};  // being compressed
+  size_t next_{};   // next block of the batch to compress
+  size_t done_{};   // blocks of the batch compressed
+  bool stopping_{false};
+};
+
+// Heap snapshot file mapped into memory. Serves segment memory to the walker
+// without copies unless it is compressed, the DAC interfaces are not
+// available.
+class Snapshot final : public IDac {
+ public:
+  static std::unique_ptr<Snapshot> Open(const std::string& path);
+
+  Snapshot(const Snapshot&) = delete;
+  Snapshot(Snapshot&&) = delete;
+  Snapshot& operator=(const Snapshot&) = delete;
+  Snapshot& operator=(Snapshot&&) = delete;
+
+  // Fills heap metadata in
+  void Read(HeapSnapshot& heap) const;
+  // Adds method tables saved to the resolver
+  void Read(MethodTableResolver& resolver) const;
+  // Returns empty string if the method table is not found
+  std::string GetName(uintptr_t mt) const;
+  bool IsComplete() const { return header_->method_tables_offset != 0; }
+
+  // IDac
+  IXCLRDataTarget3* GetXCLRDataTarget3() override { return nullptr; }
+  ISOSDacInterface* GetSOSDacInterface() override { return nullptr; }
+  HRESULT ReadMemory(ReadRequest* requests, size_t count) override;
+  CacheStatistics GetCacheStatistics() override { return {}; }
+  const BYTE* MapMemory(CLRDATA_ADDRESS address, size_t size) override;
+  size_t GetReadableSize(CLRDATA_ADDRESS, size_t size) override {
+    return size;
+  }
+  void RefreshMemoryMap() override {}
+  void Flush() override {}
+
+ private:
+  Snapshot() = default;
+  bool Initialize(const std::string& path);
+
+  template <typename T>
+  const T* At(uint64_t offset, uint64_t count) const {
+    auto size = mapping_->GetSize();
+    if (size < offset || offset % alignof(T) ||
+        (size - offset) / sizeof(T) < count) {
+      return nullptr;
+    }
+    return reinterpret_cast<const T*>(mapping_->GetData() + offset);
+  }
+
+  // Checks segment memory (or its blocks) is within the file
+  bool IsValid(const SnapshotSegment& segment) const;
+  // Segment containing [address, address + size) range or nullptr
+  const SnapshotSegment* FindSegment(CLRDATA_ADDRESS address,
+                                     size_t size) const;
+  // Reads memory of a compressed segment
+  bool ReadBlocks(const SnapshotSegment& segment, ReadRequest& request) const;
+  // Returns decompressed block data, valid until the next call on the thread
+  const BYTE* GetBlock(uint64_t index) const;
+
+  std::unique_ptr<IFileMapping> mapping_;
+  const SnapshotHeader* header_{};
+  const DacpGcHeapDetails* details_{};
+  const SnapshotSegment* segments_{};
+  const SnapshotAllocationContext* allocation_contexts_{};
+  const SnapshotBlock* blocks_{};
+  const SnapshotMethodTable* method_tables_{};
+  const char* names_{};
+  std::vector<const SnapshotSegment*> index_;  // sorted by address
+  // Tells decompressed blocks of different snapshots apart
+  uint64_t id_{};
+};
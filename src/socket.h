@@ -0,0 +1,42 @@
+#pragma once
+#include <memory>
+#include <string>
+
+// Stream socket connection, closed on destruction. Receive and send time out,
+// so that a stalled peer does not hold the server.
+struct IConnection {
+  virtual ~IConnection() = default;
+  // Returns number of bytes received, zero if the peer closed the connection,
+  // on timeout or error
+  virtual size_t Receive(char* buffer, size_t size) = 0;
+  virtual bool Send(const char* data, size_t size) = 0;
+};
+
+struct IListener {
+  virtual ~IListener() = default;
+  // Blocks until a connection comes, nullptr on error
+  virtual std::unique_ptr<IConnection> Accept() = 0;
+};
+
+// Listens on "port" of the loopback interface, "host:port", or Unix domain
+// socket at "path" (Linux only, stale socket file is replaced, any other file
+// at the path is an error)
+std::unique_ptr<IListener> Listen(const std::string& address);
+
+// Splits TCP address into host and port, false if it is a path
+inline bool SplitHostPort(const std::string& address, std::string& host,
+                          std::string& port) {
+  auto colon = address.rfind(':');
+  port = colon == std::string::npos ? address : address.substr(colon + 1);
+  host = colon == std::string::npos ? "127.0.0.1" : address.substr(0, colon);
+  if (port.empty() ||
+      port.find_first_not_of("0123456789") != std::string::npos ||
+      host.find('/') != std::string::npos) {
+    return false;
+  }
+  // IPv6 address in brackets, i.e. [::1]:9090
+  if (2 <= host.size() && host.front() == '[' && host.back() == ']') {
+    host = host.substr(1, host.size() - 2);
+  }
+  return true;
+}
@@ -1,6 +1,11 @@
 #include "statistics.h"
 
+#include <deque>
 #include <iterator>
+#include <thread>
+#include <unordered_set>
+
+#include "process.h"
 
 int DacpGcHeapDetailsEx::Generation(CLRDATA_ADDRESS address) const {
   auto gen = 0;
@@ -53,7 +58,6 @@ bool HeapSnapshot::Initialize(ISOSDacInterface* dac) {
       return SUCCEEDED(lasterror);
     }
   } else {
-    details.resize(1);
     DacpGcHeapDetailsEx heap{};
     hr = heap.Request(dac);
     if (FAILED(hr)) {
@@ -100,22 +104,22 @@ bool HeapSnapshot::Initialize(ISOSDacInterface* dac) {
   DacpThreadStoreData threadstore_data{};
   hr = threadstore_data.Request(dac);
   if (SUCCEEDED(hr)) {
+    std::unordered_set<CLRDATA_ADDRESS> known;
+    for (auto& allocation_context : allocation_contexts) {
+      known.insert(allocation_context.ptr);
+    }
     DacpThreadData thread_data{};
     for (auto thread = threadstore_data.firstThread; thread;
          thread = thread_data.nextThread) {
       hr = thread_data.Request(dac, thread);
+      ++thread_count;
       if (FAILED(hr)) {
         Error() << "Error getting ThreadData at " << thread << ", code " << hr;
-      } else if (thread_data.allocContextPtr) {
-        auto i = 0u;
-        for (; i < allocation_contexts.size() &&
-               allocation_contexts[i].ptr != thread_data.allocContextPtr;
-             ++i)
-          ;
-        if (i == allocation_contexts.size())
-          allocation_contexts.push_back(
-              {static_cast<uintptr_t>(thread_data.allocContextPtr),
-               static_cast<uintptr_t>(thread_data.allocContextLimit)});
+      } else if (thread_data.allocContextPtr &&
+                 known.insert(thread_data.allocContextPtr).second) {
+        allocation_contexts.push_back(
+            {static_cast<uintptr_t>(thread_data.allocContextPtr),
+             static_cast<uintptr_t>(thread_data.allocContextLimit)});
       }
     }
   }
@@ -135,51 +139,602 @@ bool HeapSnapshot::Initialize(ISOSDacInterface* dac) {
 }
 
 bool HeapStatisticsGenerator::Run(HeapStatistics& statistics) {
-  if (!dac_) {
-    return false;
+  // Totals are summed up into the statistics, whatever the caller passes
+  statistics = HeapStatistics{};
+  if (sampled_) {
+    profile_ = Profile{options_.profile};
+    if (dac_) {
+      names_->Stop();
+      dac_->Flush();
+    }
+    heap_ = HeapSnapshot{};
+    statistics_.Clear();
+    resolver_.ForgetFailures();
+  } else if (!options_.mtcache.empty() && dac_) {
+    mt_cache_ = std::make_unique<MethodTableCache>(
+        dac_.get(), options_.mtcache, options_.pid,
+        GetProcessStartTime(options_.pid));
+    mt_cache_->Load();
+    resolver_.SetCache(mt_cache_.get());
+  }
+  sampled_ = true;
+  if (!options_.load.empty()) {
+    PhaseTimer timer{profile_, Phase::HeapData};
+    snapshot_ = Snapshot::Open(options_.load);
+    if (!snapshot_) {
+      return false;
+    }
+    if (!snapshot_->IsComplete()) {
+      Error() << "Heap snapshot " << options_.load << " is incomplete";
+      return false;
+    }
+    snapshot_->Read(heap_);
+    snapshot_->Read(resolver_);
+  } else {
+    PhaseTimer timer{profile_, Phase::HeapData};
+    if (!dac_ || !heap_.Initialize(dac_->GetSOSDacInterface())) {
+      return false;
+    }
+    profile_[Counter::DacHeapRequests] =
+        heap_.data.bServerMode ? heap_.data.HeapCount : 1;
+    profile_[Counter::DacSegmentRequests] =
+        heap_.segments[0].size() + heap_.segments[1].size();
+    profile_[Counter::DacThreadRequests] = heap_.thread_count;
+    ValidateSegments();
+  }
+  // Save snapshot, then walk the copy of the target memory
+  std::unique_ptr<SnapshotWriter> writer;
+  auto& path = options_.save.empty() ? options_.capture : options_.save;
+  if (!path.empty()) {
+    PhaseTimer timer{profile_, Phase::Save};
+    auto threads = options_.threads ? options_.threads
+                                    : std::thread::hardware_concurrency();
+    writer = std::make_unique<SnapshotWriter>(path, !options_.capture.empty(),
+                                              threads);
+    if (!writer->WriteHeap(dac_.get(), heap_, options_.window_size)) {
+      return false;
+    }
+    snapshot_ = Snapshot::Open(path);
+    if (!snapshot_) {
+      return false;
+    }
   }
   // Generate statistics
-  auto hr = heap_.Initialize(dac_->GetSOSDacInterface());
-  if (FAILED(hr)) {
+  {
+    PhaseTimer timer{profile_, Phase::Walk};
+    WalkSegments();
+  }
+  if (writer) {
+    PhaseTimer timer{profile_, Phase::Save};
+    snapshot_.reset();
+    if (!writer->WriteMethodTables(resolver_, *names_)) {
+      return false;
+    }
+  }
+  // Count totals of all the types, collect rows
+  std::vector<Row> rows;
+  {
+    PhaseTimer timer{profile_, Phase::Sort};
+    rows.reserve(statistics_.size());
+    for (auto& item : statistics_) {
+      for (auto gen = 0; gen <= DAC_NUMBERGENERATIONS; ++gen) {
+        statistics.count[gen] += item.second.count[gen];
+        statistics.size_total[gen] += item.second.size_total[gen];
+      }
+      rows.push_back(&item);
+    }
+    // Select the rows within the limit, then sort only those
+    TypeInformationComparer compare{options_};
+    if (options_.limit < rows.size()) {
+      std::nth_element(rows.begin(), rows.begin() + options_.limit,
+                       rows.end(), compare);
+      rows.resize(options_.limit);
+    }
+    std::sort(rows.begin(), rows.end(), compare);
+  }
+  // Get names, most of them are resolved while segments are walked
+  {
+    PhaseTimer timer{profile_, Phase::Names};
+    statistics.details.reserve(rows.size());
+    for (auto row : rows) {
+      auto mt = row->first;
+      statistics.details.emplace_back(mt, row->second);
+      statistics.details.back().name =
+          dac_ ? names_->Get(mt).str() : snapshot_->GetName(mt);
+    }
+    if (dac_) {
+      names_->Stop();
+    }
+  }
+  if (dac_) {
+    Debug() << "Type names resolved " << names_->BackgroundCount()
+            << " in the background, " << names_->OnDemandCount()
+            << " on demand";
+    auto cache = dac_->GetCacheStatistics();
+    Debug() << "Page cache hits " << cache.hits << ", misses " << cache.misses
+            << ", evictions " << cache.evictions;
+  }
+  if (mt_cache_) {
+    auto misses = mt_cache_->Misses() + mt_cache_->Stale();
+    auto names = names_->BackgroundCount() + names_->OnDemandCount();
+    Debug() << "Method table cache hits " << mt_cache_->Hits() << ", misses "
+            << mt_cache_->Misses() << ", stale " << mt_cache_->Stale()
+            << ", names resolved " << names - mt_cache_names_;
+    if (misses != mt_cache_misses_ || names != mt_cache_names_) {
+      mt_cache_misses_ = misses;
+      mt_cache_names_ = names;
+      mt_cache_->Save(resolver_, *names_);
+    }
+  }
+  // Counters kept since attach are turned into those of the sample
+  if (profile_.enabled) {
+    profile_[Counter::Objects] = statistics.count[DAC_NUMBERGENERATIONS];
+    auto totals = GetTotals();
+    profile_[Phase::MethodTables] =
+        totals[Phase::MethodTables] - totals_[Phase::MethodTables];
+    for (auto counter : {Counter::DacMethodTableRequests,
+                         Counter::DacNameRequests, Counter::PageCacheHits,
+                         Counter::PageCacheMisses,
+                         Counter::MethodTableCacheHits}) {
+      profile_[counter] = totals[counter] - totals_[counter];
+    }
+    totals_ = totals;
+    statistics.profile = profile_;
+  }
+  return true;
+}
+
+namespace {
+
+// Range of a segment walked by a single thread. Segments larger than the
+// chunk size are split, chunks other than the first one start at an unknown
+// object boundary and are walked speculatively.
+struct Task {
+  uintptr_t mem;
+  uintptr_t allocated;
+  DacpGcHeapDetailsEx* heap;
+  int gen;
+  bool large;
+  bool reusable;    // statistics might be reused by the next sample
+  uintptr_t first;  // chunk start
+  uintptr_t stop;   // chunk end
+};
+
+struct TaskResult {
+  uintptr_t start;    // first object walked
+  uintptr_t landing;  // first object beyond the chunk
+  bool valid;
+  GenerationCounters counters;
+};
+
+// Per-thread task queues, a thread takes tasks from the front of its own queue
+// and steals from the back of the others
+class WorkQueue final {
+ public:
+  explicit WorkQueue(size_t count) : queues_(count) {}
+
+  WorkQueue(const WorkQueue&) = delete;
+  WorkQueue(WorkQueue&&) = delete;
+  WorkQueue& operator=(const WorkQueue&) = delete;
+  WorkQueue& operator=(WorkQueue&&) = delete;
+
+  void Push(size_t worker, size_t task) {
+    auto& queue = queues_[worker % queues_.size()];
+    std::lock_guard<std::mutex> lock{queue.mutex};
+    queue.tasks.push_back(task);
+  }
+
+  bool Pop(size_t worker, size_t& task) {
+    {
+      auto& queue = queues_[worker];
+      std::lock_guard<std::mutex> lock{queue.mutex};
+      if (!queue.tasks.empty()) {
+        task = queue.tasks.front();
+        queue.tasks.pop_front();
+        return true;
+      }
+    }
+    for (size_t i = 1; i < queues_.size(); ++i) {
+      auto& queue = queues_[(worker + i) % queues_.size()];
+      std::lock_guard<std::mutex> lock{queue.mutex};
+      if (!queue.tasks.empty()) {
+        task = queue.tasks.back();
+        queue.tasks.pop_back();
+        return true;
+      }
+    }
     return false;
   }
+
+ private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<size_t> tasks;
+  };
+
+  std::vector<Queue> queues_;
+};
+
+// Generation of the object at "addr"
+int Generation(const Task& task, uintptr_t addr) {
+  auto gen = task.gen;
+  for (; gen; --gen) {
+    auto start = static_cast<uintptr_t>(
+        task.heap->generation_table[gen - 1].allocation_start);
+    if (start < task.mem || addr < start) break;
+  }
+  return gen;
+}
+
+template <size_t Alignment>
+void WalkTask(SegmentWalker& walker, const Task& task, TaskResult& result) {
+  if (task.first == task.mem && task.stop == task.allocated) {
+    walker.WalkSegment<Alignment>(task.mem, task.allocated, task.heap,
+                                  task.gen);
+    return;
+  }
+  if (task.first == task.mem) {
+    result.start = task.mem;
+    result.landing = walker.Walk<Alignment>(task.mem, task.stop,
+                                            task.allocated, task.heap, task.gen);
+    result.valid = true;
+    return;
+  }
+  walker.SetSpeculative(true);
+  result.start = task.first;
+  if (walker.FindObject<Alignment>(result.start, task.stop, task.allocated)) {
+    result.landing =
+        walker.Walk<Alignment>(result.start, task.stop, task.allocated,
+                               task.heap, Generation(task, result.start));
+    result.valid = !walker.Failed();
+  }
+  walker.SetSpeculative(false);
+}
+
+// Objects walked are counted into the result
+void WalkTask(SegmentWalker& walker, const Task& task, TaskResult& result) {
+  std::swap(walker.GetCounters(), result.counters);
+  if (task.large)
+    WalkTask<kAlignmentLarge>(walker, task, result);
+  else
+    WalkTask<kAlignment>(walker, task, result);
+  std::swap(walker.GetCounters(), result.counters);
+}
+
+void Merge(MethodTableMap<TypeStatistics>& to,
+           const GenerationCounters& from) {
+  for (auto gen = 0; gen < DAC_NUMBERGENERATIONS; ++gen) {
+    for (auto& item : from[gen]) {
+      auto& stat = to[item.first];
+      stat.count[gen] += item.second.count;
+      stat.count[DAC_NUMBERGENERATIONS] += item.second.count;
+      stat.size_total[gen] += item.second.size_total;
+      stat.size_total[DAC_NUMBERGENERATIONS] += item.second.size_total;
+    }
+  }
+}
+
+void Merge(MethodTableMap<TypeStatistics>& to,
+           const MethodTableMap<TypeStatistics>& from) {
+  for (auto& item : from) {
+    auto& stat = to[item.first];
+    for (auto gen = 0; gen <= DAC_NUMBERGENERATIONS; ++gen) {
+      stat.count[gen] += item.second.count[gen];
+      stat.size_total[gen] += item.second.size_total[gen];
+    }
+  }
+}
+
+// Generation boundaries and background GC state of all the heaps. Every GC
+// changes them: generation starts move as objects are promoted, background GC
+// progress is recorded as it marks and sweeps.
+std::vector<CLRDATA_ADDRESS> GetGcState(const HeapSnapshot& heap) {
+  std::vector<CLRDATA_ADDRESS> state;
+  for (auto& details : heap.details) {
+    for (auto& generation : details.generation_table) {
+      state.push_back(generation.start_segment);
+      state.push_back(generation.allocation_start);
+    }
+    state.insert(state.end(),
+                 {details.ephemeral_heap_segment, details.current_c_gc_state,
+                  details.next_sweep_obj, details.saved_sweep_ephemeral_seg,
+                  details.saved_sweep_ephemeral_start,
+                  details.background_saved_lowest_address,
+                  details.background_saved_highest_address});
+  }
+  return state;
+}
+
+// Hash of evenly spaced stripes of the segment memory, zero if not read.
+// Cheap, but changes of the memory between the stripes go unnoticed.
+uint64_t Fingerprint(IDac* memory, uintptr_t mem, uintptr_t allocated) {
+  auto constexpr kStripeCount = 32;
+  auto constexpr kStripeSize = 64;
+  if (allocated - mem < kStripeSize) {
+    return 0;
+  }
+  uint64_t data[kStripeCount][kStripeSize / sizeof(uint64_t)];
+  ReadRequest requests[kStripeCount];
+  auto step = (allocated - mem - kStripeSize) / (kStripeCount - 1);
+  for (auto i = 0; i < kStripeCount; ++i) {
+    auto addr = (mem + step * i) & ~uintptr_t{sizeof(uint64_t) - 1};
+    requests[i] = {static_cast<CLRDATA_ADDRESS>(addr),
+                   reinterpret_cast<BYTE*>(data[i]), kStripeSize};
+  }
+  if (memory->ReadMemory(requests, kStripeCount) != S_OK) {
+    return 0;
+  }
+  uint64_t hash = 0xCBF29CE484222325ull;
+  for (auto& stripe : data) {
+    for (auto word : stripe) {
+      hash = (hash ^ word) * 0x100000001B3ull;
+    }
+  }
+  return hash | 1;
+}
+
+}  // namespace
+
+// The target runs while segments are listed and walked, the GC might free or
+// shrink a segment meanwhile. Segments not within the readable memory are
+// requested once again along with the memory map, which might be older than
+// the segment. Those still not mapped are clipped to the memory mapped or
+// dropped, so that neither reads nor the walk go beyond.
+void HeapStatisticsGenerator::ValidateSegments() {
+  auto unmapped = [this](const HeapSnapshot::Segment& segment) {
+    auto size = static_cast<size_t>(segment.End() - segment.data.mem);
+    return segment.data.mem < segment.End() &&
+           dac_->GetReadableSize(segment.data.mem, size) < size;
+  };
+  auto mismatched = false;
+  for (auto& segments : heap_.segments) {
+    mismatched = mismatched ||
+                 std::any_of(segments.begin(), segments.end(), unmapped);
+  }
+  if (!mismatched) {
+    return;
+  }
+  dac_->RefreshMemoryMap();
+  std::lock_guard<std::mutex> lock{dac_mutex_};
+  auto sos = dac_->GetSOSDacInterface();
+  for (auto& segments : heap_.segments) {
+    for (auto it = segments.begin(); it != segments.end();) {
+      if (!unmapped(*it)) {
+        ++it;
+        continue;
+      }
+      auto mem = it->data.mem;
+      auto hr = it->data.Request(sos, it->addr, *it->heap);
+      ++profile_[Counter::DacSegmentRequests];
+      auto readable =
+          SUCCEEDED(hr) && it->data.mem == mem
+              ? dac_->GetReadableSize(mem, static_cast<size_t>(it->End() - mem))
+              : 0;
+      if (!readable) {
+        Debug() << "Segment at 0x" << std::hex << it->addr << std::dec
+                << " is not mapped anymore, skipped";
+        it = segments.erase(it);
+        continue;
+      }
+      if (mem + readable < it->End()) {
+        Debug() << "Segment at 0x" << std::hex << it->addr << " is mapped up "
+                << "to 0x" << mem + readable << " of 0x" << it->End()
+                << std::dec << ", the rest is skipped";
+        it->SetEnd(mem + readable);
+      }
+      ++it;
+    }
+  }
+}
+
+void HeapStatisticsGenerator::WalkSegments() {
+  // Snapshot memory is walked if there is one
+  auto memory = snapshot_ ? static_cast<IDac*>(snapshot_.get()) : dac_.get();
+  std::vector<Task> segments;
   for (auto& segment : heap_.segments[0]) {
     auto gen = segment.heap->Generation(segment.data.mem);
-    if (segment.addr == segment.heap->ephemeral_heap_segment)
-      WalkSegment<kAlignment>(segment.data.mem, segment.heap->alloc_allocated,
-                              segment.heap, gen);
-    else
-      WalkSegment<kAlignment>(segment.data.mem, segment.data.allocated,
-                              segment.heap, gen);
+    auto reusable = segment.addr != segment.heap->ephemeral_heap_segment;
+    segments.push_back({static_cast<uintptr_t>(segment.data.mem),
+                        static_cast<uintptr_t>(segment.End()), segment.heap,
+                        gen, false, reusable});
   }
+  // Large objects are allocated in the free space of their segments without
+  // GC, so those segments are always walked
   for (auto& segment : heap_.segments[1]) {
-    WalkSegment<kAlignmentLarge>(segment.data.mem, segment.data.allocated,
-                                 segment.heap, DAC_NUMBERGENERATIONS - 1);
-  }
-  // To array
-  statistics.details.reserve(statistics_.size());
-  std::transform(statistics_.cbegin(), statistics_.cend(),
-                 std::back_inserter(statistics.details), [this](auto& p) {
-                   return TypeInformation{p.first, p.second};
-                 });
-  // Sort and limit
-  if (options_.order == Order::Asc) {
-    std::sort(statistics.details.begin(), statistics.details.end(),
-              TypeInformationComparer<std::less>{options_});
-  } else {
-    std::sort(statistics.details.begin(), statistics.details.end(),
-              TypeInformationComparer<std::greater>{options_});
-  }
-  statistics.details.resize(
-      (std::min)(statistics.details.size(), options_.limit));
-  // Get names, count totals
-  TypeNameProvider nameof{dac_.get()};
-  for (auto& item : statistics.details) {
-    item.name = nameof(item.method_table_address);
-    statistics.count[DAC_NUMBERGENERATIONS] +=
-        item.statistics.count[DAC_NUMBERGENERATIONS];
-    statistics.size_total[DAC_NUMBERGENERATIONS] +=
-        item.statistics.size_total[DAC_NUMBERGENERATIONS];
-  }
-  return S_OK;
+    segments.push_back({static_cast<uintptr_t>(segment.data.mem),
+                        static_cast<uintptr_t>(segment.data.allocated),
+                        segment.heap, DAC_NUMBERGENERATIONS - 1, true, false});
+  }
+  // Segments of the older generations are changed by GCs only, they are not
+  // walked again if there has been no GC since the previous sample. Their
+  // bounds and fingerprint are checked too. Every "full" samples everything
+  // is walked anyway.
+  auto gc_state = GetGcState(heap_);
+  auto gc_quiet = !gc_state_.empty() && gc_state == gc_state_;
+  if (!gc_quiet && !segment_cache_.empty()) {
+    Debug() << "GC has happened since the previous sample, all the segments "
+            << "are walked";
+  }
+  gc_state_ = std::move(gc_state);
+  std::unordered_map<uintptr_t, SegmentCache> segment_cache;
+  std::vector<uint64_t> fingerprints;
+  size_t reused_count = 0;
+  for (auto it = segments.begin(); it != segments.end();) {
+    auto fingerprint =
+        it->reusable && options_.full != 1
+            ? Fingerprint(memory, it->mem, it->allocated)
+            : 0;
+    auto cached = segment_cache_.find(it->mem);
+    if (gc_quiet && fingerprint && cached != segment_cache_.end() &&
+        cached->second.allocated == it->allocated &&
+        cached->second.fingerprint == fingerprint &&
+        (!options_.full || ++cached->second.age < options_.full)) {
+      Merge(statistics_, cached->second.statistics);
+      segment_cache.emplace(it->mem, std::move(cached->second));
+      it = segments.erase(it);
+      ++reused_count;
+    } else {
+      it->reusable = fingerprint != 0;
+      fingerprints.push_back(fingerprint);
+      ++it;
+    }
+  }
+  // Largest segments first, so that threads finish at about the same time
+  std::vector<size_t> order(segments.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(), [&segments](auto a, auto b) {
+    return segments[a].allocated - segments[a].mem >
+           segments[b].allocated - segments[b].mem;
+  });
+  auto thread_count = options_.threads ? options_.threads
+                                       : std::thread::hardware_concurrency();
+  thread_count = (std::max)(1u, thread_count);
+  // Split large segments into chunks. First chunks are walked along with the
+  // segments not split, that resolves most of method tables before speculative
+  // walks start.
+  std::vector<Task> tasks;
+  for (auto i : order) {
+    auto& segment = segments[i];
+    segment.first = segment.mem;
+    segment.stop = segment.allocated;
+    if (1 < thread_count && options_.chunk_size &&
+        segment.mem < segment.allocated &&
+        options_.chunk_size < segment.allocated - segment.mem) {
+      segment.stop = segment.mem + options_.chunk_size;
+    }
+    tasks.push_back(segment);
+  }
+  auto anchored_count = tasks.size();
+  std::vector<size_t> chunks(anchored_count);  // first chunk index
+  for (size_t i = 0; i < anchored_count; ++i) {
+    chunks[i] = tasks.size();
+    auto segment = tasks[i];
+    for (auto first = segment.stop; first < segment.allocated;) {
+      segment.first = first;
+      segment.stop = first + (std::min)(options_.chunk_size,
+                                        static_cast<size_t>(
+                                            segment.allocated - first));
+      first = segment.stop;
+      tasks.push_back(segment);
+    }
+  }
+  chunks.push_back(tasks.size());
+  thread_count = (std::min)(thread_count, static_cast<unsigned>(tasks.size()));
+  thread_count = (std::max)(1u, thread_count);
+  // Walk
+  std::vector<std::unique_ptr<SegmentWalker>> walkers;
+  for (auto i = 0u; i < thread_count; ++i) {
+    walkers.push_back(std::make_unique<SegmentWalker>(
+        memory, heap_, resolver_, options_.window_size));
+  }
+  std::vector<TaskResult> results(tasks.size());
+  WorkQueue queue{thread_count};
+  auto work = [&tasks, &results, &queue, &walkers](size_t worker) {
+    for (size_t i; queue.Pop(worker, i);) {
+      WalkTask(*walkers[worker], tasks[i], results[i]);
+    }
+  };
+  auto run = [&work, thread_count]() {
+    std::vector<std::thread> threads;
+    for (auto i = 1u; i < thread_count; ++i) {
+      threads.emplace_back(work, i);
+    }
+    work(0);
+    for (auto& thread : threads) {
+      thread.join();
+    }
+  };
+  for (size_t i = 0; i < anchored_count; ++i) {
+    queue.Push(i, i);
+  }
+  run();
+  for (auto i = anchored_count; i < tasks.size(); ++i) {
+    queue.Push(i, i);
+  }
+  run();
+  // Stitch chunks, a chunk is accepted if its speculative walk started where
+  // the walk of the previous chunk ended. Otherwise the chunk is walked again
+  // starting from there.
+  size_t rewalk_count = 0;
+  auto& rewalker = *walkers[0];
+  for (size_t i = 0; i < anchored_count; ++i) {
+    // Statistics of the segment
+    SegmentCache cache{tasks[i].allocated, fingerprints[order[i]]};
+    Merge(cache.statistics, results[i].counters);
+    auto landing = results[i].landing;
+    auto rewalked = false;
+    for (auto j = chunks[i]; j < chunks[i + 1]; ++j) {
+      auto& task = tasks[j];
+      auto& result = results[j];
+      if (task.stop <= landing) {
+        // Chunk is covered by an object of the previous one
+        continue;
+      }
+      if (result.valid && result.start == landing) {
+        Merge(cache.statistics, result.counters);
+        landing = result.landing;
+        continue;
+      }
+      ++rewalk_count;
+      rewalked = true;
+      if (task.large)
+        landing = rewalker.Walk<kAlignmentLarge>(
+            landing, task.stop, task.allocated, task.heap,
+            Generation(task, landing));
+      else
+        landing = rewalker.Walk<kAlignment>(landing, task.stop,
+                                            task.allocated, task.heap,
+                                            Generation(task, landing));
+    }
+    if (rewalked) {
+      Merge(cache.statistics, rewalker.GetCounters());
+      rewalker.GetCounters() = GenerationCounters{};
+    }
+    Merge(statistics_, cache.statistics);
+    if (tasks[i].reusable) {
+      segment_cache.emplace(tasks[i].mem, std::move(cache));
+    }
+  }
+  segment_cache_ = std::move(segment_cache);
+  // Totals
+  uint64_t bytes_walked = 0, bytes_skipped = 0, bytes_read = 0,
+           read_count = 0;
+  for (auto& walker : walkers) {
+    bytes_walked += walker->BytesWalked();
+    bytes_skipped += walker->BytesSkipped();
+    bytes_read += walker->GetReader().BytesRead();
+    read_count += walker->GetReader().ReadCount();
+  }
+  Debug() << "Segments walked " << bytes_walked << " bytes, read " << bytes_read
+          << " bytes in " << read_count << " reads by " << thread_count
+          << " thread(s), " << tasks.size() - anchored_count << " chunk(s), "
+          << rewalk_count << " walked again, " << reused_count
+          << " segment(s) not changed since the previous sample";
+  profile_[Counter::BytesWalked] = bytes_walked;
+  profile_[Counter::BytesSkipped] = bytes_skipped;
+  profile_[Counter::BytesRead] = bytes_read;
+  profile_[Counter::ReadCalls] = read_count;
+  profile_[Counter::SegmentsWalked] = anchored_count;
+  profile_[Counter::SegmentsReused] = reused_count;
+  profile_[Counter::Chunks] = tasks.size() - anchored_count;
+  profile_[Counter::ChunksWalkedAgain] = rewalk_count;
+}
+
+Profile HeapStatisticsGenerator::GetTotals() {
+  Profile totals{true};
+  totals[Phase::MethodTables] = resolver_.DacTime();
+  totals[Counter::DacMethodTableRequests] = resolver_.DacRequests();
+  if (dac_) {
+    totals[Counter::DacNameRequests] =
+        names_->BackgroundCount() + names_->OnDemandCount();
+    auto cache = dac_->GetCacheStatistics();
+    totals[Counter::PageCacheHits] = cache.hits;
+    totals[Counter::PageCacheMisses] = cache.misses;
+  }
+  if (mt_cache_) {
+    totals[Counter::MethodTableCacheHits] = mt_cache_->Hits();
+  }
+  return totals;
 }
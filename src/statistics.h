@@ -1,10 +1,19 @@
 #pragma once
 #include <algorithm>
 #include <array>
+#include <condition_variable>
 #include <cstdint>
+#include <mutex>
 #include <unordered_map>
 
 #include "dac.h"
+#include "mtcache.h"
+#include "mtmap.h"
+#include "names.h"
+#include "profile.h"
+#include "reader.h"
+#include "snapshot.h"
+#include "zeros.h"
 
 struct DacpGcHeapDetailsEx : DacpGcHeapDetails {
   int Generation(CLRDATA_ADDRESS address) const;
@@ -18,10 +27,35 @@ struct HeapSnapshot {
     uintptr_t limit;
   };
 
+  using AllocationContextIterator =
+      std::vector<AllocationContext>::const_iterator;
+
+  // Allocation contexts starting in [first, last) range, in address order
+  std::pair<AllocationContextIterator, AllocationContextIterator>
+  AllocationContexts(uintptr_t first, uintptr_t last) const {
+    auto less = [](const AllocationContext& a, uintptr_t addr) {
+      return a.ptr < addr;
+    };
+    auto begin = std::lower_bound(allocation_contexts.cbegin(),
+                                  allocation_contexts.cend(), first, less);
+    return {begin, std::lower_bound(begin, allocation_contexts.cend(), last,
+                                    less)};
+  }
+
   struct Segment {
     uintptr_t addr;
     DacpGcHeapDetailsEx* heap;
     DacpHeapSegmentData data;
+
+    // End of the objects allocated
+    CLRDATA_ADDRESS End() const {
+      return addr == heap->ephemeral_heap_segment ? heap->alloc_allocated
+                                                  : data.allocated;
+    }
+    void SetEnd(CLRDATA_ADDRESS end) {
+      (addr == heap->ephemeral_heap_segment ? heap->alloc_allocated
+                                            : data.allocated) = end;
+    }
   };
 
   DacpGcHeapData data{};
@@ -30,6 +64,7 @@ struct HeapSnapshot {
   std::array<std::vector<Segment>, 2> segments{};  // [0] - small & ephemeral
                                                    // [1] - large
   std::vector<AllocationContext> allocation_contexts{};
+  size_t thread_count{};  // threads listed by the DAC
 };
 
 #ifdef _WIN64
@@ -51,9 +86,20 @@ uintptr_t Align(uintptr_t value) {
 
 static_assert(DAC_NUMBERGENERATIONS == 4, "4 generations expected!");
 
+// Per-type counters of a single generation, updated for every object walked.
+// Kept small so that the walk touches as little memory per object as
+// possible, TypeStatistics are built of them when the walk is over.
+struct TypeCounters {
+  uint32_t base_size;
+  uint32_t component_size;
+  SIZE_T count;
+  SIZE_T size_total;
+};
+
+using GenerationCounters =
+    std::array<MethodTableMap<TypeCounters>, DAC_NUMBERGENERATIONS>;
+
 struct TypeStatistics {
-  size_t base_size;
-  size_t component_size;
   std::array<SIZE_T, DAC_NUMBERGENERATIONS + 1> count;
   std::array<SIZE_T, DAC_NUMBERGENERATIONS + 1> size_total;
 };
@@ -73,27 +119,169 @@ struct HeapStatistics {
   std::array<SIZE_T, DAC_NUMBERGENERATIONS + 1> count;
   std::array<SIZE_T, DAC_NUMBERGENERATIONS + 1> size_total;
   std::vector<TypeInformation> details;
+  Profile profile;  // of the sample, with /profile
 };
 
-class HeapStatisticsGenerator final {
+// Resolves method table data with the help of the DAC. Thread safe, access to
+// the DAC is serialized with the mutex given. Without the DAC (i.e. analyzing
+// a snapshot) only the method tables added beforehand are resolved. Method
+// table cache, if any, is checked before the DAC. Method tables resolved are
+// passed on to the name resolver, if any, so that names are resolved while
+// the walk goes on.
+class MethodTableResolver final {
  public:
-  static bool Run(const Options& options, HeapStatistics& statistics) {
-    return HeapStatisticsGenerator{options}.Run(statistics);
+  MethodTableResolver(IDac* dac, std::mutex& dac_mutex)
+      : dac_{dac}, dac_mutex_{dac_mutex} {}
+
+  MethodTableResolver(const MethodTableResolver&) = delete;
+  MethodTableResolver(MethodTableResolver&&) = delete;
+  MethodTableResolver& operator=(const MethodTableResolver&) = delete;
+  MethodTableResolver& operator=(MethodTableResolver&&) = delete;
+
+  // Method tables seen first are looked up in the method table cache and
+  // requested from the DAC without holding the cache lock, so that lookups of
+  // the others do not wait for the target. Those looking up a method table
+  // being requested wait for the request only. The method table cache reads
+  // the target as well, it is used under the DAC lock.
+  HRESULT Resolve(uintptr_t mt, size_t& base_size, size_t& component_size) {
+    std::unique_lock<std::mutex> lock{mutex_};
+    auto it = cache_.find(mt);
+    if (it == cache_.end()) {
+      Entry entry{S_OK};
+      if (persistent_ || dac_) {
+        entry.pending = true;
+      } else {
+        entry.hr = E_NOTIMPL;
+      }
+      it = cache_.emplace(mt, entry).first;
+      if (entry.pending) {
+        // Entries are not moved by rehashing, nor erased while pending
+        auto& requested = it->second;
+        lock.unlock();
+        DacpMethodTableData mt_data{};
+        auto cached = false;
+        auto named = false;
+        std::string name;
+        if (persistent_) {
+          std::lock_guard<std::mutex> dac_lock{dac_mutex_};
+          cached = persistent_->Find(mt, mt_data.BaseSize,
+                                     mt_data.ComponentSize);
+          named = cached && names_ && persistent_->FindName(mt, name);
+        }
+        auto hr = cached ? S_OK : E_NOTIMPL;
+        std::chrono::steady_clock::duration time{};
+        if (!cached && dac_) {
+          // Reading the clock costs nothing next to a DAC request
+          auto start = std::chrono::steady_clock::now();
+          {
+            std::lock_guard<std::mutex> dac_lock{dac_mutex_};
+            hr = mt_data.Request(dac_->GetSOSDacInterface(), mt);
+          }
+          time = std::chrono::steady_clock::now() - start;
+        }
+        lock.lock();
+        if (!cached && dac_) {
+          ++dac_requests_;
+          dac_time_ += time;
+        }
+        requested = {hr, mt_data.BaseSize, mt_data.ComponentSize};
+        if (named) {
+          names_->Add(mt, name);
+        } else if (names_ && SUCCEEDED(hr)) {
+          names_->Push(mt);
+        }
+        resolved_.notify_all();
+      }
+    }
+    auto& entry = it->second;
+    resolved_.wait(lock, [&entry] { return !entry.pending; });
+    base_size = entry.base_size;
+    component_size = entry.component_size;
+    return entry.hr;
   }
 
- private:
-  explicit HeapStatisticsGenerator(const Options& options)
-      : options_{options}, dac_{CreateDac(options.pid)} {}
-  bool Run(HeapStatistics& statistics);
+  // Same as Resolve but never asks the DAC, false if not resolved yet
+  bool Find(uintptr_t mt, size_t& base_size, size_t& component_size) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    auto it = cache_.find(mt);
+    if (it == cache_.end() || it->second.pending || FAILED(it->second.hr)) {
+      return false;
+    }
+    base_size = it->second.base_size;
+    component_size = it->second.component_size;
+    return true;
+  }
 
-#ifndef _WIN64
-  template <size_t Alignment>
-  void WalkSegment(CLRDATA_ADDRESS mem, CLRDATA_ADDRESS allocated,
-                   DacpGcHeapDetailsEx* heap, int gen) {
-    WalkSegment<Alignment>(static_cast<uintptr_t>(mem),
-                           static_cast<uintptr_t>(allocated), heap, gen);
+  // Requests made to the DAC and the time they took, waits for the DAC
+  // included
+  uint64_t DacRequests() {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return dac_requests_;
+  }
+  std::chrono::steady_clock::duration DacTime() {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return dac_time_;
   }
-#endif
+
+  void SetCache(MethodTableCache* cache) { persistent_ = cache; }
+  void SetNames(TypeNameResolver* names) { names_ = names; }
+
+  void Add(uintptr_t mt, DWORD base_size, DWORD component_size) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    cache_[mt] = {S_OK, base_size, component_size};
+  }
+
+  // Failed lookups are retried next time, i.e. the target has changed since
+  void ForgetFailures() {
+    std::lock_guard<std::mutex> lock{mutex_};
+    for (auto it = cache_.begin(); it != cache_.end();) {
+      it = !it->second.pending && FAILED(it->second.hr) ? cache_.erase(it)
+                                                          : std::next(it);
+    }
+  }
+
+  // Calls "f(mt, base_size, component_size)" for every method table resolved
+  template <typename F>
+  void ForEach(F f) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    for (auto& item : cache_) {
+      if (!item.second.pending && SUCCEEDED(item.second.hr)) {
+        f(item.first, item.second.base_size, item.second.component_size);
+      }
+    }
+  }
+
+ private:
+  struct Entry {
+    HRESULT hr;
+    DWORD base_size;
+    DWORD component_size;
+    bool pending;  // being requested from the DAC
+  };
+
+  IDac* dac_;
+  std::mutex& dac_mutex_;
+  MethodTableCache* persistent_{};
+  TypeNameResolver* names_{};
+  std::mutex mutex_;
+  std::condition_variable resolved_;  // pending entries resolved
+  std::unordered_map<uintptr_t, Entry> cache_;
+  uint64_t dac_requests_{};
+  std::chrono::steady_clock::duration dac_time_{};
+};
+
+// Walks heap segments, accumulates statistics. Each thread walking segments
+// has its own walker.
+class SegmentWalker final {
+ public:
+  SegmentWalker(IDac* dac, const HeapSnapshot& heap,
+                MethodTableResolver& resolver, size_t window_size)
+      : heap_{heap}, resolver_{resolver}, reader_{dac, window_size} {}
+
+  SegmentWalker(const SegmentWalker&) = delete;
+  SegmentWalker(SegmentWalker&&) = delete;
+  SegmentWalker& operator=(const SegmentWalker&) = delete;
+  SegmentWalker& operator=(SegmentWalker&&) = delete;
 
   template <size_t Alignment>
   void WalkSegment(uintptr_t mem, uintptr_t allocated,
@@ -102,71 +290,138 @@ class HeapStatisticsGenerator final {
       Error() << "Invalid segment range encountered";
       return;
     }
-    auto size = static_cast<size_t>(allocated - mem);
-    if (!size) {
+    if (mem == allocated) {
       Error() << "Empty segment encountered";
       return;
     }
-    std::vector<BYTE> buffer(size);
-    ULONG32 read = 0;
-    auto hr = dac_->GetXCLRDataTarget3()->ReadVirtual(
-        static_cast<CLRDATA_ADDRESS>(mem), &buffer[0], static_cast<ULONG>(size),
-        &read);
-    if (FAILED(hr)) {
-      Error() << "Error reading segment memory"
-              << ", code " << hr;
-      return;
-    }
-    if (read != size) {
-      Error() << "Incomplete segment memory read, bytes requested " << size
-              << ", read " << read;
-      return;
-    }
-    auto ptr = &buffer[0], end = &buffer[0] + size;
-    auto allocation_context = std::find_if(
-        heap_.allocation_contexts.cbegin(), heap_.allocation_contexts.cend(),
-        [mem, allocated](auto& a) {
-          return mem <= a.ptr && a.ptr < allocated;
-        });
-    for (; allocation_context != heap_.allocation_contexts.cend();
-         ++allocation_context) {
-      WalkMemory<Alignment>(
-          mem, ptr, (std::min)(allocation_context->ptr, allocated) - mem, heap,
-          gen);
+    Walk<Alignment>(mem, allocated, allocated, heap, gen);
+  }
+
+  // Walks objects starting in [addr, stop) range of the segment ending at
+  // "allocated". Returns the address of the first object at or beyond "stop",
+  // or "allocated" if the rest of the segment can not be walked.
+  template <size_t Alignment>
+  uintptr_t Walk(uintptr_t addr, uintptr_t stop, uintptr_t allocated,
+                 DacpGcHeapDetailsEx* heap, int gen) {
+    bytes_walked_ += (std::min)(stop, allocated) - addr;
+    auto allocation_contexts = heap_.AllocationContexts(addr, allocated);
+    auto allocation_context = allocation_contexts.first;
+    for (;; ++allocation_context) {
+      auto end = allocation_context != allocation_contexts.second
+                     ? allocation_context->ptr
+                     : allocated;
+      if (addr < end && !WalkMemory<Alignment>(addr, end, stop, heap, gen))
+        return allocated;
+      if (addr < end) return addr;
+      if (allocation_context == allocation_contexts.second) return allocated;
       if (allocated < allocation_context->limit) {
         Debug() << "Allocation context limit " << allocation_context->limit
                 << " goes " << allocation_context->limit - allocated
                 << " bytes beyond segment boundary";
-        return;
+        return allocated;
       }
       auto limit =
           allocation_context->limit + Align<kAlignment>(kMinObjectSize);
       if (allocated < limit) {
         Debug() << "Aligned allocation context limit " << limit << " goes "
                 << limit - allocated << " bytes beyond segment boundary";
-        return;
+        return allocated;
+      }
+      // Overlapping allocation contexts never move the walk backwards
+      addr = (std::max)(addr, limit);
+      if (stop <= addr) return addr;
+    }
+  }
+
+  // Speculative walk starts at an address which is not known to be an object
+  // start. Such a walk does not report inconsistencies, it is just marked as
+  // failed then.
+  void SetSpeculative(bool speculative) {
+    speculative_ = speculative;
+    failed_ = false;
+    reader_.SetQuiet(speculative);
+  }
+  bool Failed() const { return failed_; }
+
+  // Looks for an object start in [addr, stop) range, checking that there is a
+  // chain of objects of the known types starting there
+  template <size_t Alignment>
+  bool FindObject(uintptr_t& addr, uintptr_t stop, uintptr_t allocated) {
+    auto constexpr kMaxDistance = 0x100000;
+    auto constexpr kChainLength = 3;
+    stop = (std::min)(stop, addr + kMaxDistance);
+    for (addr = Align<Alignment>(addr); addr < stop; addr += Alignment) {
+      auto next = addr;
+      auto n = 0;
+      for (; n < kChainLength && next < allocated; ++n) {
+        auto size = PeekObject<Alignment>(next, allocated);
+        if (!size) break;
+        next += size;
       }
-      size = allocated - limit;
-      ptr = end - size;
-      mem = limit;
+      if (n == kChainLength || (n && next == allocated)) return true;
     }
-    WalkMemory<Alignment>(mem, ptr, size, heap, gen);
+    return false;
+  }
+
+  GenerationCounters& GetCounters() { return counters_; }
+  const SegmentReader& GetReader() const { return reader_; }
+  uint64_t BytesWalked() const { return bytes_walked_; }
+  // Zero gaps, stray words within them and the rest of the memory where
+  // no object follows a gap
+  uint64_t BytesSkipped() const { return bytes_skipped_; }
+
+ private:
+  // Non-zero words a zero gap might have, the rest of the memory is not
+  // walked if there are more
+  static auto constexpr kMaxStrayWords = 16;
+
+  LogLine Error() {
+    failed_ = true;
+    return speculative_ ? Log::Discard() : Log::Error();
+  }
+
+  // Warnings do not fail the walk
+  LogLine Debug() {
+    return speculative_ ? Log::Discard() : Log::Debug();
   }
 
+  // Walks objects in [addr, end) range, stops at the first object at or
+  // beyond "stop". Returns false if segment memory could not be read.
   template <size_t Alignment>
-  void WalkMemory(uintptr_t addr, PBYTE ptr, size_t size,
+  bool WalkMemory(uintptr_t& addr, uintptr_t end, uintptr_t stop,
                   DacpGcHeapDetails* heap, int& gen) {
-    for (size_t object_size; kMinObjectSize <= size;
-         addr += object_size, ptr += object_size, size -= object_size) {
+    auto size = static_cast<size_t>(end - addr);
+    for (size_t object_size; kMinObjectSize <= size && addr < stop;
+         addr += object_size, size -= object_size) {
       if (gen && addr == heap->generation_table[gen - 1].allocation_start)
         --gen;
+      // Objects larger than the window are not read beyond the header
+      auto ptr = reader_.Fetch(addr, kMinObjectSize, end);
+      if (!ptr) return !(failed_ = true);
       // Get method table address
-      auto mt = *reinterpret_cast<uintptr_t*>(ptr) & ~3;
+      auto mt = *reinterpret_cast<const uintptr_t*>(ptr) & ~3;
       if (!mt) {
-        auto end = ptr + size;
-        for (; ptr < end && *ptr == 0; ++ptr)
-          ;
-        if (ptr == end) {
+        // Zero gap (i.e. unused part of an allocation context), continue with
+        // the object at the first non-zero word. A non-zero word is not taken
+        // for an object unless a chain of objects starts there, stray words
+        // are skipped with the gap.
+        auto zero = addr;
+        auto next = addr;
+        auto found = false;
+        for (auto stray = 0; stray <= kMaxStrayWords; ++stray) {
+          if (!SkipZeros(zero, end)) return !(failed_ = true);
+          if (zero == end) break;
+          next = zero & ~(Alignment - 1);
+          if ((found = IsObjectChain<Alignment>(next, end))) break;
+          zero = (std::min)(next + Alignment, end);
+        }
+        if (found) {
+          object_size = next - addr;
+          bytes_skipped_ += object_size;
+          Debug() << "Skip " << object_size << " zero bytes of gen#" << gen;
+          continue;
+        }
+        if (zero == end) {
           if (!gen)
             Debug() << size
                     << "-byte tail of a gen#0 segment is all filled with zeros";
@@ -174,77 +429,250 @@ class HeapStatisticsGenerator final {
             Error() << size << "-byte tail of a gen#" << gen
                     << " segment is all filled with zeros";
         } else
-          Error() << "Zero method table address encountered, skip " << size
-                  << " bytes of gen#" << gen;
-        return;
+          Error() << "No object found after a zero method table address, skip "
+                  << size << " bytes of gen#" << gen;
+        bytes_skipped_ += size;
+        addr = end;
+        return true;
       }
       // Get method table data
-      auto it = statistics_.find(mt);
-      if (it == statistics_.end()) {
-        DacpMethodTableData mt_data{};
-        auto hr = mt_data.Request(dac_->GetSOSDacInterface(), mt);
+      auto counters = counters_[gen].Find(mt);
+      if (!counters) {
+        TypeCounters data{};
+        auto hr = Resolve(mt, data);
         if (FAILED(hr)) {
           Error() << "Error getting method table data, code " << hr << ", skip "
                   << size << " bytes of gen#" << gen;
-          return;
+          addr = end;
+          return true;
         }
-        TypeStatistics stat{mt_data.BaseSize, mt_data.ComponentSize};
-        it = statistics_.emplace(mt, stat).first;
+        counters = &counters_[gen].Insert(mt, data);
       }
       // Calculate object size
-      auto& stat = it->second;
-      auto component_count = *reinterpret_cast<PDWORD>(ptr + sizeof(uintptr_t));
-      if (mt == heap_.globals.StringMethodTable) {
-        // The component size on a String does not contain the trailing NULL
-        // character, so we must add that ourselves.
-        ++component_count;
-      }
-      object_size = stat.base_size + component_count * stat.component_size;
-#if _WIN64
-      if (object_size < kMinObjectSize) object_size = kMinObjectSize;
-#endif
+      object_size = ObjectSize(mt, ptr, counters->base_size,
+                               counters->component_size);
       // Validate object size
       if (!object_size || size < object_size) {
         Error() << "Object size " << object_size
                 << " is out of valid range, skip " << size << " bytes of gen#"
                 << gen;
-        return;
+        addr = end;
+        return true;
       }
       // Update statistics
-      ++stat.count[gen];
-      ++stat.count[DAC_NUMBERGENERATIONS];
-      stat.size_total[gen] += object_size;
-      stat.size_total[DAC_NUMBERGENERATIONS] += object_size;
+      ++counters->count;
+      counters->size_total += object_size;
       // Align object size
       object_size = Align<Alignment>(object_size);
       if (!object_size || size < object_size) {
         Error() << "Aligned object size " << object_size
                 << " is out of valid range, skip " << size << "bytes of gen#"
                 << gen;
-        return;
+        addr = end;
+        return true;
       }
     }
+    if (stop <= addr && kMinObjectSize <= size) return true;
     if (size) Error() << "Skip " << size << " bytes of gen#" << gen;
+    addr = end;
+    return true;
+  }
+
+  size_t ObjectSize(uintptr_t mt, const BYTE* ptr, size_t base_size,
+                    size_t component_size) const {
+    auto component_count =
+        *reinterpret_cast<const DWORD*>(ptr + sizeof(uintptr_t));
+    if (mt == heap_.globals.StringMethodTable) {
+      // The component size on a String does not contain the trailing NULL
+      // character, so we must add that ourselves.
+      ++component_count;
+    }
+    size_t object_size = base_size + component_count * component_size;
+#if _WIN64
+    if (object_size < kMinObjectSize) object_size = kMinObjectSize;
+#endif
+    return object_size;
+  }
+
+  // Gets method table data from the counters of any generation, asks the
+  // resolver if there are none
+  HRESULT Resolve(uintptr_t mt, TypeCounters& counters) {
+    for (auto& map : counters_) {
+      auto it = map.Find(mt);
+      if (it) {
+        counters.base_size = it->base_size;
+        counters.component_size = it->component_size;
+        return S_OK;
+      }
+    }
+    size_t base_size = 0, component_size = 0;
+    auto hr = speculative_
+                  ? (resolver_.Find(mt, base_size, component_size) ? S_OK
+                                                                    : E_FAIL)
+                  : resolver_.Resolve(mt, base_size, component_size);
+    counters.base_size = static_cast<uint32_t>(base_size);
+    counters.component_size = static_cast<uint32_t>(component_size);
+    return hr;
+  }
+
+  // Checks that objects of the known types start at "addr", followed by the
+  // next ones up to the chain length, a zero gap or "end"
+  template <size_t Alignment>
+  bool IsObjectChain(uintptr_t addr, uintptr_t end) {
+    auto constexpr kChainLength = 3;
+    for (auto n = 0; n < kChainLength; ++n) {
+      auto size = PeekObject<Alignment>(addr, end);
+      if (!size) {
+        if (!n) return false;
+        if (end - addr < kMinObjectSize) return true;
+        auto ptr = reader_.Fetch(addr, sizeof(uintptr_t), end);
+        return ptr && !(*reinterpret_cast<const uintptr_t*>(ptr) & ~3);
+      }
+      addr += size;
+      if (addr == end) return true;
+    }
+    return true;
+  }
+
+  // Returns aligned size of the object of a known type at "addr" or zero
+  template <size_t Alignment>
+  size_t PeekObject(uintptr_t addr, uintptr_t allocated) {
+    if (allocated - addr < kMinObjectSize) return 0;
+    auto ptr = reader_.Fetch(addr, kMinObjectSize, allocated);
+    if (!ptr) return 0;
+    auto mt = *reinterpret_cast<const uintptr_t*>(ptr) & ~3;
+    if (!mt || (mt & (sizeof(uintptr_t) - 1))) return 0;
+    TypeCounters data;
+    if (FAILED(Resolve(mt, data))) return 0;
+    auto size = Align<Alignment>(
+        ObjectSize(mt, ptr, data.base_size, data.component_size));
+    return size <= allocated - addr ? size : 0;
+  }
+
+  // Advances "addr" to the first non-zero byte or to "end" if there is none
+  bool SkipZeros(uintptr_t& addr, uintptr_t end) {
+    while (addr < end) {
+      auto ptr = reader_.Fetch(addr, 1, end);
+      if (!ptr) return false;
+      auto last = ptr + (std::min)(reader_.Available(addr),
+                                   static_cast<size_t>(end - addr));
+      auto it = FindNonZero(ptr, last);
+      addr += it - ptr;
+      if (it != last) break;
+    }
+    return true;
+  }
+
+  const HeapSnapshot& heap_;
+  MethodTableResolver& resolver_;
+  SegmentReader reader_;
+  bool speculative_{false};
+  bool failed_{false};
+  uint64_t bytes_walked_{};
+  uint64_t bytes_skipped_{};
+  GenerationCounters counters_;
+};
+
+class HeapStatisticsGenerator final {
+ public:
+  static bool Run(const Options& options, HeapStatistics& statistics) {
+    return HeapStatisticsGenerator{options}.Run(statistics);
+  }
+
+  explicit HeapStatisticsGenerator(const Options& options)
+      : options_{options},
+        profile_{options.profile},
+        dac_{OpenTarget(options, profile_)},
+        resolver_{dac_.get(), dac_mutex_} {
+    if (dac_) {
+      names_ = std::make_unique<TypeNameResolver>(dac_.get(), dac_mutex_);
+      resolver_.SetNames(names_.get());
+    }
   }
 
-  template <template <class> class C>
+  HeapStatisticsGenerator(const HeapStatisticsGenerator&) = delete;
+  HeapStatisticsGenerator(HeapStatisticsGenerator&&) = delete;
+  HeapStatisticsGenerator& operator=(const HeapStatisticsGenerator&) = delete;
+  HeapStatisticsGenerator& operator=(HeapStatisticsGenerator&&) = delete;
+
+  // Might be called many times to sample a live target. The DAC, method
+  // tables and names resolved are kept, the heap is read anew.
+  bool Run(HeapStatistics& statistics);
+
+ private:
+  // Returns nullptr if the target is a snapshot
+  static std::unique_ptr<IDac> OpenTarget(const Options& options,
+                                          Profile& profile) {
+    PhaseTimer timer{profile, Phase::Attach};
+    if (!options.core.empty()) {
+      return CreateCoreDac(options.core);
+    }
+    return options.load.empty() ? CreateDac(options.pid) : nullptr;
+  }
+  // Clips segments to the memory mapped, see statistics.cpp
+  void ValidateSegments();
+  void WalkSegments();
+  // Counters kept since attach, the profile of a sample has the difference
+  Profile GetTotals();
+
+  using Row = const MethodTableMap<TypeStatistics>::Entry*;
+
+  // Compares by the first sort key, ties are broken by the next keys and then
+  // by method table address, so that rows selected do not depend on the
+  // order types are found in
   struct TypeInformationComparer final {
-    explicit TypeInformationComparer(const Options& options)
-        : ptr{options.orderby == OrderBy::Count ? &TypeStatistics::count
-                                                : &TypeStatistics::size_total},
-          gen{options.orderby_gen} {}
+    explicit TypeInformationComparer(const Options& options) {
+      for (auto& key : options.sort) {
+        keys.push_back({key.orderby == OrderBy::Count
+                            ? &TypeStatistics::count
+                            : &TypeStatistics::size_total,
+                        key.gen, key.order == Order::Asc});
+      }
+    }
 
-    bool operator()(TypeInformation& a, TypeInformation& b) {
-      return cmp((a.statistics.*ptr)[gen], (b.statistics.*ptr)[gen]);
+    bool operator()(Row a, Row b) const {
+      for (auto& key : keys) {
+        auto x = (a->second.*key.ptr)[key.gen];
+        auto y = (b->second.*key.ptr)[key.gen];
+        if (x != y) {
+          return key.asc ? x < y : y < x;
+        }
+      }
+      return a->first < b->first;
     }
 
-    std::array<SIZE_T, DAC_NUMBERGENERATIONS + 1> TypeStatistics::*ptr;
-    int gen;
-    C<SIZE_T> cmp;
+    struct Key {
+      std::array<SIZE_T, DAC_NUMBERGENERATIONS + 1> TypeStatistics::*ptr;
+      int gen;
+      bool asc;
+    };
+
+    std::vector<Key> keys;
   };
 
   const Options& options_;
+  Profile profile_;  // of the current sample
+  Profile totals_;   // as of the last sample
   std::unique_ptr<IDac> dac_;
+  std::mutex dac_mutex_;  // serializes calls to the DAC interfaces
+  MethodTableResolver resolver_;
+  std::unique_ptr<Snapshot> snapshot_;
+  // Statistics of a segment walked, reused by the next sample if there has
+  // been no GC and the segment has not changed
+  struct SegmentCache {
+    uintptr_t allocated;
+    uint64_t fingerprint;
+    unsigned age{};  // number of samples reused by
+    MethodTableMap<TypeStatistics> statistics;
+  };
+
   HeapSnapshot heap_;
-  std::unordered_map<uintptr_t, TypeStatistics> statistics_;
+  MethodTableMap<TypeStatistics> statistics_;
+  std::unordered_map<uintptr_t, SegmentCache> segment_cache_;  // by address
+  std::vector<CLRDATA_ADDRESS> gc_state_;  // as of the previous sample
+  std::unique_ptr<TypeNameResolver> names_;  // nullptr if there is no DAC
+  std::unique_ptr<MethodTableCache> mt_cache_;
+  uint64_t mt_cache_misses_{};  // as of the last save
+  uint64_t mt_cache_names_{};   // names resolved as of the last save
+  bool sampled_{false};  // Run called before
 };
@@ -6,6 +6,8 @@
 
 #include <cinttypes>
 
+#include "cache.h"
+
 class Dac final : public IDac, IXCLRDataTarget3 {
  public:
   bool Initialize(int pid);
@@ -15,6 +17,12 @@ class Dac final : public IDac, IXCLRDataTarget3 {
   // IDac
   IXCLRDataTarget3* GetXCLRDataTarget3() override;
   ISOSDacInterface* GetSOSDacInterface() override;
+  HRESULT ReadMemory(ReadRequest* requests, size_t count) override;
+  CacheStatistics GetCacheStatistics() override;
+  const BYTE* MapMemory(CLRDATA_ADDRESS address, size_t size) override;
+  size_t GetReadableSize(CLRDATA_ADDRESS address, size_t size) override;
+  void RefreshMemoryMap() override;
+  void Flush() override;
   // clang-format off
   // IUnknown
   STDMETHOD(QueryInterface)(REFIID riid, void** ppvObject) override;
@@ -48,7 +56,9 @@ class Dac final : public IDac, IXCLRDataTarget3 {
   CLRDATA_ADDRESS clrbase_{};
   std::wstring dacpath_;
   wil::unique_hmodule dac_;
+  wil::com_ptr<IXCLRDataProcess> xclrdataprocess_;
   wil::com_ptr<ISOSDacInterface> sos_;
+  PageCache cache_{this, PageCache::kDefaultCapacity};
 };
 
 namespace {
@@ -155,16 +165,15 @@ bool Dac::Initialize(int pid) {
     Error() << "CLRDataCreateInstance not found";
     return false;
   }
-  wil::com_ptr<IXCLRDataProcess> xclrdataprocess;
   auto hr = reinterpret_cast<PFN_CLRDataCreateInstance>(pfn)(
       __uuidof(IXCLRDataProcess), this,
-      reinterpret_cast<void**>(&xclrdataprocess));
+      reinterpret_cast<void**>(&xclrdataprocess_));
   if (FAILED(hr)) {
     Error() << "Could not create IXCLRDataProcess instance";
     Error() << ToString(hr);
     return false;
   }
-  hr = xclrdataprocess.try_query_to(&sos_);
+  hr = xclrdataprocess_.try_query_to(&sos_);
   if (FAILED(hr)) {
     Error() << "Could not create ISOSDacInterface instance";
     Error() << ToString(hr);
@@ -176,6 +185,53 @@ bool Dac::Initialize(int pid) {
 
 IXCLRDataTarget3* Dac::GetXCLRDataTarget3() { return this; }
 ISOSDacInterface* Dac::GetSOSDacInterface() { return sos_.get(); }
+CacheStatistics Dac::GetCacheStatistics() { return cache_.GetStatistics(); }
+const BYTE* Dac::MapMemory(CLRDATA_ADDRESS, size_t) { return nullptr; }
+
+// Regions are queried on every call, VirtualQueryEx is cheap compared to the
+// reads validated and there is no map to cache
+size_t Dac::GetReadableSize(CLRDATA_ADDRESS address, size_t size) {
+  auto end = address + size;
+  auto addr = address;
+  while (addr < end) {
+    MEMORY_BASIC_INFORMATION info{};
+    if (!VirtualQueryEx(process_.get(),
+                        reinterpret_cast<LPCVOID>(static_cast<ULONG_PTR>(addr)),
+                        &info, sizeof(info)) ||
+        info.State != MEM_COMMIT ||
+        (info.Protect & (PAGE_NOACCESS | PAGE_GUARD))) {
+      break;
+    }
+    addr = reinterpret_cast<ULONG_PTR>(info.BaseAddress) + info.RegionSize;
+  }
+  return static_cast<size_t>((std::min)(addr, end) - address);
+}
+
+void Dac::RefreshMemoryMap() {}
+
+void Dac::Flush() {
+  cache_.Clear();
+  xclrdataprocess_->Flush();
+}
+
+HRESULT Dac::ReadMemory(ReadRequest* requests, size_t count) {
+  // There is no vectored counterpart of ReadProcessMemory
+  auto hr = S_OK;
+  for (size_t i = 0; i < count; ++i) {
+    auto& request = requests[i];
+    SIZE_T read = 0;
+    if (!ReadProcessMemory(process_.get(), (PVOID)(ULONG_PTR)request.address,
+                           request.buffer, request.size, &read)) {
+      auto lasterror = GetLastError();
+      if (lasterror != ERROR_PARTIAL_COPY && lasterror != ERROR_NOACCESS) {
+        return HRESULT_FROM_WIN32(lasterror);
+      }
+      hr = S_FALSE;
+    }
+    request.read = static_cast<ULONG32>(read);
+  }
+  return hr;
+}
 
 HRESULT Dac::QueryInterface(REFIID riid, void** ppvObject) {
   if (IsEqualIID(riid, __uuidof(ICLRDataTarget)) ||
@@ -217,19 +273,17 @@ HRESULT Dac::GetImageBase(PCWSTR imagePath, CLRDATA_ADDRESS* baseAddress) {
 
 HRESULT Dac::ReadVirtual(CLRDATA_ADDRESS address, BYTE* buffer,
                          ULONG32 bytesRequested, ULONG32* bytesRead) {
-  SIZE_T read = 0;
-  if (!ReadProcessMemory(process_.get(), (PVOID)(ULONG_PTR)address, buffer,
-                         bytesRequested, &read)) {
-    auto hr = HRESULT_FROM_WIN32(GetLastError());
+  auto read = cache_.Read(address, buffer, bytesRequested);
+  if (read == 0 && bytesRequested != 0) {
     auto pagefirst = address & ~(pagesize_ - 1);
     auto pagelast = (address + bytesRequested) & ~(pagesize_ - 1);
     Error() << "Error reading process memory at " << address << " (requested "
-            << bytesRequested << ", read " << read << " bytes)"
+            << bytesRequested << ")"
             << (pagefirst != pagelast ? ", cross-page read" : "");
-    return hr;
+    return E_FAIL;
   }
 
-  *bytesRead = static_cast<ULONG32>(read);
+  *bytesRead = read;
   return S_OK;
 }
 
@@ -301,3 +355,8 @@ std::unique_ptr<IDac> CreateDac(int pid) {
   }
   return dac;
 }
+
+std::unique_ptr<IDac> CreateCoreDac(const std::string& path) {
+  Error() << "ELF core files can be analyzed on Linux only";
+  return nullptr;
+}
@@ -0,0 +1,70 @@
+#include "mapping.h"
+
+class FileMapping final : public IFileMapping {
+ public:
+  FileMapping() = default;
+  ~FileMapping() override = default;
+
+  FileMapping(const FileMapping&) = delete;
+  FileMapping(FileMapping&&) = delete;
+  FileMapping& operator=(const FileMapping&) = delete;
+  FileMapping& operator=(FileMapping&&) = delete;
+
+  bool Initialize(const std::string& path);
+
+ private:
+  // IFileMapping
+  const BYTE* GetData() const override {
+    return static_cast<const BYTE*>(view_.get());
+  }
+  size_t GetSize() const override { return size_; }
+
+  wil::unique_hfile file_;
+  wil::unique_handle mapping_;
+  wil::unique_mapview_ptr<void> view_;
+  size_t size_{};
+};
+
+bool FileMapping::Initialize(const std::string& path) {
+  file_.reset(CreateFileA(path.c_str(), GENERIC_READ,
+                          FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                          OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr));
+  if (!file_) {
+    Error() << "Error opening " << path << ", code "
+            << HRESULT_FROM_WIN32(GetLastError());
+    return false;
+  }
+  LARGE_INTEGER size{};
+  if (!GetFileSizeEx(file_.get(), &size)) {
+    Error() << "Error getting size of " << path << ", code "
+            << HRESULT_FROM_WIN32(GetLastError());
+    return false;
+  }
+  size_ = static_cast<size_t>(size.QuadPart);
+  if (!size_) {
+    Error() << "File " << path << " is empty";
+    return false;
+  }
+  mapping_.reset(
+      CreateFileMappingW(file_.get(), nullptr, PAGE_READONLY, 0, 0, nullptr));
+  if (!mapping_) {
+    Error() << "Error mapping " << path << ", code "
+            << HRESULT_FROM_WIN32(GetLastError());
+    return false;
+  }
+  view_.reset(MapViewOfFile(mapping_.get(), FILE_MAP_READ, 0, 0, 0));
+  if (!view_) {
+    Error() << "Error mapping " << path << ", code "
+            << HRESULT_FROM_WIN32(GetLastError());
+    return false;
+  }
+  return true;
+}
+
+std::unique_ptr<IFileMapping> MapFile(const std::string& path) {
+  auto mapping = std::make_unique<FileMapping>();
+  if (!mapping->Initialize(path)) {
+    return nullptr;
+  }
+  return mapping;
+}
@@ -0,0 +1,69 @@
+#include "process.h"
+
+#include <Psapi.h>
+
+#include <algorithm>
+
+uint64_t GetProcessStartTime(int pid) {
+  wil::unique_handle process{OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION,
+                                         FALSE, static_cast<DWORD>(pid))};
+  FILETIME creation{}, exit{}, kernel{}, user{};
+  if (!process ||
+      !GetProcessTimes(process.get(), &creation, &exit, &kernel, &user)) {
+    return 0;
+  }
+  return (static_cast<uint64_t>(creation.dwHighDateTime) << 32) |
+         creation.dwLowDateTime;
+}
+
+std::vector<int> FindDotNetProcesses() {
+  std::vector<DWORD> ids(1024);
+  DWORD size = 0;
+  for (;;) {
+    auto capacity = static_cast<DWORD>(ids.size() * sizeof(DWORD));
+    if (!EnumProcesses(&ids[0], capacity, &size)) {
+      Error() << "Could not list processes, error " << GetLastError();
+      return {};
+    }
+    // Buffer is full, there might be more processes
+    if (size < capacity) {
+      break;
+    }
+    ids.resize(ids.size() * 2);
+  }
+  ids.resize(size / sizeof(DWORD));
+  std::vector<int> pids;
+  std::vector<HMODULE> modules(512);
+  wchar_t name[MAX_PATH];
+  for (auto id : ids) {
+    if (id == 0 || id == GetCurrentProcessId()) {
+      continue;
+    }
+    wil::unique_handle process{OpenProcess(
+        PROCESS_QUERY_LIMITED_INFORMATION | PROCESS_VM_READ, FALSE, id)};
+    DWORD needed = 0;
+    for (;;) {
+      auto capacity = static_cast<DWORD>(modules.size() * sizeof(HMODULE));
+      if (!process || !EnumProcessModulesEx(process.get(), &modules[0],
+                                            capacity, &needed,
+                                            LIST_MODULES_ALL)) {
+        needed = 0;
+        break;
+      }
+      if (needed <= capacity) {
+        break;
+      }
+      modules.resize(needed / sizeof(HMODULE));
+    }
+    for (DWORD i = 0; i < needed / sizeof(HMODULE); ++i) {
+      if (GetModuleBaseNameW(process.get(), modules[i], name,
+                             ARRAYSIZE(name)) &&
+          (!_wcsicmp(name, L"coreclr.dll") || !_wcsicmp(name, L"clr.dll"))) {
+        pids.push_back(static_cast<int>(id));
+        break;
+      }
+    }
+  }
+  std::sort(pids.begin(), pids.end());
+  return pids;
+}
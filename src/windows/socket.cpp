@@ -0,0 +1,118 @@
+#include "socket.h"
+
+#include <winsock2.h>
+#include <ws2tcpip.h>
+
+namespace {
+
+auto constexpr kTimeoutMilliseconds = 5000;
+auto constexpr kBacklog = 16;
+
+class Connection final : public IConnection {
+ public:
+  explicit Connection(SOCKET socket) : socket_{socket} {}
+  ~Connection() override { closesocket(socket_); }
+
+  Connection(const Connection&) = delete;
+  Connection(Connection&&) = delete;
+  Connection& operator=(const Connection&) = delete;
+  Connection& operator=(Connection&&) = delete;
+
+  size_t Receive(char* buffer, size_t size) override {
+    auto res = recv(socket_, buffer, static_cast<int>(size), 0);
+    return res < 0 ? 0 : static_cast<size_t>(res);
+  }
+
+  bool Send(const char* data, size_t size) override {
+    while (size) {
+      auto res = send(socket_, data, static_cast<int>(size), 0);
+      if (res <= 0) {
+        return false;
+      }
+      data += res;
+      size -= static_cast<size_t>(res);
+    }
+    return true;
+  }
+
+ private:
+  SOCKET socket_;
+};
+
+class Listener final : public IListener {
+ public:
+  explicit Listener(SOCKET socket) : socket_{socket} {}
+  ~Listener() override {
+    closesocket(socket_);
+    WSACleanup();
+  }
+
+  Listener(const Listener&) = delete;
+  Listener(Listener&&) = delete;
+  Listener& operator=(const Listener&) = delete;
+  Listener& operator=(Listener&&) = delete;
+
+  std::unique_ptr<IConnection> Accept() override {
+    auto socket = accept(socket_, nullptr, nullptr);
+    if (socket == INVALID_SOCKET) {
+      Error() << "Error accepting connection, error " << WSAGetLastError();
+      return nullptr;
+    }
+    DWORD timeout = kTimeoutMilliseconds;
+    setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO,
+               reinterpret_cast<const char*>(&timeout), sizeof(timeout));
+    setsockopt(socket, SOL_SOCKET, SO_SNDTIMEO,
+               reinterpret_cast<const char*>(&timeout), sizeof(timeout));
+    return std::make_unique<Connection>(socket);
+  }
+
+ private:
+  SOCKET socket_;
+};
+
+}  // namespace
+
+std::unique_ptr<IListener> Listen(const std::string& address) {
+  std::string host, port;
+  if (!SplitHostPort(address, host, port)) {
+    Error() << "Unix domain sockets are not supported, specify port";
+    return nullptr;
+  }
+  WSADATA data{};
+  auto res = WSAStartup(MAKEWORD(2, 2), &data);
+  if (res != 0) {
+    Error() << "Error initializing Winsock, error " << res;
+    return nullptr;
+  }
+  addrinfo hints{};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE | AI_NUMERICSERV;
+  addrinfo* info = nullptr;
+  res = getaddrinfo(host.c_str(), port.c_str(), &hints, &info);
+  if (res != 0) {
+    Error() << "Could not resolve " << host << ", error " << res;
+    WSACleanup();
+    return nullptr;
+  }
+  auto socket = INVALID_SOCKET;
+  for (auto it = info; it && socket == INVALID_SOCKET; it = it->ai_next) {
+    socket = ::socket(it->ai_family, it->ai_socktype, it->ai_protocol);
+    if (socket == INVALID_SOCKET) {
+      continue;
+    }
+    if (bind(socket, it->ai_addr, static_cast<int>(it->ai_addrlen)) != 0 ||
+        listen(socket, kBacklog) != 0) {
+      Error() << "Could not listen on " << host << ":" << port << ", error "
+              << WSAGetLastError();
+      closesocket(socket);
+      socket = INVALID_SOCKET;
+    }
+  }
+  freeaddrinfo(info);
+  if (socket == INVALID_SOCKET) {
+    WSACleanup();
+    return nullptr;
+  }
+  return std::make_unique<Listener>(socket);
+}
@@ -0,0 +1,88 @@
+#include "zeros.h"
+
+#include <immintrin.h>
+
+namespace {
+
+unsigned CountTrailingZeros(unsigned value) {
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward(&index, value);
+  return index;
+#else
+  return __builtin_ctz(value);
+#endif
+}
+
+}  // namespace
+
+const BYTE* FindNonZeroScalar(const BYTE* first, const BYTE* last) {
+  for (; first != last && !*first; ++first)
+    ;
+  return first;
+}
+
+const BYTE* FindNonZeroSse2(const BYTE* first, const BYTE* last) {
+  auto zero = _mm_setzero_si128();
+  for (; 64 <= last - first; first += 64) {
+    auto p = reinterpret_cast<const __m128i*>(first);
+    auto v = _mm_or_si128(
+        _mm_or_si128(_mm_loadu_si128(p), _mm_loadu_si128(p + 1)),
+        _mm_or_si128(_mm_loadu_si128(p + 2), _mm_loadu_si128(p + 3)));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)) != 0xFFFF) break;
+  }
+  for (; 16 <= last - first; first += 16) {
+    auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first));
+    unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, zero));
+    if (mask != 0xFFFF) return first + CountTrailingZeros(~mask);
+  }
+  return FindNonZeroScalar(first, last);
+}
+
+#ifndef _MSC_VER
+__attribute__((target("avx2")))
+#endif
+const BYTE* FindNonZeroAvx2(const BYTE* first, const BYTE* last) {
+  auto zero = _mm256_setzero_si256();
+  for (; 128 <= last - first; first += 128) {
+    auto p = reinterpret_cast<const __m256i*>(first);
+    auto v = _mm256_or_si256(
+        _mm256_or_si256(_mm256_loadu_si256(p), _mm256_loadu_si256(p + 1)),
+        _mm256_or_si256(_mm256_loadu_si256(p + 2), _mm256_loadu_si256(p + 3)));
+    if (!_mm256_testz_si256(v, v)) break;
+  }
+  for (; 32 <= last - first; first += 32) {
+    auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(first));
+    if (!_mm256_testz_si256(v, v)) {
+      unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, zero));
+      return first + CountTrailingZeros(~mask);
+    }
+  }
+  return FindNonZeroSse2(first, last);
+}
+
+bool IsAvx2Supported() {
+#ifdef _MSC_VER
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7) return false;
+  // AVX registers must be enabled by the OS
+  __cpuid(info, 1);
+  auto constexpr kOsXsave = 1 << 27;
+  auto constexpr kAvx = 1 << 28;
+  if ((info[2] & (kOsXsave | kAvx)) != (kOsXsave | kAvx) ||
+      (_xgetbv(0) & 6) != 6)
+    return false;
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+#else
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+#endif
+}
+
+const BYTE* FindNonZero(const BYTE* first, const BYTE* last) {
+  static const auto find =
+      IsAvx2Supported() ? FindNonZeroAvx2 : FindNonZeroSse2;
+  return find(first, last);
+}
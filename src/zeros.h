@@ -0,0 +1,13 @@
+#pragma once
+
+// Returns pointer to the first non-zero byte in [first, last) range or "last"
+// if all the bytes are zero. Uses AVX2 if the processor supports it, SSE2
+// otherwise.
+const BYTE* FindNonZero(const BYTE* first, const BYTE* last);
+
+// Implementations FindNonZero dispatches to, exposed to tests and benchmarks.
+// FindNonZeroAvx2 must not be called unless AVX2 is supported.
+const BYTE* FindNonZeroScalar(const BYTE* first, const BYTE* last);
+const BYTE* FindNonZeroSse2(const BYTE* first, const BYTE* last);
+const BYTE* FindNonZeroAvx2(const BYTE* first, const BYTE* last);
+bool IsAvx2Supported();
@@ -0,0 +1,223 @@
+// Allocation contexts of 10k threads: HeapSnapshot must collect them from the
+// thread list of the DAC once each, in address order, lookup by address range
+// must find what a linear scan finds, and the walk must skip the contexts
+// exactly, i.e. count the objects next to them and none of the garbage within.
+#include <algorithm>
+#include <random>
+
+#include "fake_dac.h"
+#include "statistics.h"
+#include "test.h"
+
+namespace {
+
+using AllocationContext = HeapSnapshot::AllocationContext;
+
+auto constexpr kThreadCount = 10000;
+auto constexpr kHeap = CLRDATA_ADDRESS{0x1000};
+auto constexpr kSegment = CLRDATA_ADDRESS{0x2000};
+auto constexpr kSegmentStart = uintptr_t{0x10000000};
+auto constexpr kMethodTable = uintptr_t{0x7f0000001000};
+auto constexpr kArrayMethodTable = uintptr_t{0x7f0000002000};
+// Free object the GC puts beyond an allocation context limit
+const auto kGap = Align<kAlignment>(kMinObjectSize);
+
+// Segment of objects with allocation contexts of all the threads in between
+struct Segment {
+  std::vector<BYTE> data;
+  std::vector<AllocationContext> contexts;
+  size_t objects{};  // outside of the contexts
+  size_t arrays{};
+
+  uintptr_t End() const { return kSegmentStart + data.size(); }
+
+  void AddObject(bool array, uint32_t length) {
+    auto offset = data.size();
+    auto size = array ? Align<kAlignment>(24 + length * 8) : size_t{24};
+    data.resize(offset + size);
+    auto mt = array ? kArrayMethodTable : kMethodTable;
+    memcpy(&data[offset], &mt, sizeof(mt));
+    memcpy(&data[offset + sizeof(mt)], &length, sizeof(length));
+    ++(array ? arrays : objects);
+  }
+
+  // Context is filled with garbage, walking into it fails the test
+  void AddContext(size_t size) {
+    auto ptr = End();
+    data.resize(data.size() + size + kGap, 0xCD);
+    contexts.push_back({ptr, ptr + size});
+  }
+};
+
+Segment GenerateSegment() {
+  std::mt19937_64 random{42};
+  Segment segment;
+  // Object exactly at the start of the segment is within a context
+  segment.AddContext(256);
+  for (auto i = 1; i < kThreadCount; ++i) {
+    switch (random() % 4) {
+      case 0:
+        // Adjacent context, the next one starts right after the free object
+        break;
+      case 1:
+        // Single object right at the limit of the previous context
+        segment.AddObject(false, 0);
+        break;
+      default:
+        for (auto n = random() % 8 + 1; n; --n) {
+          segment.AddObject(random() % 2 == 0, random() % 100);
+        }
+    }
+    segment.AddContext(random() % 2 ? 8192 : 0);
+  }
+  // Last context ends where the segment does
+  return segment;
+}
+
+// Thread list of the DAC has a thread for each context in random order, and
+// more threads sharing them, threads with no context and one with an invalid
+// context. Context of the heap is listed by a thread as well.
+HeapSnapshot Initialize(const Segment& segment) {
+  FakeDac dac;
+  auto& sos = dac.Sos();
+  sos.heap_data.HeapCount = 1;
+  sos.heap_data.g_max_generation = 2;
+  sos.heap_data.bGcStructuresValid = TRUE;
+  auto& heap_context = segment.contexts[kThreadCount / 2];
+  auto& details = sos.heaps[kHeap];
+  details.heapAddr = kHeap;
+  details.alloc_allocated = segment.End();
+  details.ephemeral_heap_segment = kSegment;
+  details.generation_table[2].start_segment = kSegment;
+  details.generation_table[0].allocContextPtr = heap_context.ptr;
+  details.generation_table[0].allocContextLimit = heap_context.limit;
+  auto& data = sos.segments[kSegment];
+  data.segmentAddr = kSegment;
+  data.mem = kSegmentStart;
+  data.allocated = segment.End();
+
+  std::mt19937_64 random{7};
+  std::vector<const AllocationContext*> threads;
+  for (auto& context : segment.contexts) {
+    threads.push_back(&context);
+  }
+  for (auto i = 0; i < kThreadCount / 10; ++i) {
+    threads.push_back(&segment.contexts[random() % kThreadCount]);
+    threads.push_back(nullptr);
+  }
+  std::shuffle(threads.begin(), threads.end(), random);
+  for (auto context : threads) {
+    sos.AddThread(context ? context->ptr : 0, context ? context->limit : 0);
+  }
+  sos.AddThread(segment.End() + 0x1000, segment.End());
+
+  HeapSnapshot heap{};
+  auto errors = Log::ErrorCount.load();
+  CHECK(heap.Initialize(&sos));
+  CHECK_EQ(Log::ErrorCount.load() - errors, 1);
+  CHECK_EQ(heap.thread_count, threads.size() + 1);
+  CHECK_EQ(heap.details.size(), size_t{1});
+  CHECK_EQ(heap.segments[0].size(), size_t{1});
+  CHECK(heap.segments[1].empty());
+  auto& contexts = heap.allocation_contexts;
+  CHECK_EQ(contexts.size(), size_t{kThreadCount});
+  if (contexts.size() == kThreadCount) {
+    for (size_t i = 0; i < contexts.size(); ++i) {
+      if (contexts[i].ptr != segment.contexts[i].ptr ||
+          contexts[i].limit != segment.contexts[i].limit) {
+        ++Failures();
+        std::cerr << "Allocation context " << i << " differs\n";
+        break;
+      }
+    }
+  }
+  return heap;
+}
+
+// Allocation contexts starting in [first, last) the way the walk found them
+// before lookup by binary search, empty range if there are none
+std::pair<size_t, size_t> LinearScan(
+    const std::vector<AllocationContext>& contexts, uintptr_t first,
+    uintptr_t last) {
+  auto begin = std::find_if(contexts.begin(), contexts.end(),
+                            [first, last](const AllocationContext& context) {
+                              return first <= context.ptr &&
+                                     context.ptr < last;
+                            });
+  auto end = std::find_if(begin, contexts.end(),
+                          [last](const AllocationContext& context) {
+                            return last <= context.ptr;
+                          });
+  if (begin == end) {
+    return {0, 0};
+  }
+  return {static_cast<size_t>(begin - contexts.begin()),
+          static_cast<size_t>(end - contexts.begin())};
+}
+
+void TestLookup(const HeapSnapshot& heap) {
+  auto& contexts = heap.allocation_contexts;
+  std::mt19937_64 random{7};
+  // Linear scan is slow, contexts at the ends of the list and a sample of
+  // those between are looked up
+  for (size_t i = 0; i < contexts.size();
+       i += i < 16 || contexts.size() < i + 32 ? 1 : 101) {
+    auto& context = contexts[i];
+    for (auto first : {context.ptr - 1, context.ptr, context.ptr + 1,
+                       context.limit, context.limit + kGap}) {
+      for (auto last : {first, first + 1, context.limit + kGap,
+                        first + random() % 0x100000, uintptr_t{~0ull}}) {
+        auto expected = LinearScan(contexts, first, last);
+        auto found = heap.AllocationContexts(first, last);
+        auto begin = static_cast<size_t>(found.first - contexts.cbegin());
+        auto end = static_cast<size_t>(found.second - contexts.cbegin());
+        if (begin == end) {
+          begin = end = 0;
+        }
+        if (begin != expected.first || end != expected.second) {
+          ++Failures();
+          std::cerr << "Contexts in [0x" << std::hex << first << ", 0x" << last
+                    << std::dec << ") are [" << begin << ", " << end
+                    << "), expected [" << expected.first << ", "
+                    << expected.second << ")\n";
+          return;
+        }
+      }
+    }
+  }
+}
+
+void TestWalk(const HeapSnapshot& heap, const Segment& segment,
+              size_t window_size) {
+  FakeDac dac;
+  dac.AddRegion(kSegmentStart, segment.data.size()) = segment.data;
+  std::mutex dac_mutex;
+  MethodTableResolver resolver{nullptr, dac_mutex};
+  resolver.Add(kMethodTable, 24, 0);
+  resolver.Add(kArrayMethodTable, 24, 8);
+  SegmentWalker walker{&dac, heap, resolver, window_size};
+  DacpGcHeapDetailsEx details{};
+  auto errors = Log::ErrorCount.load();
+  walker.WalkSegment<kAlignment>(kSegmentStart, segment.End(), &details, 2);
+  CHECK_EQ(Log::ErrorCount.load(), errors);
+  auto& counters = walker.GetCounters()[2];
+  auto objects = counters.Find(kMethodTable);
+  auto arrays = counters.Find(kArrayMethodTable);
+  CHECK(objects && arrays && counters.size() == 2);
+  if (objects && arrays) {
+    CHECK_EQ(objects->count, segment.objects);
+    CHECK_EQ(arrays->count, segment.arrays);
+  }
+}
+
+}  // namespace
+
+int main() {
+  auto segment = GenerateSegment();
+  auto heap = Initialize(segment);
+  TestLookup(heap);
+  for (auto window_size : {size_t{4096}, size_t{1} << 20}) {
+    TestWalk(heap, segment, window_size);
+  }
+  return TestResult();
+}
@@ -0,0 +1,237 @@
+// Binary output (/format:binary) read back by BinaryReader must give what was
+// written, and records truncated or with a corrupt header must be rejected
+// without reading beyond the data, or allocating for them when read from a
+// stream.
+#include <sstream>
+
+#include "format.h"
+#include "test.h"
+
+namespace {
+
+auto constexpr kTime = std::chrono::milliseconds{1700000000123};
+auto constexpr kPid = 4242;
+
+HeapStatistics GenerateStatistics() {
+  HeapStatistics statistics{};
+  const char* names[] = {"System.String", "System.Byte[]", "",
+                         "System.Collections.Generic.Dictionary`2[[System."
+                         "String],[System.Object]]"};
+  uintptr_t mt = 0x7f0000001000;
+  for (auto name : names) {
+    TypeStatistics type{};
+    for (auto gen = 0; gen < DAC_NUMBERGENERATIONS; ++gen) {
+      type.count[gen] = mt % 7 + gen;
+      type.size_total[gen] = type.count[gen] * 24;
+      type.count[DAC_NUMBERGENERATIONS] += type.count[gen];
+      type.size_total[DAC_NUMBERGENERATIONS] += type.size_total[gen];
+    }
+    for (auto gen = 0; gen <= DAC_NUMBERGENERATIONS; ++gen) {
+      statistics.count[gen] += type.count[gen];
+      statistics.size_total[gen] += type.size_total[gen];
+    }
+    statistics.details.emplace_back(mt, type);
+    statistics.details.back().name = name;
+    mt += 0x1000;
+  }
+  return statistics;
+}
+
+std::string Write(const HeapStatistics& statistics, int pid) {
+  Options options;
+  options.format = OutputFormat::Binary;
+  std::ostringstream out;
+  out << Format{statistics, options,
+                std::chrono::system_clock::time_point{kTime}, pid};
+  return out.str();
+}
+
+void CheckRecord(const BinaryReader& reader, const HeapStatistics& statistics,
+                 int pid) {
+  auto& header = reader.Header();
+  CHECK_EQ(header.version, kBinaryVersion);
+  CHECK_EQ(header.time, static_cast<uint64_t>(kTime.count()));
+  CHECK_EQ(header.pid, static_cast<uint32_t>(pid));
+  CHECK_EQ(header.row_count, statistics.details.size());
+  for (auto gen = 0; gen < kBinaryGenerations; ++gen) {
+    CHECK_EQ(header.count[gen], statistics.count[gen]);
+    CHECK_EQ(header.size_total[gen], statistics.size_total[gen]);
+  }
+  for (uint32_t i = 0; i < header.row_count && i < statistics.details.size();
+       ++i) {
+    auto& item = statistics.details[i];
+    auto row = reader.Row(i);
+    CHECK_EQ(row.mt, item.method_table_address);
+    for (auto gen = 0; gen < kBinaryGenerations; ++gen) {
+      CHECK_EQ(row.count[gen], item.statistics.count[gen]);
+      CHECK_EQ(row.size_total[gen], item.statistics.size_total[gen]);
+    }
+    CHECK_EQ(reader.Name(row), item.name);
+  }
+}
+
+// Several records, as the monitor and fleet modes write them
+void TestRoundTrip() {
+  auto statistics = GenerateStatistics();
+  HeapStatistics empty{};
+  auto data = Write(statistics, 0) + Write(empty, kPid) + Write(statistics, 1);
+  BinaryReader reader{data.data(), data.size()};
+  CHECK(reader.Next());
+  CheckRecord(reader, statistics, 0);
+  CHECK(reader.Next());
+  CheckRecord(reader, empty, kPid);
+  CHECK(reader.Next());
+  CheckRecord(reader, statistics, 1);
+  CHECK(!reader.Next());
+
+  // Read from a stream record by record
+  std::istringstream in{data};
+  std::vector<char> buffer;
+  auto records = 0;
+  while (BinaryReader::ReadRecord(in, buffer)) {
+    ++records;
+  }
+  CHECK_EQ(records, 3);
+  CHECK_EQ(buffer.size(), data.size());
+  CHECK(std::equal(buffer.begin(), buffer.end(), data.begin()));
+}
+
+// Every prefix of a record is rejected, a copy of its own makes ASan catch
+// reads beyond it
+void TestTruncated() {
+  auto data = Write(GenerateStatistics(), 0);
+  for (size_t size = 0; size < data.size(); ++size) {
+    std::vector<char> prefix(data.begin(), data.begin() + size);
+    BinaryReader reader{prefix.data(), prefix.size()};
+    if (reader.Next()) {
+      ++Failures();
+      std::cerr << "Record truncated to " << size << " bytes of "
+                << data.size() << " is read\n";
+      return;
+    }
+    std::istringstream in{std::string{prefix.begin(), prefix.end()}};
+    std::vector<char> buffer;
+    CHECK(!BinaryReader::ReadRecord(in, buffer));
+    CHECK(buffer.empty());
+  }
+}
+
+template <typename T>
+void Patch(std::string& data, size_t offset, T value) {
+  memcpy(&data[offset], &value, sizeof(value));
+}
+
+// Header fields out of line with each other or with the data
+void TestCorrupt() {
+  auto statistics = GenerateStatistics();
+  auto data = Write(statistics, 0);
+  auto rows_size = sizeof(BinaryRow) * statistics.details.size();
+  struct Corruption {
+    const char* name;
+    void (*patch)(std::string& data, size_t rows_size);
+  };
+  const Corruption corruptions[] = {
+      {"magic", [](std::string& data, size_t) { data[3] = 'X'; }},
+      {"version",
+       [](std::string& data, size_t) {
+         Patch(data, offsetof(BinaryHeader, version),
+               uint16_t{kBinaryVersion + 1});
+       }},
+      {"header size below the fixed fields",
+       [](std::string& data, size_t) {
+         Patch(data, offsetof(BinaryHeader, header_size),
+               uint16_t{offsetof(BinaryHeader, count) - 1});
+       }},
+      {"header size beyond the record",
+       [](std::string& data, size_t) {
+         Patch(data, offsetof(BinaryHeader, header_size), uint16_t{0xFFFF});
+       }},
+      {"row size below the fixed fields",
+       [](std::string& data, size_t) {
+         Patch(data, offsetof(BinaryHeader, row_size),
+               uint32_t{offsetof(BinaryRow, reserved) - 1});
+       }},
+      {"rows beyond the record",
+       [](std::string& data, size_t) {
+         Patch(data, offsetof(BinaryHeader, row_count), uint32_t{0x10000000});
+       }},
+      {"row size overflowing",
+       [](std::string& data, size_t) {
+         Patch(data, offsetof(BinaryHeader, row_size), uint32_t{0xFFFFFFFF});
+         Patch(data, offsetof(BinaryHeader, row_count), uint32_t{0xFFFFFFFF});
+       }},
+      {"names beyond the record",
+       [](std::string& data, size_t) {
+         uint64_t names_size;
+         memcpy(&names_size, &data[offsetof(BinaryHeader, names_size)],
+                sizeof(names_size));
+         Patch(data, offsetof(BinaryHeader, names_size), names_size + 1);
+       }},
+      {"names size overflowing",
+       [](std::string& data, size_t) {
+         Patch(data, offsetof(BinaryHeader, names_size), ~uint64_t{});
+       }},
+      {"record size beyond the data",
+       [](std::string& data, size_t) {
+         Patch(data, offsetof(BinaryHeader, size), uint64_t{data.size() + 1});
+       }},
+      {"record size below the header",
+       [](std::string& data, size_t) {
+         Patch(data, offsetof(BinaryHeader, size),
+               uint64_t{sizeof(BinaryHeader) - 1});
+       }},
+      {"record size beyond any heap",
+       [](std::string& data, size_t) {
+         Patch(data, offsetof(BinaryHeader, size), uint64_t{1} << 40);
+       }},
+      {"record size below the rows",
+       [](std::string& data, size_t rows_size) {
+         Patch(data, offsetof(BinaryHeader, size),
+               uint64_t{sizeof(BinaryHeader) + rows_size - 1});
+       }},
+  };
+  for (auto& corruption : corruptions) {
+    auto corrupt = data;
+    corruption.patch(corrupt, rows_size);
+    std::vector<char> copy(corrupt.begin(), corrupt.end());
+    BinaryReader reader{copy.data(), copy.size()};
+    if (reader.Next()) {
+      ++Failures();
+      std::cerr << "Record with " << corruption.name << " is read\n";
+    }
+    // Header is cleared, nothing of the record is used
+    CHECK_EQ(reader.Header().row_count, 0u);
+    // Record read from a stream after a valid one is not appended
+    std::istringstream in{data + corrupt};
+    std::vector<char> buffer;
+    CHECK(BinaryReader::ReadRecord(in, buffer));
+    if (BinaryReader::ReadRecord(in, buffer)) {
+      ++Failures();
+      std::cerr << "Record with " << corruption.name
+                << " is read from a stream\n";
+    }
+    CHECK_EQ(buffer.size(), data.size());
+  }
+
+  // Name out of the names of the record is empty, the rest is read
+  auto corrupt = data;
+  auto row = sizeof(BinaryHeader) + sizeof(BinaryRow);
+  Patch(corrupt, row + offsetof(BinaryRow, name_offset), ~uint64_t{});
+  Patch(corrupt, row + 2 * sizeof(BinaryRow) + offsetof(BinaryRow, name_size),
+        uint32_t{0xFFFFFFFF});
+  BinaryReader reader{corrupt.data(), corrupt.size()};
+  CHECK(reader.Next());
+  CHECK_EQ(reader.Name(reader.Row(0)), statistics.details[0].name);
+  CHECK(reader.Name(reader.Row(1)).empty());
+  CHECK_EQ(reader.Name(reader.Row(2)), statistics.details[2].name);
+  CHECK(reader.Name(reader.Row(3)).empty());
+}
+
+}  // namespace
+
+int main() {
+  TestRoundTrip();
+  TestTruncated();
+  TestCorrupt();
+  return TestResult();
+}
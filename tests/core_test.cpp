@@ -0,0 +1,309 @@
+// CoreFile must serve the memory of a core built in memory (PT_LOAD segments
+// and an NT_FILE note) from the segments dumped and the files mapped, find
+// modules by the note, and use what is there of a truncated core without
+// reading beyond it.
+#include <elf.h>
+
+#include <cstdio>
+#include <fstream>
+
+#include "core.h"
+#include "test.h"
+
+namespace {
+
+#ifdef __LP64__
+using ElfHeader = Elf64_Ehdr;
+using ElfProgramHeader = Elf64_Phdr;
+using ElfNoteHeader = Elf64_Nhdr;
+auto constexpr kElfClass = ELFCLASS64;
+#else
+using ElfHeader = Elf32_Ehdr;
+using ElfProgramHeader = Elf32_Phdr;
+using ElfNoteHeader = Elf32_Nhdr;
+auto constexpr kElfClass = ELFCLASS32;
+#endif
+
+auto constexpr kPath = "core_test.core";
+auto constexpr kMappedPath = "core_test.mapped";
+auto constexpr kPageSize = 0x1000;
+// Two adjacent segments dumped, then pages of a file mapped but not dumped
+auto constexpr kFirst = uint64_t{0x10000000};
+auto constexpr kSecond = kFirst + 3 * kPageSize;
+auto constexpr kMapped = kSecond + 2 * kPageSize;
+auto constexpr kMappedSize = uint64_t{2 * kPageSize};
+auto constexpr kMappedOffset = uint64_t{1};  // pages into the file
+
+// Byte at "addr" of the process dumped
+BYTE Content(uint64_t addr) {
+  return static_cast<BYTE>(addr * 7 + addr / 251);
+}
+
+struct Core {
+  std::string data;
+  size_t note_offset;
+  size_t second_offset;  // of the second segment data
+};
+
+template <typename T>
+void Append(std::string& data, const T& value) {
+  data.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void AppendNote(std::string& data, uint32_t type, const char* name,
+                const std::string& desc) {
+  ElfNoteHeader note{};
+  note.n_namesz = static_cast<uint32_t>(strlen(name) + 1);
+  note.n_descsz = static_cast<uint32_t>(desc.size());
+  note.n_type = type;
+  Append(data, note);
+  data.append(name, note.n_namesz);
+  data.resize((data.size() + 3) & ~size_t{3});
+  data += desc;
+  data.resize((data.size() + 3) & ~size_t{3});
+}
+
+// NT_FILE note: the module mapped at two ranges, the file mapped beyond the
+// segments dumped
+std::string FileNote() {
+  std::string desc;
+  auto word = [&desc](uint64_t value) {
+    Append(desc, static_cast<unsigned long>(value));
+  };
+  word(3);
+  word(kPageSize);
+  word(kFirst + kPageSize);
+  word(kFirst + 2 * kPageSize);
+  word(0);
+  word(kFirst);
+  word(kFirst + kPageSize);
+  word(0);
+  word(kMapped);
+  word(kMapped + kMappedSize);
+  word(kMappedOffset);
+  auto module = "/usr/share/dotnet/libcoreclr.so";
+  desc.append(module, strlen(module) + 1);
+  desc.append(module, strlen(module) + 1);
+  desc.append(kMappedPath, strlen(kMappedPath) + 1);
+  return desc;
+}
+
+Core BuildCore() {
+  Core core;
+  auto& data = core.data;
+  ElfHeader header{};
+  memcpy(header.e_ident, ELFMAG, SELFMAG);
+  header.e_ident[EI_CLASS] = kElfClass;
+  header.e_ident[EI_DATA] = ELFDATA2LSB;
+  header.e_ident[EI_VERSION] = EV_CURRENT;
+  header.e_type = ET_CORE;
+  header.e_version = EV_CURRENT;
+  header.e_phoff = sizeof(ElfHeader);
+  header.e_ehsize = sizeof(ElfHeader);
+  header.e_phentsize = sizeof(ElfProgramHeader);
+  header.e_phnum = 3;
+  Append(data, header);
+
+  std::string notes;
+  AppendNote(notes, NT_PRSTATUS, "CORE", std::string(16, '\1'));
+  AppendNote(notes, NT_FILE, "LINUX", FileNote());  // not of the kernel
+  AppendNote(notes, NT_FILE, "CORE", FileNote());
+  core.note_offset = sizeof(ElfHeader) + 3 * sizeof(ElfProgramHeader);
+  auto first_offset = (core.note_offset + notes.size() + kPageSize - 1) &
+                      ~size_t{kPageSize - 1};
+  core.second_offset = first_offset + 3 * kPageSize;
+
+  ElfProgramHeader note{};
+  note.p_type = PT_NOTE;
+  note.p_offset = core.note_offset;
+  note.p_filesz = notes.size();
+  Append(data, note);
+  // Segments are listed out of address order
+  ElfProgramHeader second{};
+  second.p_type = PT_LOAD;
+  second.p_offset = core.second_offset;
+  second.p_vaddr = kSecond;
+  second.p_filesz = 2 * kPageSize;
+  second.p_memsz = 2 * kPageSize;
+  Append(data, second);
+  ElfProgramHeader first = second;
+  first.p_offset = first_offset;
+  first.p_vaddr = kFirst;
+  first.p_filesz = 3 * kPageSize;
+  first.p_memsz = 3 * kPageSize;
+  Append(data, first);
+
+  data += notes;
+  data.resize(first_offset);
+  for (auto addr = kFirst; addr < kSecond + 2 * kPageSize; ++addr) {
+    data.push_back(static_cast<char>(Content(addr)));
+  }
+  return core;
+}
+
+void WriteFile(const char* path, const std::string& data) {
+  std::ofstream file{path, std::ios::binary | std::ios::trunc};
+  file.write(data.data(), data.size());
+}
+
+std::unique_ptr<CoreFile> Open(const std::string& data) {
+  WriteFile(kPath, data);
+  return CoreFile::Open(kPath);
+}
+
+// Reads [addr, addr + size), checks the bytes read are the content and
+// returns their number
+size_t Read(CoreFile& core, uint64_t addr, size_t size, HRESULT expected) {
+  std::vector<BYTE> buffer(size, 0xCD);
+  ReadRequest request{addr, buffer.data(), static_cast<ULONG32>(size)};
+  auto hr = core.ReadMemory(&request, 1);
+  CHECK_EQ(hr, expected);
+  for (size_t i = 0; i < request.read; ++i) {
+    if (buffer[i] != Content(addr + i)) {
+      ++Failures();
+      std::cerr << "Byte at 0x" << std::hex << addr + i << std::dec
+                << " differs\n";
+      break;
+    }
+  }
+  return request.read;
+}
+
+void TestCore() {
+  auto core = Open(BuildCore().data);
+  CHECK(core);
+  if (!core) {
+    return;
+  }
+  // Within a segment and across the adjacent ones
+  CHECK_EQ(Read(*core, kFirst + 10, 100, S_OK), size_t{100});
+  CHECK_EQ(Read(*core, kSecond - 100, 200, S_OK), size_t{200});
+  // Pages of the mapped file up to its end, nothing is mapped beyond
+  CHECK_EQ(Read(*core, kMapped - 16, 32, S_OK), size_t{32});
+  CHECK_EQ(Read(*core, kMapped + kMappedSize - 48, 48, S_FALSE), size_t{32});
+  CHECK_EQ(Read(*core, kMapped + kMappedSize, 1, S_FALSE), size_t{0});
+  CHECK_EQ(Read(*core, kFirst - 1, 2, S_FALSE), size_t{0});
+
+  auto mapped = core->MapMemory(kFirst + 5, 10);
+  CHECK(mapped && *mapped == Content(kFirst + 5));
+  CHECK(core->MapMemory(kSecond, 2 * kPageSize));
+  // Segments are mapped one at a time
+  CHECK(!core->MapMemory(kSecond - 1, 2));
+  CHECK(!core->MapMemory(kMapped, 1));
+
+  CLRDATA_ADDRESS base = 0;
+  std::string path;
+  CHECK(core->FindModule("libcoreclr.so", base, path));
+  CHECK_EQ(base, CLRDATA_ADDRESS{kFirst});
+  CHECK_EQ(path, std::string{"/usr/share/dotnet/libcoreclr.so"});
+  CHECK(!core->FindModule("libmscordaccore.so", base, path));
+}
+
+// Memory of the segments cut off is not read, what is left is
+void TestTruncatedLoad() {
+  auto built = BuildCore();
+  auto size = built.second_offset + kPageSize + 100;
+  auto errors = Log::ErrorCount.load();
+  auto core = Open(built.data.substr(0, size));
+  CHECK(core);
+  CHECK_EQ(Log::ErrorCount.load() - errors, 1);
+  if (!core) {
+    return;
+  }
+  CHECK_EQ(Read(*core, kSecond + kPageSize, kPageSize, S_FALSE),
+           size_t{100});
+  CHECK(core->MapMemory(kSecond, kPageSize + 100));
+  CHECK(!core->MapMemory(kSecond, kPageSize + 101));
+  // Segment cut off entirely
+  core = Open(built.data.substr(0, built.second_offset));
+  CHECK(core);
+  if (core) {
+    CHECK_EQ(Read(*core, kSecond, 1, S_FALSE), size_t{0});
+    CHECK_EQ(Read(*core, kSecond - 1, 1, S_OK), size_t{1});
+  }
+}
+
+// Notes cut off or with sizes beyond the data are skipped
+void TestTruncatedNote() {
+  auto built = BuildCore();
+  auto& data = built.data;
+  auto note = sizeof(ElfHeader);
+  auto filesz = note + offsetof(ElfProgramHeader, p_filesz);
+  ElfProgramHeader header;
+  memcpy(&header, &data[note], sizeof(header));
+  CLRDATA_ADDRESS base = 0;
+  std::string path;
+  for (uint64_t size = 0; size < header.p_filesz; size += 4) {
+    auto truncated = data;
+    auto value = static_cast<decltype(header.p_filesz)>(size);
+    memcpy(&truncated[filesz], &value, sizeof(value));
+    auto core = Open(truncated);
+    CHECK(core);
+    // Module is found once the note listing it is whole
+    if (core && core->FindModule("libcoreclr.so", base, path) &&
+        size < header.p_filesz) {
+      ++Failures();
+      std::cerr << "Module found in a note truncated to " << size
+                << " bytes\n";
+      return;
+    }
+  }
+  // Mapping count beyond the note
+  auto corrupt = data;
+  auto desc = data.rfind(std::string{"CORE\0\0\0\0", 8}) + 8;
+  auto count = static_cast<unsigned long>(100);
+  memcpy(&corrupt[desc], &count, sizeof(count));
+  auto core = Open(corrupt);
+  CHECK(core && !core->FindModule("libcoreclr.so", base, path));
+  // Note size beyond the data
+  corrupt = data;
+  auto descsz = static_cast<uint32_t>(0xFFFFFFF0);
+  memcpy(&corrupt[desc - 8 - sizeof(ElfNoteHeader) +
+                  offsetof(ElfNoteHeader, n_descsz)],
+         &descsz, sizeof(descsz));
+  core = Open(corrupt);
+  CHECK(core && !core->FindModule("libcoreclr.so", base, path));
+}
+
+void TestCorrupt() {
+  auto data = BuildCore().data;
+  for (auto size : {size_t{0}, sizeof(ElfHeader) - 1, sizeof(ElfHeader),
+                    sizeof(ElfHeader) + 3 * sizeof(ElfProgramHeader) - 1}) {
+    if (Open(data.substr(0, size))) {
+      ++Failures();
+      std::cerr << "Core truncated to " << size << " bytes is opened\n";
+    }
+  }
+  auto corrupt = data;
+  corrupt[offsetof(ElfHeader, e_type)] = ET_EXEC;
+  CHECK(!Open(corrupt));
+  corrupt = data;
+  corrupt[offsetof(ElfHeader, e_phentsize)] += 1;
+  CHECK(!Open(corrupt));
+  corrupt = data;
+  auto phoff = static_cast<decltype(ElfHeader::e_phoff)>(data.size() - 1);
+  memcpy(&corrupt[offsetof(ElfHeader, e_phoff)], &phoff, sizeof(phoff));
+  CHECK(!Open(corrupt));
+  // Program headers are read in place
+  phoff = sizeof(ElfHeader) + 1;
+  memcpy(&corrupt[offsetof(ElfHeader, e_phoff)], &phoff, sizeof(phoff));
+  CHECK(!Open(corrupt));
+}
+
+}  // namespace
+
+int main() {
+  // File is shorter than the range mapped, as a file truncated after mapping
+  std::string mapped(kMappedOffset * kPageSize, '\0');
+  for (auto addr = kMapped; addr < kMapped + kMappedSize - 16; ++addr) {
+    mapped.push_back(static_cast<char>(Content(addr)));
+  }
+  WriteFile(kMappedPath, mapped);
+  TestCore();
+  TestTruncatedLoad();
+  TestTruncatedNote();
+  TestCorrupt();
+  remove(kPath);
+  remove(kMappedPath);
+  return TestResult();
+}
@@ -0,0 +1,219 @@
+// Exporter over a Unix domain socket, sampling a fake target: scrapes get the
+// metrics with GET and HEAD, requests it does not serve get their error, a
+// target which can not be sampled gets 503 without being sampled again until
+// the refresh interval passes, and files at the socket path which are not
+// sockets are never removed.
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <future>
+#include <thread>
+
+#include "exporter.h"
+#include "fake_dac.h"
+#include "test.h"
+
+namespace {
+
+auto constexpr kPath = "exporter_test.sock";
+auto constexpr kHeap = CLRDATA_ADDRESS{0x1000};
+auto constexpr kSegment = CLRDATA_ADDRESS{0x2000};
+auto constexpr kSegmentStart = uintptr_t{0x10000000};
+auto constexpr kObjectCount = 100;
+auto constexpr kMethodTable = uintptr_t{0x7f0000001000};
+
+// Target sampled by the exporter, see CreateDac
+FakeDac* target;
+
+void SetUpTarget(FakeDac& dac) {
+  auto& sos = dac.Sos();
+  sos.heap_data.HeapCount = 1;
+  sos.heap_data.g_max_generation = 2;
+  sos.heap_data.bGcStructuresValid = TRUE;
+  sos.globals.FreeMethodTable = 0x7f0000000100;
+  auto end = kSegmentStart + kObjectCount * 24;
+  auto& details = sos.heaps[kHeap];
+  details.heapAddr = kHeap;
+  details.alloc_allocated = end;
+  details.ephemeral_heap_segment = kSegment;
+  details.generation_table[2].start_segment = kSegment;
+  for (auto gen = 0; gen <= 2; ++gen) {
+    details.generation_table[gen].allocation_start = kSegmentStart;
+  }
+  auto& segment = sos.segments[kSegment];
+  segment.segmentAddr = kSegment;
+  segment.mem = kSegmentStart;
+  segment.allocated = end;
+  dac.AddRegion(kSegmentStart, end - kSegmentStart);
+  for (auto i = 0; i < kObjectCount; ++i) {
+    dac.Write(kSegmentStart + i * 24, kMethodTable);
+  }
+  sos.method_tables[kMethodTable] = {24, 0, "App.\"Quoted\"\\Type"};
+}
+
+struct Response {
+  std::string status;
+  size_t content_length;
+  std::string body;
+};
+
+// Sends the request over a connection of its own and reads the response to
+// the end, while the exporter handles the connection
+Response Request(IListener& listener, HeapExporter& exporter,
+                 const std::string& request) {
+  auto client = std::async(std::launch::async, [&request] {
+    std::string response;
+    auto fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, kPath);
+    if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0) {
+      send(fd, request.data(), request.size(), MSG_NOSIGNAL);
+      char buffer[4096];
+      for (ssize_t size; 0 < (size = recv(fd, buffer, sizeof(buffer), 0));) {
+        response.append(buffer, static_cast<size_t>(size));
+      }
+    }
+    close(fd);
+    return response;
+  });
+  auto connection = listener.Accept();
+  CHECK(connection);
+  if (connection) {
+    exporter.Handle(*connection);
+  }
+  connection.reset();
+  auto data = client.get();
+  Response response{};
+  auto status_end = data.find("\r\n");
+  auto headers_end = data.find("\r\n\r\n");
+  auto length = data.find("Content-Length: ");
+  if (data.compare(0, 9, "HTTP/1.1 ") != 0 || headers_end == std::string::npos ||
+      length == std::string::npos) {
+    ++Failures();
+    std::cerr << "Response is not valid: " << data << '\n';
+    return response;
+  }
+  response.status = data.substr(9, status_end - 9);
+  response.content_length = std::stoul(data.substr(length + 16));
+  response.body = data.substr(headers_end + 4);
+  return response;
+}
+
+void TestRequests(IListener& listener, HeapExporter& exporter) {
+  auto get = Request(listener, exporter,
+                     "GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n");
+  CHECK_EQ(get.status, std::string{"200 OK"});
+  CHECK_EQ(get.content_length, get.body.size());
+  auto series = "gcheapstat_type_objects{mt=\"0x7f0000001000\",type=\"App.\\\""
+                "Quoted\\\"\\\\Type\",generation=\"0\"} 100\n";
+  CHECK(get.body.find(series) != std::string::npos);
+  CHECK(get.body.size() >= 6 &&
+        get.body.compare(get.body.size() - 6, 6, "# EOF\n") == 0);
+
+  // Same metrics, the last sample is recent enough
+  auto head = Request(listener, exporter, "HEAD / HTTP/1.1\r\n\r\n");
+  CHECK_EQ(head.status, std::string{"200 OK"});
+  CHECK_EQ(head.content_length, get.body.size());
+  CHECK(head.body.empty());
+  auto query = Request(listener, exporter, "GET /metrics?x=1 HTTP/1.1\r\n\r\n");
+  CHECK_EQ(query.body, get.body);
+
+  CHECK_EQ(Request(listener, exporter, "GET /other HTTP/1.1\r\n\r\n").status,
+           std::string{"404 Not Found"});
+  auto not_found = Request(listener, exporter, "HEAD /other HTTP/1.1\r\n\r\n");
+  CHECK_EQ(not_found.status, std::string{"404 Not Found"});
+  CHECK(not_found.body.empty());
+  CHECK_EQ(Request(listener, exporter, "POST /metrics HTTP/1.1\r\n\r\n").status,
+           std::string{"405 Method Not Allowed"});
+  CHECK_EQ(Request(listener, exporter,
+                   "GET /metrics HTTP/1.1\r\nX: " + std::string(9000, 'x'))
+               .status,
+           std::string{"431 Request Header Fields Too Large"});
+  CHECK_EQ(Request(listener, exporter, "GET\r\n\r\n").status,
+           std::string{"400 Bad Request"});
+}
+
+void TestBackoff(IListener& listener, HeapExporter& exporter) {
+  auto get = "GET /metrics HTTP/1.1\r\n\r\n";
+  // Sample of the previous test is outdated
+  std::this_thread::sleep_for(std::chrono::milliseconds{1100});
+  auto heaps = target->Sos().heaps;
+  target->Sos().heaps.clear();
+  CHECK_EQ(Request(listener, exporter, get).status,
+           std::string{"503 Service Unavailable"});
+  // Target is not sampled again until the interval passes
+  target->Sos().heaps = heaps;
+  CHECK_EQ(Request(listener, exporter, get).status,
+           std::string{"503 Service Unavailable"});
+  std::this_thread::sleep_for(std::chrono::milliseconds{1100});
+  CHECK_EQ(Request(listener, exporter, get).status, std::string{"200 OK"});
+}
+
+bool Exists(const char* path) {
+  struct stat st;
+  return lstat(path, &st) == 0;
+}
+
+void TestSocketPath() {
+  // Stale socket of a previous run is replaced
+  auto fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, kPath);
+  CHECK_EQ(bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)), 0);
+  close(fd);
+  auto listener = Listen(kPath);
+  CHECK(listener);
+  // File put at the path meanwhile is kept
+  unlink(kPath);
+  std::ofstream{kPath} << "data";
+  listener.reset();
+  CHECK(Exists(kPath));
+  // Files other than sockets are never replaced
+  auto errors = Log::ErrorCount.load();
+  CHECK(!Listen(kPath));
+  CHECK_EQ(Log::ErrorCount.load() - errors, 1);
+  std::string data;
+  std::ifstream{kPath} >> data;
+  CHECK_EQ(data, std::string{"data"});
+  unlink(kPath);
+  CHECK(symlink("exporter_test.missing", kPath) == 0);
+  CHECK(!Listen(kPath));
+  unlink(kPath);
+}
+
+}  // namespace
+
+// Target of the exporter is the fake one
+std::unique_ptr<IDac> CreateDac(int) {
+  auto dac = std::make_unique<FakeDac>();
+  SetUpTarget(*dac);
+  target = dac.get();
+  return dac;
+}
+
+std::unique_ptr<IDac> CreateCoreDac(const std::string&) { return nullptr; }
+
+int main() {
+  unlink(kPath);
+  Options options;
+  options.pid = 1;
+  options.interval = 1;
+  options.serve = kPath;
+  {
+    HeapExporter exporter{options};
+    auto listener = Listen(kPath);
+    CHECK(listener);
+    if (listener) {
+      TestRequests(*listener, exporter);
+      TestBackoff(*listener, exporter);
+    }
+  }
+  CHECK(!Exists(kPath));
+  TestSocketPath();
+  return TestResult();
+}
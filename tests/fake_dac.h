@@ -0,0 +1,294 @@
+#pragma once
+#include <atomic>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "dac.h"
+
+// DAC of the tests: the GC heap, threads and method tables are set by the
+// test, the rest of the requests fail
+class FakeSos final : public ISOSDacInterface {
+ public:
+  static auto constexpr kFirstThread = CLRDATA_ADDRESS{0x7e0000000000};
+  static auto constexpr kThreadSize = CLRDATA_ADDRESS{0x1000};
+
+  struct MethodTable {
+    DWORD base_size;
+    DWORD component_size;
+    std::string name;  // ASCII
+  };
+
+  FakeSos() = default;
+
+  FakeSos(const FakeSos&) = delete;
+  FakeSos(FakeSos&&) = delete;
+  FakeSos& operator=(const FakeSos&) = delete;
+  FakeSos& operator=(FakeSos&&) = delete;
+
+  // Server mode if there is more than one heap, heap addresses are the keys
+  DacpGcHeapData heap_data{};
+  std::map<CLRDATA_ADDRESS, DacpGcHeapDetails> heaps;
+  std::map<CLRDATA_ADDRESS, DacpHeapSegmentData> segments;
+  DacpUsefulGlobalsData globals{};
+  // Listed from the first thread by their "nextThread", see AddThread
+  CLRDATA_ADDRESS first_thread{};
+  std::unordered_map<CLRDATA_ADDRESS, DacpThreadData> threads;
+  std::map<CLRDATA_ADDRESS, MethodTable> method_tables;
+  // Requests of method table data and names
+  std::atomic<int> method_table_requests{};
+  std::atomic<int> name_requests{};
+
+  // Appends a thread with [ptr, limit) allocation context to the list
+  void AddThread(CLRDATA_ADDRESS ptr, CLRDATA_ADDRESS limit) {
+    auto thread = kFirstThread + threads.size() * kThreadSize;
+    auto& data = threads[thread];
+    data.osThreadId = static_cast<DWORD>(threads.size());
+    data.allocContextPtr = ptr;
+    data.allocContextLimit = limit;
+    if (threads.size() == 1) {
+      first_thread = thread;
+    } else {
+      threads[thread - kThreadSize].nextThread = thread;
+    }
+  }
+
+  // clang-format off
+  // IUnknown
+  STDMETHOD(QueryInterface)(REFIID, void**) override { return E_NOINTERFACE; }
+  STDMETHOD_(ULONG, AddRef)() override { return 1; }
+  STDMETHOD_(ULONG, Release)() override { return 1; }
+  // clang-format on
+  // ISOSDacInterface
+  STDMETHOD(GetThreadStoreData)(struct DacpThreadStoreData* data) override {
+    *data = {};
+    data->threadCount = static_cast<LONG>(threads.size());
+    data->firstThread = first_thread;
+    return S_OK;
+  }
+  STDMETHOD(GetThreadData)(CLRDATA_ADDRESS thread,
+                           struct DacpThreadData* data) override {
+    return Get(threads, thread, data);
+  }
+  STDMETHOD(GetGCHeapData)(struct DacpGcHeapData* data) override {
+    *data = heap_data;
+    return S_OK;
+  }
+  STDMETHOD(GetGCHeapList)(unsigned int count, CLRDATA_ADDRESS values[],
+                           unsigned int* pNeeded) override {
+    if (pNeeded) *pNeeded = static_cast<unsigned int>(heaps.size());
+    if (count < heaps.size()) return E_INVALIDARG;
+    for (auto& heap : heaps) {
+      *values++ = heap.first;
+    }
+    return S_OK;
+  }
+  STDMETHOD(GetGCHeapDetails)(CLRDATA_ADDRESS heap,
+                              struct DacpGcHeapDetails* details) override {
+    return Get(heaps, heap, details);
+  }
+  STDMETHOD(GetGCHeapStaticData)(struct DacpGcHeapDetails* data) override {
+    if (heaps.size() != 1) return E_FAIL;
+    *data = heaps.begin()->second;
+    return S_OK;
+  }
+  STDMETHOD(GetHeapSegmentData)(CLRDATA_ADDRESS seg,
+                                struct DacpHeapSegmentData* data) override {
+    return Get(segments, seg, data);
+  }
+  STDMETHOD(GetUsefulGlobals)(struct DacpUsefulGlobalsData* data) override {
+    *data = globals;
+    return S_OK;
+  }
+  STDMETHOD(GetMethodTableData)(CLRDATA_ADDRESS mt,
+                                struct DacpMethodTableData* data) override {
+    ++method_table_requests;
+    auto it = method_tables.find(mt);
+    if (it == method_tables.end()) return E_INVALIDARG;
+    *data = {};
+    data->BaseSize = it->second.base_size;
+    data->ComponentSize = it->second.component_size;
+    return S_OK;
+  }
+  STDMETHOD(GetMethodTableName)(CLRDATA_ADDRESS mt, unsigned int count,
+                                WCHAR* mtName,
+                                unsigned int* pNeeded) override {
+    ++name_requests;
+    auto it = method_tables.find(mt);
+    if (it == method_tables.end()) return E_INVALIDARG;
+    auto& name = it->second.name;
+    auto needed = static_cast<unsigned int>(name.size() + 1);
+    if (pNeeded) *pNeeded = needed;
+    if (!count) return S_FALSE;
+    auto length = (std::min)(count - 1, needed - 1);
+    std::copy(name.begin(), name.begin() + length, mtName);
+    mtName[length] = 0;
+    return count < needed ? S_FALSE : S_OK;
+  }
+  // clang-format off
+  STDMETHOD(GetAppDomainStoreData)(struct DacpAppDomainStoreData* data) override { return E_NOTIMPL; }
+  STDMETHOD(GetAppDomainList)(unsigned int count, CLRDATA_ADDRESS values[], unsigned int* pNeeded) override { return E_NOTIMPL; }
+  STDMETHOD(GetAppDomainData)(CLRDATA_ADDRESS addr, struct DacpAppDomainData* data) override { return E_NOTIMPL; }
+  STDMETHOD(GetAppDomainName)(CLRDATA_ADDRESS addr, unsigned int count, WCHAR* name, unsigned int* pNeeded) override { return E_NOTIMPL; }
+  STDMETHOD(GetDomainFromContext)(CLRDATA_ADDRESS context, CLRDATA_ADDRESS* domain) override { return E_NOTIMPL; }
+  STDMETHOD(GetAssemblyList)(CLRDATA_ADDRESS appDomain, int count, CLRDATA_ADDRESS values[], int* pNeeded) override { return E_NOTIMPL; }
+  STDMETHOD(GetAssemblyData)(CLRDATA_ADDRESS baseDomainPtr, CLRDATA_ADDRESS assembly, struct DacpAssemblyData* data) override { return E_NOTIMPL; }
+  STDMETHOD(GetAssemblyName)(CLRDATA_ADDRESS assembly, unsigned int count, WCHAR* name, unsigned int* pNeeded) override { return E_NOTIMPL; }
+  STDMETHOD(GetModule)(CLRDATA_ADDRESS addr, IXCLRDataModule* * mod) override { return E_NOTIMPL; }
+  STDMETHOD(GetModuleData)(CLRDATA_ADDRESS moduleAddr, struct DacpModuleData* data) override { return E_NOTIMPL; }
+  STDMETHOD(TraverseModuleMap)(ModuleMapType mmt, CLRDATA_ADDRESS moduleAddr, MODULEMAPTRAVERSE pCallback, LPVOID token) override { return E_NOTIMPL; }
+  STDMETHOD(GetAssemblyModuleList)(CLRDATA_ADDRESS assembly, unsigned int count, CLRDATA_ADDRESS modules[], unsigned int* pNeeded) override { return E_NOTIMPL; }
+  STDMETHOD(GetILForModule)(CLRDATA_ADDRESS moduleAddr, DWORD rva, CLRDATA_ADDRESS* il) override { return E_NOTIMPL; }
+  STDMETHOD(GetThreadFromThinlockID)(UINT thinLockId, CLRDATA_ADDRESS* pThread) override { return E_NOTIMPL; }
+  STDMETHOD(GetStackLimits)(CLRDATA_ADDRESS threadPtr, CLRDATA_ADDRESS* lower, CLRDATA_ADDRESS* upper, CLRDATA_ADDRESS* fp) override { return E_NOTIMPL; }
+  STDMETHOD(GetMethodDescData)(CLRDATA_ADDRESS methodDesc, CLRDATA_ADDRESS ip, struct DacpMethodDescData* data, ULONG cRevertedRejitVersions, struct DacpReJitData* rgRevertedRejitData, ULONG* pcNeededRevertedRejitData) override { return E_NOTIMPL; }
+  STDMETHOD(GetMethodDescPtrFromIP)(CLRDATA_ADDRESS ip, CLRDATA_ADDRESS* ppMD) override { return E_NOTIMPL; }
+  STDMETHOD(GetMethodDescName)(CLRDATA_ADDRESS methodDesc, unsigned int count, WCHAR* name, unsigned int* pNeeded) override { return E_NOTIMPL; }
+  STDMETHOD(GetMethodDescPtrFromFrame)(CLRDATA_ADDRESS frameAddr, CLRDATA_ADDRESS* ppMD) override { return E_NOTIMPL; }
+  STDMETHOD(GetMethodDescFromToken)(CLRDATA_ADDRESS moduleAddr, mdToken token, CLRDATA_ADDRESS* methodDesc) override { return E_NOTIMPL; }
+  STDMETHOD(GetMethodDescTransparencyData)(CLRDATA_ADDRESS methodDesc, struct DacpMethodDescTransparencyData* data) override { return E_NOTIMPL; }
+  STDMETHOD(GetCodeHeaderData)(CLRDATA_ADDRESS ip, struct DacpCodeHeaderData* data) override { return E_NOTIMPL; }
+  STDMETHOD(GetJitManagerList)(unsigned int count, struct DacpJitManagerInfo* managers, unsigned int* pNeeded) override { return E_NOTIMPL; }
+  STDMETHOD(GetJitHelperFunctionName)(CLRDATA_ADDRESS ip, unsigned int count, char* name, unsigned int* pNeeded) override { return E_NOTIMPL; }
+  STDMETHOD(GetJumpThunkTarget)(T_CONTEXT* ctx, CLRDATA_ADDRESS* targetIP, CLRDATA_ADDRESS* targetMD) override { return E_NOTIMPL; }
+  STDMETHOD(GetThreadpoolData)(struct DacpThreadpoolData* data) override { return E_NOTIMPL; }
+  STDMETHOD(GetWorkRequestData)(CLRDATA_ADDRESS addrWorkRequest, struct DacpWorkRequestData* data) override { return E_NOTIMPL; }
+  STDMETHOD(GetHillClimbingLogEntry)(CLRDATA_ADDRESS addr, struct DacpHillClimbingLogEntry* data) override { return E_NOTIMPL; }
+  STDMETHOD(GetObjectData)(CLRDATA_ADDRESS objAddr, struct DacpObjectData* data) override { return E_NOTIMPL; }
+  STDMETHOD(GetObjectStringData)(CLRDATA_ADDRESS obj, unsigned int count, WCHAR* stringData, unsigned int* pNeeded) override { return E_NOTIMPL; }
+  STDMETHOD(GetObjectClassName)(CLRDATA_ADDRESS obj, unsigned int count, WCHAR* className, unsigned int* pNeeded) override { return E_NOTIMPL; }
+  STDMETHOD(GetMethodTableSlot)(CLRDATA_ADDRESS mt, unsigned int slot, CLRDATA_ADDRESS* value) override { return E_NOTIMPL; }
+  STDMETHOD(GetMethodTableFieldData)(CLRDATA_ADDRESS mt, struct DacpMethodTableFieldData* data) override { return E_NOTIMPL; }
+  STDMETHOD(GetMethodTableTransparencyData)(CLRDATA_ADDRESS mt, struct DacpMethodTableTransparencyData* data) override { return E_NOTIMPL; }
+  STDMETHOD(GetMethodTableForEEClass)(CLRDATA_ADDRESS eeClass, CLRDATA_ADDRESS* value) override { return E_NOTIMPL; }
+  STDMETHOD(GetFieldDescData)(CLRDATA_ADDRESS fieldDesc, struct DacpFieldDescData* data) override { return E_NOTIMPL; }
+  STDMETHOD(GetFrameName)(CLRDATA_ADDRESS vtable, unsigned int count, WCHAR* frameName, unsigned int* pNeeded) override { return E_NOTIMPL; }
+  STDMETHOD(GetPEFileBase)(CLRDATA_ADDRESS addr, CLRDATA_ADDRESS* base) override { return E_NOTIMPL; }
+  STDMETHOD(GetPEFileName)(CLRDATA_ADDRESS addr, unsigned int count, WCHAR* fileName, unsigned int* pNeeded) override { return E_NOTIMPL; }
+  STDMETHOD(GetOOMData)(CLRDATA_ADDRESS oomAddr, struct DacpOomData* data) override { return E_NOTIMPL; }
+  STDMETHOD(GetOOMStaticData)(struct DacpOomData* data) override { return E_NOTIMPL; }
+  STDMETHOD(GetHeapAnalyzeData)(CLRDATA_ADDRESS addr, struct DacpGcHeapAnalyzeData* data) override { return E_NOTIMPL; }
+  STDMETHOD(GetHeapAnalyzeStaticData)(struct DacpGcHeapAnalyzeData* data) override { return E_NOTIMPL; }
+  STDMETHOD(GetDomainLocalModuleData)(CLRDATA_ADDRESS addr, struct DacpDomainLocalModuleData* data) override { return E_NOTIMPL; }
+  STDMETHOD(GetDomainLocalModuleDataFromAppDomain)(CLRDATA_ADDRESS appDomainAddr, int moduleID, struct DacpDomainLocalModuleData* data) override { return E_NOTIMPL; }
+  STDMETHOD(GetDomainLocalModuleDataFromModule)(CLRDATA_ADDRESS moduleAddr, struct DacpDomainLocalModuleData* data) override { return E_NOTIMPL; }
+  STDMETHOD(GetThreadLocalModuleData)(CLRDATA_ADDRESS thread, unsigned int index, struct DacpThreadLocalModuleData* data) override { return E_NOTIMPL; }
+  STDMETHOD(GetSyncBlockData)(unsigned int number, struct DacpSyncBlockData* data) override { return E_NOTIMPL; }
+  STDMETHOD(GetSyncBlockCleanupData)(CLRDATA_ADDRESS addr, struct DacpSyncBlockCleanupData* data) override { return E_NOTIMPL; }
+  STDMETHOD(GetHandleEnum)(ISOSHandleEnum* * ppHandleEnum) override { return E_NOTIMPL; }
+  STDMETHOD(GetHandleEnumForTypes)(unsigned int types[], unsigned int count, ISOSHandleEnum* * ppHandleEnum) override { return E_NOTIMPL; }
+  STDMETHOD(GetHandleEnumForGC)(unsigned int gen, ISOSHandleEnum* * ppHandleEnum) override { return E_NOTIMPL; }
+  STDMETHOD(TraverseEHInfo)(CLRDATA_ADDRESS ip, DUMPEHINFO pCallback, LPVOID token) override { return E_NOTIMPL; }
+  STDMETHOD(GetNestedExceptionData)(CLRDATA_ADDRESS exception, CLRDATA_ADDRESS* exceptionObject, CLRDATA_ADDRESS* nextNestedException) override { return E_NOTIMPL; }
+  STDMETHOD(GetStressLogAddress)(CLRDATA_ADDRESS* stressLog) override { return E_NOTIMPL; }
+  STDMETHOD(TraverseLoaderHeap)(CLRDATA_ADDRESS loaderHeapAddr, VISITHEAP pCallback) override { return E_NOTIMPL; }
+  STDMETHOD(GetCodeHeapList)(CLRDATA_ADDRESS jitManager, unsigned int count, struct DacpJitCodeHeapInfo* codeHeaps, unsigned int* pNeeded) override { return E_NOTIMPL; }
+  STDMETHOD(TraverseVirtCallStubHeap)(CLRDATA_ADDRESS pAppDomain, VCSHeapType heaptype, VISITHEAP pCallback) override { return E_NOTIMPL; }
+  STDMETHOD(GetClrWatsonBuckets)(CLRDATA_ADDRESS thread, void* pGenericModeBlock) override { return E_NOTIMPL; }
+  STDMETHOD(GetTLSIndex)(ULONG* pIndex) override { return E_NOTIMPL; }
+  STDMETHOD(GetDacModuleHandle)(HMODULE* phModule) override { return E_NOTIMPL; }
+  STDMETHOD(GetRCWData)(CLRDATA_ADDRESS addr, struct DacpRCWData* data) override { return E_NOTIMPL; }
+  STDMETHOD(GetRCWInterfaces)(CLRDATA_ADDRESS rcw, unsigned int count, struct DacpCOMInterfacePointerData* interfaces, unsigned int* pNeeded) override { return E_NOTIMPL; }
+  STDMETHOD(GetCCWData)(CLRDATA_ADDRESS ccw, struct DacpCCWData* data) override { return E_NOTIMPL; }
+  STDMETHOD(GetCCWInterfaces)(CLRDATA_ADDRESS ccw, unsigned int count, struct DacpCOMInterfacePointerData* interfaces, unsigned int* pNeeded) override { return E_NOTIMPL; }
+  STDMETHOD(TraverseRCWCleanupList)(CLRDATA_ADDRESS cleanupListPtr, VISITRCWFORCLEANUP pCallback, LPVOID token) override { return E_NOTIMPL; }
+  STDMETHOD(GetStackReferences)(DWORD osThreadID, ISOSStackRefEnum* * ppEnum) override { return E_NOTIMPL; }
+  STDMETHOD(GetRegisterName)(int regName, unsigned int count, WCHAR* buffer, unsigned int* pNeeded) override { return E_NOTIMPL; }
+  STDMETHOD(GetThreadAllocData)(CLRDATA_ADDRESS thread, struct DacpAllocData* data) override { return E_NOTIMPL; }
+  STDMETHOD(GetHeapAllocData)(unsigned int count, struct DacpGenerationAllocData* data, unsigned int* pNeeded) override { return E_NOTIMPL; }
+  STDMETHOD(GetFailedAssemblyList)(CLRDATA_ADDRESS appDomain, int count, CLRDATA_ADDRESS values[], unsigned int* pNeeded) override { return E_NOTIMPL; }
+  STDMETHOD(GetPrivateBinPaths)(CLRDATA_ADDRESS appDomain, int count, WCHAR* paths, unsigned int* pNeeded) override { return E_NOTIMPL; }
+  STDMETHOD(GetAssemblyLocation)(CLRDATA_ADDRESS assembly, int count, WCHAR* location, unsigned int* pNeeded) override { return E_NOTIMPL; }
+  STDMETHOD(GetAppDomainConfigFile)(CLRDATA_ADDRESS appDomain, int count, WCHAR* configFile, unsigned int* pNeeded) override { return E_NOTIMPL; }
+  STDMETHOD(GetApplicationBase)(CLRDATA_ADDRESS appDomain, int count, WCHAR* base, unsigned int* pNeeded) override { return E_NOTIMPL; }
+  STDMETHOD(GetFailedAssemblyData)(CLRDATA_ADDRESS assembly, unsigned int* pContext, HRESULT* pResult) override { return E_NOTIMPL; }
+  STDMETHOD(GetFailedAssemblyLocation)(CLRDATA_ADDRESS assesmbly, unsigned int count, WCHAR* location, unsigned int* pNeeded) override { return E_NOTIMPL; }
+  STDMETHOD(GetFailedAssemblyDisplayName)(CLRDATA_ADDRESS assembly, unsigned int count, WCHAR* name, unsigned int* pNeeded) override { return E_NOTIMPL; }
+  // clang-format on
+
+ private:
+  template <typename Map, typename T>
+  static HRESULT Get(const Map& items, CLRDATA_ADDRESS address, T* data) {
+    auto it = items.find(address);
+    if (it == items.end()) return E_INVALIDARG;
+    *data = it->second;
+    return S_OK;
+  }
+};
+
+// Target of the tests: memory regions at their addresses, reads beyond them
+// are partial the way reads of unmapped target memory are, and the DAC above
+class FakeDac : public IDac {
+ public:
+  FakeDac() = default;
+
+  FakeDac(const FakeDac&) = delete;
+  FakeDac(FakeDac&&) = delete;
+  FakeDac& operator=(const FakeDac&) = delete;
+  FakeDac& operator=(FakeDac&&) = delete;
+
+  FakeSos& Sos() { return sos_; }
+
+  // Region is zero filled, to be filled by the test
+  std::vector<BYTE>& AddRegion(uintptr_t address, size_t size) {
+    auto& region = regions_[address];
+    region.assign(size, 0);
+    return region;
+  }
+
+  // Writes "value" to the memory of a region
+  template <typename T>
+  void Write(uintptr_t address, const T& value) {
+    auto memory = Find(address);
+    if (sizeof(value) <= memory.size) {
+      memcpy(memory.data, &value, sizeof(value));
+    }
+  }
+
+  IXCLRDataTarget3* GetXCLRDataTarget3() override { return nullptr; }
+  ISOSDacInterface* GetSOSDacInterface() override { return &sos_; }
+  HRESULT ReadMemory(ReadRequest* requests, size_t count) override {
+    auto hr = S_OK;
+    for (size_t i = 0; i < count; ++i) {
+      auto& request = requests[i];
+      auto memory = Find(static_cast<uintptr_t>(request.address));
+      request.read = static_cast<ULONG32>(
+          (std::min)(size_t{request.size}, memory.size));
+      if (request.read) {
+        memcpy(request.buffer, memory.data, request.read);
+      }
+      if (request.read < request.size) {
+        hr = S_FALSE;
+      }
+    }
+    return hr;
+  }
+  CacheStatistics GetCacheStatistics() override { return {}; }
+  const BYTE* MapMemory(CLRDATA_ADDRESS, size_t) override { return nullptr; }
+  size_t GetReadableSize(CLRDATA_ADDRESS, size_t size) override {
+    return size;
+  }
+  void RefreshMemoryMap() override {}
+  void Flush() override {}
+
+ private:
+  struct Memory {
+    BYTE* data;
+    size_t size;
+  };
+
+  // Returns the memory at "address" up to the end of its region, empty if no
+  // region has it
+  Memory Find(uintptr_t address) {
+    auto it = regions_.upper_bound(address);
+    if (it == regions_.begin()) return {};
+    --it;
+    auto offset = static_cast<size_t>(address - it->first);
+    if (it->second.size() <= offset) return {};
+    return {&it->second[offset], it->second.size() - offset};
+  }
+
+  FakeSos sos_;
+  std::map<uintptr_t, std::vector<BYTE>> regions_;
+};
@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "maps.h"
+
+// Modules of the generated maps are named "lib<line>.so", one per interval
+auto constexpr kMapsModuleInterval = 100;
+
+// Maps of a large process: modules among many anonymous regions, some of them
+// not readable, in the order and format the kernel writes them. The regions
+// MemoryMap parses from them are appended to "regions".
+inline std::string GenerateMaps(size_t line_count,
+                                std::vector<MemoryMap::Region>& regions) {
+  std::mt19937_64 random{42};
+  std::ostringstream maps;
+  maps << std::hex;
+  uint64_t address = 0x7f0000000000;
+  for (size_t i = 0; i < line_count; ++i) {
+    MemoryMap::Region region{};
+    address += random() % 4 == 0 ? 0x1000 * (random() % 16 + 1) : 0;
+    region.first = address;
+    region.last = address += 0x1000 * (random() % 64 + 1);
+    auto module = i % kMapsModuleInterval == 0;
+    region.protection =
+        random() % 8 == 0 ? 0 : MemoryMap::kRead | MemoryMap::kWrite;
+    maps << region.first << '-' << region.last << ' '
+         << (region.protection & MemoryMap::kRead ? 'r' : '-')
+         << (region.protection & MemoryMap::kWrite ? 'w' : '-') << "-p "
+         << "00000000 " << (module ? "08:02 1234 " : "00:00 0 ");
+    region.path = MemoryMap::kNoPath;
+    if (module) {
+      region.path = static_cast<uint32_t>(i / kMapsModuleInterval);
+      maps << "                    /usr/share/dotnet/shared/"
+              "Microsoft.NETCore.App/8.0.0/lib"
+           << std::dec << i << std::hex << ".so";
+    }
+    maps << '\n';
+    regions.push_back(region);
+  }
+  return maps.str();
+}
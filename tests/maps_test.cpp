@@ -0,0 +1,95 @@
+// MemoryMap must parse maps files the way the kernel writes them, including
+// paths with spaces and files deleted while mapped, and stay exact on maps of
+// 100k regions as large heaps make them.
+#include "maps.h"
+#include "maps_generator.h"
+#include "test.h"
+
+namespace {
+
+auto constexpr kLineCount = 100000;
+
+void TestParse() {
+  const char maps[] =
+      "00400000-00452000 r-xp 00000000 08:02 173521      /usr/bin/dotnet\n"
+      "7f0000000000-7f0000010000 rw-p 00000000 00:00 0 \n"
+      "7f1000000000-7f1000100000 r--p 00000000 08:02 42 "
+      "/usr/share/dotnet/shared/Microsoft.NETCore.App/8.0.0/libcoreclr.so "
+      "(deleted)\n"
+      "7f1000100000-7f1000400000 r-xp 00100000 08:02 42 "
+      "/usr/share/dotnet/shared/Microsoft.NETCore.App/8.0.0/libcoreclr.so "
+      "(deleted)\n"
+      "7f2000000000-7f2000001000 r--p 00000000 08:02 43 "
+      "/opt/my app/libfoo.so\n"
+      "7f3000000000-7f3000001000 r--p 00000000 08:02 44 /tmp/ (deleted)\n"
+      "malformed line\n"
+      "7ffd00000000-7ffd00021000 rw-p 00000000 00:00 0   [stack]\n"
+      "7ffe00000000-7ffe00001000 r-xp 00000000 00:00 0   [vdso]";
+  MemoryMap map;
+  map.Parse(maps, sizeof(maps) - 1);
+  auto& regions = map.GetRegions();
+  CHECK_EQ(regions.size(), size_t{8});
+
+  auto clr = map.FindModule("libcoreclr.so");
+  CHECK(clr);
+  if (clr) {
+    CHECK_EQ(clr->first, uint64_t{0x7f1000000000});
+    CHECK_EQ(clr->protection, uint32_t{MemoryMap::kRead});
+    CHECK_EQ(map.GetPath(*clr),
+             std::string{"/usr/share/dotnet/shared/Microsoft.NETCore.App/"
+                         "8.0.0/libcoreclr.so (deleted)"});
+  }
+  CHECK(!map.FindModule("libcoreclr.so (deleted)"));
+  auto foo = map.FindModule("libfoo.so");
+  CHECK(foo && map.GetPath(*foo) == "/opt/my app/libfoo.so");
+  CHECK(map.FindModule("dotnet"));
+  CHECK(!map.FindModule("[stack]"));
+  CHECK(!map.FindModule(""));
+
+  auto anonymous = map.Find(0x7f0000000100);
+  CHECK(anonymous && anonymous->path == MemoryMap::kNoPath);
+  auto code = map.Find(0x7f1000100000);
+  CHECK(code && code->offset == 0x100000 &&
+        code->protection == (MemoryMap::kRead | MemoryMap::kExecute));
+  CHECK(!map.Find(0x7f1000400000));
+  // Adjacent regions of the module are readable as a whole
+  CHECK_EQ(map.GetReadableSize(0x7f10000ff000, 0x10000), uint64_t{0x10000});
+  CHECK_EQ(map.GetReadableSize(0x7f10003ff000, 0x10000), uint64_t{0x1000});
+}
+
+void TestLarge() {
+  std::vector<MemoryMap::Region> expected;
+  auto maps = GenerateMaps(kLineCount, expected);
+  MemoryMap map;
+  map.Parse(maps.data(), maps.size());
+  auto& regions = map.GetRegions();
+  CHECK_EQ(regions.size(), expected.size());
+  if (regions.size() != expected.size()) {
+    return;
+  }
+  for (size_t i = 0; i < regions.size(); ++i) {
+    auto& region = regions[i];
+    if (region.first != expected[i].first || region.last != expected[i].last ||
+        region.protection != expected[i].protection ||
+        region.path != expected[i].path) {
+      ++Failures();
+      std::cerr << "Region " << i << " differs\n";
+      return;
+    }
+    CHECK(map.Find(region.first) == &region);
+    CHECK(map.Find(region.last - 1) == &region);
+  }
+  for (auto i = 0; i < kLineCount; i += kMapsModuleInterval) {
+    auto name = "lib" + std::to_string(i) + ".so";
+    auto module = map.FindModule(name);
+    CHECK(module == &regions[i]);
+  }
+}
+
+}  // namespace
+
+int main() {
+  TestParse();
+  TestLarge();
+  return TestResult();
+}
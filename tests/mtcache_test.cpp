@@ -0,0 +1,244 @@
+// Method table cache against a fake DAC: method tables and names resolved
+// are saved and used by the next run against the same process without
+// asking the DAC, entries the target no longer matches are resolved again,
+// and caches of another process or corrupted are not used.
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <thread>
+
+#include "fake_dac.h"
+#include "mtcache.h"
+#include "names.h"
+#include "statistics.h"
+#include "test.h"
+
+namespace {
+
+auto constexpr kPath = "mtcache_test.cache";
+auto constexpr kPid = 1234;
+auto constexpr kStartTime = uint64_t{5678};
+auto constexpr kCount = 64;
+auto constexpr kMethodTables = uintptr_t{0x7f0000001000};
+auto constexpr kMethodTableSize = 0x100;
+auto constexpr kThreadCount = 4;
+
+// Start of a method table in the target, see MethodTableCache
+struct MethodTableHeader {
+  uint32_t flags;  // component size in low bits if the high bit is set
+  uint32_t base_size;
+  uint16_t flags2;
+  uint16_t token;
+};
+
+uintptr_t MethodTable(int i) { return kMethodTables + i * kMethodTableSize; }
+
+// Method tables of the target, the last one can not be read from the target
+void AddMethodTables(FakeDac& dac) {
+  dac.AddRegion(kMethodTables, kCount * kMethodTableSize);
+  for (auto i = 0; i <= kCount; ++i) {
+    auto array = i % 3 == 0;
+    dac.Sos().method_tables[MethodTable(i)] = {
+        static_cast<DWORD>(24 + i * 8), array ? DWORD{2} : DWORD{0},
+        "Type" + std::to_string(i)};
+    if (i < kCount) {
+      dac.Write(MethodTable(i),
+                MethodTableHeader{array ? 0x80000000u | 2 : 0,
+                                  static_cast<uint32_t>(24 + i * 8), 0,
+                                  static_cast<uint16_t>(0x100 + i)});
+    }
+  }
+}
+
+// Type reusing the memory of an unloaded one
+void ReplaceMethodTable(FakeDac& dac, int i, uint32_t base_size,
+                        uint16_t token) {
+  auto& method_table = dac.Sos().method_tables[MethodTable(i)];
+  method_table.base_size = base_size;
+  method_table.component_size = 0;
+  method_table.name = "Reused" + std::to_string(i);
+  dac.Write(MethodTable(i), MethodTableHeader{0, base_size, 0, token});
+}
+
+// Sampling with the method table cache: resolves the method tables "used" on
+// several threads, then their names, and saves the cache
+class Run {
+ public:
+  Run(FakeDac& dac, const std::vector<int>& used, uint64_t pid = kPid,
+      uint64_t start_time = kStartTime)
+      : dac_{dac},
+        cache_{&dac, kPath, static_cast<int>(pid), start_time},
+        names_{&dac, dac_mutex_},
+        resolver_{&dac, dac_mutex_} {
+    auto& sos = dac.Sos();
+    sos.method_table_requests = 0;
+    sos.name_requests = 0;
+    cache_.Load();
+    resolver_.SetCache(&cache_);
+    resolver_.SetNames(&names_);
+    std::vector<std::thread> threads;
+    for (auto n = 0; n < kThreadCount; ++n) {
+      threads.emplace_back([this, &used] { Resolve(used); });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    for (auto i : used) {
+      CHECK_EQ(names_.Get(MethodTable(i)).str(),
+               sos.method_tables[MethodTable(i)].name);
+    }
+    names_.Stop();
+    method_table_requests = sos.method_table_requests;
+    name_requests = sos.name_requests;
+    CHECK(cache_.Save(resolver_, names_));
+  }
+
+  MethodTableCache& Cache() { return cache_; }
+
+  // Requests made to the DAC
+  int method_table_requests;
+  int name_requests;
+
+ private:
+  void Resolve(const std::vector<int>& used) {
+    for (auto i : used) {
+      size_t base_size = 0;
+      size_t component_size = 0;
+      auto& expected = dac_.Sos().method_tables[MethodTable(i)];
+      CHECK_EQ(resolver_.Resolve(MethodTable(i), base_size, component_size),
+               S_OK);
+      CHECK_EQ(base_size, size_t{expected.base_size});
+      CHECK_EQ(component_size, size_t{expected.component_size});
+    }
+  }
+
+  FakeDac& dac_;
+  std::mutex dac_mutex_;
+  MethodTableCache cache_;
+  TypeNameResolver names_;
+  MethodTableResolver resolver_;
+};
+
+std::vector<int> Range(int first, int last) {
+  std::vector<int> range;
+  for (auto i = first; i <= last; ++i) {
+    range.push_back(i);
+  }
+  return range;
+}
+
+void TestLoadSave() {
+  std::remove(kPath);
+  FakeDac dac;
+  AddMethodTables(dac);
+  auto all = Range(0, kCount);
+  {
+    Run run{dac, all};
+    CHECK_EQ(run.Cache().Misses(), uint64_t{kCount + 1});
+    CHECK_EQ(run.method_table_requests, kCount + 1);
+  }
+  // Method table which can not be checked against the target is not saved
+  {
+    Run run{dac, all};
+    CHECK_EQ(run.Cache().Hits(), uint64_t{kCount});
+    CHECK_EQ(run.Cache().Misses(), uint64_t{1});
+    CHECK_EQ(run.method_table_requests, 1);
+  }
+  // Entries not used are kept for the next runs
+  {
+    Run run{dac, Range(0, kCount / 2)};
+    CHECK_EQ(run.Cache().Hits(), uint64_t{kCount / 2 + 1});
+  }
+  {
+    Run run{dac, Range(0, kCount - 1)};
+    CHECK_EQ(run.Cache().Hits(), uint64_t{kCount});
+    CHECK_EQ(run.method_table_requests, 0);
+    CHECK_EQ(run.name_requests, 0);
+  }
+}
+
+// Entries the method tables of the target no longer match are resolved with
+// the DAC, and updated
+void TestStale() {
+  FakeDac dac;
+  AddMethodTables(dac);
+  auto used = Range(0, kCount - 1);
+  Run{dac, used};
+  ReplaceMethodTable(dac, 3, 24 + 3 * 8, 0x200);  // token differs
+  ReplaceMethodTable(dac, 4, 1000, 0x100 + 4);    // base size differs
+  ReplaceMethodTable(dac, 6, 24 + 6 * 8, 0x100 + 6);  // no components
+  {
+    Run run{dac, used};
+    CHECK_EQ(run.Cache().Stale(), uint64_t{3});
+    CHECK_EQ(run.Cache().Hits(), uint64_t{kCount - 3});
+    CHECK_EQ(run.method_table_requests, 3);
+  }
+  Run run{dac, used};
+  CHECK_EQ(run.Cache().Hits(), uint64_t{kCount});
+  CHECK_EQ(run.method_table_requests, 0);
+  CHECK_EQ(run.name_requests, 0);
+}
+
+// Cache is not used, everything is resolved with the DAC
+void CheckRejected(FakeDac& dac, uint64_t pid, uint64_t start_time) {
+  Run run{dac, Range(0, kCount - 1), pid, start_time};
+  CHECK_EQ(run.Cache().Hits(), uint64_t{0});
+  CHECK_EQ(run.Cache().Misses(), uint64_t{kCount});
+  CHECK_EQ(run.method_table_requests, kCount);
+}
+
+std::string ReadFile() {
+  std::ifstream file{kPath, std::ios::binary};
+  return {std::istreambuf_iterator<char>{file}, {}};
+}
+
+void WriteFile(const std::string& data) {
+  std::ofstream file{kPath, std::ios::binary | std::ios::trunc};
+  file.write(data.data(), data.size());
+}
+
+void TestRejected() {
+  FakeDac dac;
+  AddMethodTables(dac);
+  // Another process, or the process restarted with the same ID
+  Run{dac, Range(0, kCount - 1)};
+  CheckRejected(dac, kPid + 1, kStartTime);
+  Run{dac, Range(0, kCount - 1)};
+  CheckRejected(dac, kPid, kStartTime + 1);
+  Run{dac, Range(0, kCount - 1)};
+  auto saved = ReadFile();
+  auto corrupt = [&saved](size_t offset, uint64_t value, size_t size) {
+    auto data = saved;
+    memcpy(&data[offset], &value, size);
+    return data;
+  };
+  for (auto& data : {
+           saved.substr(0, saved.size() - 1),
+           saved.substr(0, sizeof(MethodTableCacheHeader) - 1),
+           std::string{},
+           corrupt(offsetof(MethodTableCacheHeader, magic), 0, 1),
+           corrupt(offsetof(MethodTableCacheHeader, version),
+                   MethodTableCache::kVersion + 1, sizeof(uint32_t)),
+           corrupt(offsetof(MethodTableCacheHeader, pointer_size), 2,
+                   sizeof(uint32_t)),
+           corrupt(offsetof(MethodTableCacheHeader, count), kCount + 1,
+                   sizeof(uint64_t)),
+           corrupt(offsetof(MethodTableCacheHeader, count), ~uint64_t{0} / 2,
+                   sizeof(uint64_t)),
+           corrupt(offsetof(MethodTableCacheHeader, names_size),
+                   ~uint64_t{0}, sizeof(uint64_t)),
+       }) {
+    WriteFile(data);
+    CheckRejected(dac, kPid, kStartTime);
+  }
+}
+
+}  // namespace
+
+int main() {
+  TestLoadSave();
+  TestStale();
+  TestRejected();
+  std::remove(kPath);
+  return TestResult();
+}
@@ -0,0 +1,147 @@
+// Runtime deleted while in use (i.e. updated in place): the mapping is found
+// with its " (deleted)" path, the version of the runtime is read from the
+// target wherever it is in the memory, and the DAC of that version is found
+// next to the directory of the runtime rather than the newer one in it.
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <fstream>
+
+#include "fake_dac.h"
+#include "maps.h"
+#include "runtime.h"
+#include "test.h"
+
+namespace {
+
+auto constexpr kRegion = uintptr_t{0x7f1000000000};
+auto constexpr kRegionSize = size_t{3} << 20;
+auto constexpr kRoot = "runtime_test";
+auto constexpr kApp = "runtime_test/shared/Microsoft.NETCore.App";
+
+std::string Version(const std::string& version) {
+  return "@(#)Version " + version + " @Commit: 0123456789abcdef";
+}
+
+void TestFind() {
+  std::string data = "\x7f" "ELF...@(#)Vers" + Version("8.0.1") + '\0' + "x";
+  CHECK_EQ(FindRuntimeVersion(data.data(), data.size()),
+           Version("8.0.1"));
+  CHECK_EQ(FindRuntimeVersion(data.data(), 4), std::string{});
+  // Not terminated within the data, or too long for a version
+  auto unterminated = Version("8.0.1");
+  CHECK_EQ(FindRuntimeVersion(unterminated.data(), unterminated.size()),
+           std::string{});
+  auto long_version = Version(std::string(300, '1')) + '\0';
+  CHECK_EQ(FindRuntimeVersion(long_version.data(), long_version.size()),
+           std::string{});
+}
+
+// Version is read across the chunks the target memory is read in
+void TestRead() {
+  auto version = Version("8.0.1");
+  for (auto offset : {size_t{0}, size_t{0xFFFF0}, size_t{0xFFFFB},
+                      size_t{0x1FFFF0}, kRegionSize - version.size() - 1}) {
+    FakeDac dac;
+    auto& region = dac.AddRegion(kRegion, kRegionSize);
+    memcpy(&region[offset], version.c_str(), version.size() + 1);
+    CHECK_EQ(ReadRuntimeVersion(dac, kRegion, kRegion + kRegionSize), version);
+    // Memory beyond the region is not readable
+    CHECK_EQ(ReadRuntimeVersion(dac, kRegion, kRegion + 2 * kRegionSize),
+             version);
+  }
+  FakeDac dac;
+  auto& region = dac.AddRegion(kRegion, kRegionSize);
+  memcpy(&region[kRegionSize - 4], version.c_str(), 4);
+  CHECK_EQ(ReadRuntimeVersion(dac, kRegion, kRegion + 2 * kRegionSize),
+           std::string{});
+  CHECK_EQ(ReadRuntimeVersion(dac, kRegion + kRegionSize,
+                              kRegion + 2 * kRegionSize),
+           std::string{});
+}
+
+void WriteLibrary(const std::string& path, const std::string& version) {
+  std::ofstream file{path, std::ios::binary};
+  file << std::string(4096, 'x') << version << '\0' << std::string(100, 'y');
+}
+
+void RemoveTree() {
+  for (auto path : {"runtime_test/shared/Microsoft.NETCore.App/8.0.1/"
+                    "libmscordaccore.so",
+                    "runtime_test/shared/Microsoft.NETCore.App/8.0.1.old/"
+                    "libmscordaccore.so",
+                    "runtime_test/shared/Microsoft.NETCore.App/8.0.1",
+                    "runtime_test/shared/Microsoft.NETCore.App/8.0.1.old",
+                    "runtime_test/shared/Microsoft.NETCore.App",
+                    "runtime_test/shared", "runtime_test"}) {
+    std::remove(path);
+  }
+}
+
+// Runtime of 8.0.1 updated in place to 8.0.2, its old files kept next to it
+void TestFindDac() {
+  RemoveTree();
+  auto current = std::string{kApp} + "/8.0.1";
+  auto old = std::string{kApp} + "/8.0.1.old";
+  for (auto path : {kRoot, "runtime_test/shared", kApp}) {
+    mkdir(path, 0755);
+  }
+  mkdir(current.c_str(), 0755);
+  mkdir(old.c_str(), 0755);
+  WriteLibrary(current + "/libmscordaccore.so", Version("8.0.2"));
+  WriteLibrary(old + "/libmscordaccore.so", Version("8.0.1"));
+  CHECK_EQ(FindDac(current, Version("8.0.1")), old + "/libmscordaccore.so");
+  CHECK_EQ(FindDac(current, Version("8.0.2")),
+           current + "/libmscordaccore.so");
+  CHECK_EQ(FindDac(current, Version("9.0.0")), std::string{});
+  CHECK_EQ(FindDac(current, std::string{}), std::string{});
+  CHECK_EQ(FindDac(std::string{kApp} + "/missing", Version("8.0.1")),
+           old + "/libmscordaccore.so");
+  RemoveTree();
+}
+
+// Maps of the process list the runtime file deleted while mapped the way
+// MemoryMap expects
+void TestDeletedMapping() {
+  char directory[PATH_MAX];
+  CHECK(getcwd(directory, sizeof(directory)));
+  auto path = std::string{directory} + "/libcoreclr.so";
+  WriteLibrary(path, Version("8.0.1"));
+  auto fd = open(path.c_str(), O_RDONLY);
+  CHECK(fd >= 0);
+  auto size = size_t{4096 * 2};
+  auto data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  CHECK(data != MAP_FAILED);
+  unlink(path.c_str());
+  MemoryMap map;
+  CHECK(map.Read(getpid()));
+  auto clr = map.FindModule("libcoreclr.so");
+  CHECK(clr);
+  if (clr) {
+    CHECK_EQ(clr->first, reinterpret_cast<uint64_t>(data));
+    CHECK_EQ(FindRuntimeVersion(static_cast<const char*>(data), size),
+             Version("8.0.1"));
+    auto mapped = map.GetPath(*clr);
+    CHECK_EQ(mapped, path + " (deleted)");
+    CHECK(StripDeleted(mapped));
+    CHECK_EQ(mapped, path);
+    CHECK(!StripDeleted(mapped));
+    CHECK_EQ(mapped, path);
+  }
+  munmap(data, size);
+}
+
+}  // namespace
+
+int main() {
+  TestFind();
+  TestRead();
+  TestFindDac();
+  TestDeletedMapping();
+  return TestResult();
+}
@@ -0,0 +1,476 @@
+// Heap snapshots saved (/save) and captured compressed (/capture) from a fake
+// target must give back its heap metadata, memory and method tables, and
+// snapshot files truncated or with corrupt headers, segments, block index or
+// method tables must be rejected without reading beyond the file.
+#include <cstdio>
+#include <fstream>
+#include <random>
+
+#include "fake_dac.h"
+#include "names.h"
+#include "snapshot.h"
+#include "statistics.h"
+#include "test.h"
+
+namespace {
+
+auto constexpr kPath = "snapshot_test.gcsnap";
+auto constexpr kCorruptPath = "snapshot_test_corrupt.gcsnap";
+auto constexpr kHeap = CLRDATA_ADDRESS{0x1000};
+auto constexpr kBlockSize = size_t{SnapshotWriter::kBlockSize};
+
+struct SegmentLayout {
+  CLRDATA_ADDRESS addr;
+  uintptr_t mem;
+  size_t size;      // of the objects allocated
+  size_t readable;  // bytes of the target memory, the rest can not be read
+};
+
+// Blocks of the small object segment do not compress, ephemeral segment
+// ends at a block boundary, the end of the large one can not be read
+const SegmentLayout kSmall{0x2000, 0x10000000, 2 * kBlockSize + 0x12348,
+                           2 * kBlockSize + 0x12348};
+const SegmentLayout kEphemeral{0x3000, 0x20000000, kBlockSize, kBlockSize};
+const SegmentLayout kLarge{0x4000, 0x30000000, kBlockSize + 0x80000,
+                           kBlockSize + 0x7FF00};
+
+const std::pair<uintptr_t, FakeSos::MethodTable> kMethodTables[] = {
+    {0x7f0000001000, {24, 0, "System.Object"}},
+    {0x7f0000002000, {22, 2, "System.String"}},
+    {0x7f0000003000, {24, 1, "System.Byte[]"}},
+    {0x7f0000004000,
+     {32, 0, "System.Collections.Generic.Dictionary`2[[System.String]]"}},
+};
+
+// Memory of a heap: objects of the method tables above, random bytes every
+// other block of the small object segment
+void FillMemory(std::vector<BYTE>& memory, bool random_blocks) {
+  std::mt19937_64 random{42};
+  for (size_t offset = 0; offset + 24 <= memory.size(); offset += 24) {
+    if (random_blocks && offset / kBlockSize % 2 == 0) {
+      for (size_t i = 0; i < 24; ++i) {
+        memory[offset + i] = static_cast<BYTE>(random());
+      }
+      continue;
+    }
+    auto mt = kMethodTables[random() % 4].first;
+    auto length = static_cast<uint32_t>(random() % 16);
+    memcpy(&memory[offset], &mt, sizeof(mt));
+    memcpy(&memory[offset + sizeof(mt)], &length, sizeof(length));
+  }
+}
+
+void AddSegment(FakeDac& dac, const SegmentLayout& layout, CLRDATA_ADDRESS next,
+                bool random_blocks) {
+  FillMemory(dac.AddRegion(layout.mem, layout.readable), random_blocks);
+  auto& data = dac.Sos().segments[layout.addr];
+  data.segmentAddr = layout.addr;
+  data.mem = layout.mem;
+  data.allocated = layout.mem + layout.size;
+  data.next = next;
+}
+
+void SetUpTarget(FakeDac& dac) {
+  auto& sos = dac.Sos();
+  sos.heap_data.HeapCount = 1;
+  sos.heap_data.g_max_generation = 2;
+  sos.heap_data.bGcStructuresValid = TRUE;
+  sos.globals.StringMethodTable = kMethodTables[1].first;
+  sos.globals.FreeMethodTable = 0x7f0000000100;
+  auto& details = sos.heaps[kHeap];
+  details.heapAddr = kHeap;
+  details.alloc_allocated = kEphemeral.mem + kEphemeral.size;
+  details.ephemeral_heap_segment = kEphemeral.addr;
+  details.generation_table[2].start_segment = kSmall.addr;
+  details.generation_table[2].allocation_start = kSmall.mem;
+  details.generation_table[1].allocation_start = kEphemeral.mem;
+  details.generation_table[0].allocation_start = kEphemeral.mem + 0x1000;
+  details.generation_table[3].start_segment = kLarge.addr;
+  details.generation_table[3].allocation_start = kLarge.mem;
+  details.generation_table[0].allocContextPtr = kEphemeral.mem + 0x2000;
+  details.generation_table[0].allocContextLimit = kEphemeral.mem + 0x3000;
+  AddSegment(dac, kSmall, kEphemeral.addr, true);
+  AddSegment(dac, kEphemeral, 0, false);
+  AddSegment(dac, kLarge, 0, false);
+  for (auto i = 1; i < 8; ++i) {
+    auto ptr = kEphemeral.mem + i * 0x10000;
+    sos.AddThread(ptr, ptr + 0x2000);
+  }
+  for (auto& method_table : kMethodTables) {
+    sos.method_tables.insert(method_table);
+  }
+}
+
+// Writes the snapshot the way /save and /capture do, method tables are not
+// written unless "complete"
+bool Save(FakeDac& dac, const HeapSnapshot& heap, bool compress,
+          bool complete) {
+  std::mutex dac_mutex;
+  MethodTableResolver resolver{&dac, dac_mutex};
+  for (auto& method_table : kMethodTables) {
+    size_t base_size, component_size;
+    resolver.Resolve(method_table.first, base_size, component_size);
+  }
+  TypeNameResolver names{&dac, dac_mutex};
+  SnapshotWriter writer{kPath, compress, 3};
+  // Buffer size is not a multiple of the page size
+  if (!writer.WriteHeap(&dac, heap, 0x10100)) {
+    return false;
+  }
+  return !complete || writer.WriteMethodTables(resolver, names);
+}
+
+template <typename T>
+bool Equal(const T& a, const T& b) {
+  return !memcmp(&a, &b, sizeof(T));
+}
+
+void CheckHeap(const HeapSnapshot& expected, const HeapSnapshot& heap) {
+  CHECK(Equal(heap.data, expected.data));
+  CHECK(Equal(heap.globals, expected.globals));
+  CHECK_EQ(heap.details.size(), expected.details.size());
+  for (size_t i = 0; i < heap.details.size() && i < expected.details.size();
+       ++i) {
+    CHECK(Equal<DacpGcHeapDetails>(heap.details[i], expected.details[i]));
+  }
+  for (size_t i = 0; i < heap.segments.size(); ++i) {
+    auto& segments = heap.segments[i];
+    CHECK_EQ(segments.size(), expected.segments[i].size());
+    for (size_t j = 0; j < segments.size() && j < expected.segments[i].size();
+         ++j) {
+      auto& segment = segments[j];
+      auto& expected_segment = expected.segments[i][j];
+      CHECK_EQ(segment.addr, expected_segment.addr);
+      CHECK_EQ(segment.heap - &heap.details[0],
+               expected_segment.heap - &expected.details[0]);
+      CHECK(Equal(segment.data, expected_segment.data));
+      CHECK_EQ(segment.End(), expected_segment.End());
+    }
+  }
+  CHECK_EQ(heap.allocation_contexts.size(),
+           expected.allocation_contexts.size());
+  for (size_t i = 0; i < heap.allocation_contexts.size() &&
+                     i < expected.allocation_contexts.size();
+       ++i) {
+    CHECK_EQ(heap.allocation_contexts[i].ptr,
+             expected.allocation_contexts[i].ptr);
+    CHECK_EQ(heap.allocation_contexts[i].limit,
+             expected.allocation_contexts[i].limit);
+  }
+}
+
+// Reads ranges of the segment from the snapshot and the target, the bytes
+// the target could not read are saved as zeros
+void CheckMemory(FakeDac& dac, Snapshot& snapshot,
+                 const SegmentLayout& layout, bool compressed) {
+  std::mt19937_64 random{7};
+  std::vector<BYTE> expected, actual;
+  for (auto i = 0; i < 64; ++i) {
+    auto size = static_cast<ULONG32>(
+        i % 4 ? random() % 0x20000 + 1 : random() % 64 + 1);
+    // Ranges at the ends of the segment and crossing block boundaries
+    size_t offset = 0;
+    if (i == 1) {
+      offset = layout.size - size;
+    } else if (i % 2) {
+      auto boundary = (random() % (layout.size / kBlockSize) + 1) * kBlockSize;
+      offset = boundary - (std::min)(size_t{size}, boundary) / 2;
+    } else if (i) {
+      offset = random() % (layout.size - size + 1);
+    }
+    offset = (std::min)(offset, layout.size - size);
+    expected.assign(size, 0);
+    ReadRequest request{layout.mem + offset, expected.data(), size};
+    dac.ReadMemory(&request, 1);
+    actual.assign(size, 0xCD);
+    request = {layout.mem + offset, actual.data(), size};
+    auto hr = snapshot.ReadMemory(&request, 1);
+    if (hr != S_OK || request.read != size || actual != expected) {
+      ++Failures();
+      std::cerr << "Snapshot memory at 0x" << std::hex << layout.mem + offset
+                << std::dec << ", " << size << " bytes, read "
+                << request.read << " bytes, differs\n";
+      return;
+    }
+    auto mapped = snapshot.MapMemory(layout.mem + offset, size);
+    CHECK(compressed ? !mapped
+                     : mapped && !memcmp(mapped, expected.data(), size));
+  }
+  // Beyond the segment
+  BYTE byte;
+  ReadRequest request{layout.mem + layout.size, &byte, 1};
+  CHECK_EQ(snapshot.ReadMemory(&request, 1), S_FALSE);
+  CHECK_EQ(request.read, 0u);
+  CHECK(!snapshot.MapMemory(layout.mem + layout.size - 1, 2));
+}
+
+std::string ReadFile(const char* path) {
+  std::ifstream file{path, std::ios::binary};
+  return {std::istreambuf_iterator<char>{file},
+          std::istreambuf_iterator<char>{}};
+}
+
+bool Opens(const std::string& data) {
+  {
+    std::ofstream file{kCorruptPath, std::ios::binary | std::ios::trunc};
+    file.write(data.data(), data.size());
+  }
+  return Snapshot::Open(kCorruptPath) != nullptr;
+}
+
+template <typename T>
+T Get(const std::string& data, uint64_t offset) {
+  T value;
+  memcpy(&value, &data[static_cast<size_t>(offset)], sizeof(value));
+  return value;
+}
+
+template <typename T>
+void Patch(std::string& data, uint64_t offset, T value) {
+  memcpy(&data[static_cast<size_t>(offset)], &value, sizeof(value));
+}
+
+// Every prefix of the file ending at, or next to, a boundary of its parts
+// and a sample of the others
+void TestTruncated(const std::string& data, const SnapshotHeader& header) {
+  auto segments = sizeof(SnapshotHeader) +
+                  sizeof(DacpGcHeapDetails) * header.heap_count;
+  auto contexts = segments + sizeof(SnapshotSegment) * header.segment_count;
+  std::vector<uint64_t> boundaries{
+      0,
+      sizeof(SnapshotHeader),
+      segments,
+      contexts,
+      contexts +
+          sizeof(SnapshotAllocationContext) * header.allocation_context_count,
+      header.blocks_offset,
+      header.blocks_offset + sizeof(SnapshotBlock) * header.block_count,
+      header.method_tables_offset,
+      header.names_offset,
+      data.size()};
+  for (uint32_t i = 0; i < header.segment_count; ++i) {
+    auto segment = Get<SnapshotSegment>(
+        data, segments + i * sizeof(SnapshotSegment));
+    if (!header.block_size) {
+      boundaries.push_back(segment.offset);
+      boundaries.push_back(segment.offset + segment.last - segment.first);
+    }
+  }
+  for (uint32_t i = 0; i < header.block_count; ++i) {
+    auto block = Get<SnapshotBlock>(
+        data, header.blocks_offset + i * sizeof(SnapshotBlock));
+    boundaries.push_back(block.offset + block.size);
+  }
+  std::vector<uint64_t> sizes;
+  for (auto boundary : boundaries) {
+    for (auto size : {boundary - 1, boundary, boundary + 1}) {
+      if (size < data.size()) {
+        sizes.push_back(size);
+      }
+    }
+  }
+  for (uint64_t size = 0; size < data.size(); size += data.size() / 50 + 7) {
+    sizes.push_back(size);
+  }
+  for (auto size : sizes) {
+    if (Opens(data.substr(0, static_cast<size_t>(size)))) {
+      ++Failures();
+      std::cerr << "Snapshot truncated to " << size << " bytes of "
+                << data.size() << " is opened\n";
+    }
+  }
+}
+
+void TestCorrupt(const std::string& data, const SnapshotHeader& header) {
+  auto segment = sizeof(SnapshotHeader) +
+                 sizeof(DacpGcHeapDetails) * header.heap_count;
+  auto block = header.blocks_offset;
+  auto method_table = header.method_tables_offset;
+  auto first = Get<uint64_t>(data, segment + offsetof(SnapshotSegment, first));
+  struct Corruption {
+    const char* name;
+    uint64_t offset;
+    uint64_t value;
+    size_t size;
+    bool compressed;  // applies to compressed snapshots only
+  };
+  const Corruption corruptions[] = {
+      {"magic", 0, 'X', 1},
+      {"version", offsetof(SnapshotHeader, version),
+       SnapshotWriter::kVersion + 1, sizeof(uint32_t)},
+      {"pointer size", offsetof(SnapshotHeader, pointer_size),
+       sizeof(void*) / 2, sizeof(uint32_t)},
+      {"heap count", offsetof(SnapshotHeader, heap_count), 0x10000000,
+       sizeof(uint32_t)},
+      {"segment count", offsetof(SnapshotHeader, segment_count), 0x10000000,
+       sizeof(uint32_t)},
+      {"allocation context count",
+       offsetof(SnapshotHeader, allocation_context_count), 0xFFFFFFFF,
+       sizeof(uint32_t)},
+      {"method table count", offsetof(SnapshotHeader, method_table_count),
+       0x10000000, sizeof(uint32_t)},
+      {"method tables beyond the file",
+       offsetof(SnapshotHeader, method_tables_offset), data.size() + 8,
+       sizeof(uint64_t)},
+      {"misaligned method tables",
+       offsetof(SnapshotHeader, method_tables_offset), method_table + 1,
+       sizeof(uint64_t)},
+      {"names beyond the file", offsetof(SnapshotHeader, names_offset),
+       ~uint64_t{}, sizeof(uint64_t)},
+      {"names size", offsetof(SnapshotHeader, names_size),
+       header.names_size + 1, sizeof(uint64_t)},
+      {"block count", offsetof(SnapshotHeader, block_count),
+       header.block_count - 1, sizeof(uint32_t), true},
+      {"block size", offsetof(SnapshotHeader, block_size), kBlockSize / 2,
+       sizeof(uint32_t), true},
+      {"block index beyond the file", offsetof(SnapshotHeader, blocks_offset),
+       data.size() - 8, sizeof(uint64_t), true},
+      {"misaligned block index", offsetof(SnapshotHeader, blocks_offset),
+       block + 4, sizeof(uint64_t), true},
+      {"segment range", segment + offsetof(SnapshotSegment, last), first - 1,
+       sizeof(uint64_t)},
+      {"segment beyond the file", segment + offsetof(SnapshotSegment, last),
+       first + data.size(), sizeof(uint64_t)},
+      {"segment heap", segment + offsetof(SnapshotSegment, heap),
+       header.heap_count, sizeof(uint32_t)},
+      {"segment memory beyond the file",
+       segment + offsetof(SnapshotSegment, offset), data.size() - 0x1000,
+       sizeof(uint64_t)},
+      {"segment blocks beyond the index",
+       segment + offsetof(SnapshotSegment, offset), header.block_count - 1,
+       sizeof(uint64_t), true},
+      {"block beyond the file", block + offsetof(SnapshotBlock, offset),
+       data.size() - 1, sizeof(uint64_t), true},
+      {"block larger than raw", block + offsetof(SnapshotBlock, size),
+       kBlockSize + 1, sizeof(uint32_t), true},
+      {"block raw size", block + offsetof(SnapshotBlock, raw_size),
+       kBlockSize - 1, sizeof(uint32_t), true},
+      {"method table name",
+       method_table + offsetof(SnapshotMethodTable, name_offset),
+       header.names_size, sizeof(uint64_t)},
+      {"method table name size",
+       method_table + offsetof(SnapshotMethodTable, name_size),
+       header.names_size + 1, sizeof(uint64_t)},
+  };
+  for (auto& corruption : corruptions) {
+    if (corruption.compressed && !header.block_size) {
+      continue;
+    }
+    auto corrupt = data;
+    memcpy(&corrupt[static_cast<size_t>(corruption.offset)],
+           &corruption.value, corruption.size);
+    if (Opens(corrupt)) {
+      ++Failures();
+      std::cerr << "Snapshot with corrupt " << corruption.name
+                << " is opened\n";
+    }
+  }
+}
+
+// Data of a compressed block is not checked until it is read, reading
+// garbage gives an error, not the garbage
+void TestCorruptBlock(const std::string& data, const SnapshotHeader& header) {
+  for (uint32_t i = 0; i < header.block_count; ++i) {
+    auto block = Get<SnapshotBlock>(
+        data, header.blocks_offset + i * sizeof(SnapshotBlock));
+    if (block.size == block.raw_size) {
+      continue;
+    }
+    auto corrupt = data;
+    for (uint32_t j = 0; j < block.size; j += 97) {
+      corrupt[static_cast<size_t>(block.offset + j)] ^= 0x5A;
+    }
+    Patch(corrupt, header.blocks_offset + i * sizeof(SnapshotBlock) +
+                       offsetof(SnapshotBlock, size),
+          block.size - 1);
+    CHECK(Opens(corrupt));
+    auto snapshot = Snapshot::Open(kCorruptPath);
+    if (!snapshot) {
+      return;
+    }
+    HeapSnapshot heap{};
+    snapshot->Read(heap);
+    std::vector<BYTE> buffer(kBlockSize);
+    auto errors = Log::ErrorCount.load();
+    for (auto& segments : heap.segments) {
+      for (auto& segment : segments) {
+        for (auto addr = segment.data.mem; addr < segment.End();
+             addr += kBlockSize) {
+          ReadRequest request{
+              addr, buffer.data(),
+              static_cast<ULONG32>((std::min)(
+                  CLRDATA_ADDRESS{kBlockSize}, segment.End() - addr))};
+          snapshot->ReadMemory(&request, 1);
+        }
+      }
+    }
+    CHECK_EQ(Log::ErrorCount.load() - errors, 1);
+    return;
+  }
+  ++Failures();
+  std::cerr << "No compressed block\n";
+}
+
+void TestRoundTrip(bool compress) {
+  FakeDac dac;
+  SetUpTarget(dac);
+  HeapSnapshot heap{};
+  CHECK(heap.Initialize(&dac.Sos()));
+  auto errors = Log::ErrorCount.load();
+
+  // Incomplete until method tables are written
+  CHECK(Save(dac, heap, compress, false));
+  auto snapshot = Snapshot::Open(kPath);
+  CHECK(snapshot && !snapshot->IsComplete());
+  snapshot.reset();
+
+  CHECK(Save(dac, heap, compress, true));
+  // Unreadable end of the large object segment
+  CHECK_EQ(Log::ErrorCount.load() - errors, 2);
+  snapshot = Snapshot::Open(kPath);
+  CHECK(snapshot);
+  if (!snapshot) {
+    return;
+  }
+  CHECK(snapshot->IsComplete());
+  HeapSnapshot saved{};
+  snapshot->Read(saved);
+  CheckHeap(heap, saved);
+  for (auto layout : {&kSmall, &kEphemeral, &kLarge}) {
+    CheckMemory(dac, *snapshot, *layout, compress);
+  }
+  std::mutex dac_mutex;
+  MethodTableResolver resolver{nullptr, dac_mutex};
+  snapshot->Read(resolver);
+  for (auto& method_table : kMethodTables) {
+    size_t base_size = 0, component_size = 0;
+    CHECK(resolver.Find(method_table.first, base_size, component_size));
+    CHECK_EQ(base_size, size_t{method_table.second.base_size});
+    CHECK_EQ(component_size, size_t{method_table.second.component_size});
+    CHECK_EQ(snapshot->GetName(method_table.first), method_table.second.name);
+  }
+  CHECK(snapshot->GetName(0x7f0000000100).empty());
+
+  auto data = ReadFile(kPath);
+  auto header = Get<SnapshotHeader>(data, 0);
+  CHECK_EQ(header.block_size, compress ? uint32_t{kBlockSize} : 0u);
+  CHECK_EQ(header.method_tables_offset % sizeof(uint64_t), 0u);
+  snapshot.reset();
+  errors = Log::ErrorCount.load();
+  TestTruncated(data, header);
+  TestCorrupt(data, header);
+  if (compress) {
+    TestCorruptBlock(data, header);
+  }
+  CHECK(Log::ErrorCount.load() > errors);
+}
+
+}  // namespace
+
+int main() {
+  TestRoundTrip(false);
+  TestRoundTrip(true);
+  remove(kPath);
+  remove(kCorruptPath);
+  return TestResult();
+}
@@ -0,0 +1,10 @@
+#include "test.h"
+
+int Log::Level;
+std::atomic<int> Log::ErrorCount;
+std::mutex Log::Mutex;
+
+int& Failures() {
+  static int failures;
+  return failures;
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <iostream>
+
+// Checks of the tests. A test is an executable which exit code is non-zero if
+// any check failed, failures are reported to stderr.
+int& Failures();
+
+#define CHECK(condition)                                                \
+  do {                                                                  \
+    if (!(condition)) {                                                 \
+      ++Failures();                                                     \
+      std::cerr << __FILE__ << ':' << __LINE__ << ": CHECK(" #condition \
+                << ") failed\n";                                        \
+    }                                                                   \
+  } while (false)
+
+#define CHECK_EQ(actual, expected)                                     \
+  do {                                                                 \
+    auto&& actual_value = (actual);                                    \
+    auto&& expected_value = (expected);                                \
+    if (!(actual_value == expected_value)) {                           \
+      ++Failures();                                                    \
+      std::cerr << __FILE__ << ':' << __LINE__ << ": " #actual " is "  \
+                << actual_value << ", expected " << expected_value     \
+                << '\n';                                               \
+    }                                                                  \
+  } while (false)
+
+// Returns from main
+inline int TestResult() {
+  if (Failures()) {
+    std::cerr << Failures() << " check(s) failed\n";
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,141 @@
+// Walk must resume after a zero gap only where objects of known types follow,
+// non-zero words within the gap are skipped with it, and memory with no
+// object after a gap is given up. Skipped bytes are counted.
+#include "fake_dac.h"
+#include "statistics.h"
+#include "test.h"
+
+namespace {
+
+auto constexpr kSegmentStart = uintptr_t{0x10000000};
+auto constexpr kMethodTable = uintptr_t{0x7f0000001000};
+auto constexpr kArrayMethodTable = uintptr_t{0x7f0000002000};
+auto constexpr kObjectSize = size_t{24};
+
+// Segment of objects and gaps built in address order
+struct Segment {
+  std::vector<BYTE> data;
+  size_t objects{};
+  size_t arrays{};
+
+  uintptr_t End() const { return kSegmentStart + data.size(); }
+
+  template <typename T>
+  void Write(size_t offset, T value) {
+    memcpy(&data[offset], &value, sizeof(value));
+  }
+
+  void AddObjects(size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+      auto offset = data.size();
+      auto array = i % 3 == 1;
+      uint32_t length = array ? static_cast<uint32_t>(i % 5) : 0;
+      data.resize(offset + (array ? Align<kAlignment>(kObjectSize + length * 8)
+                                  : kObjectSize));
+      Write(offset, array ? kArrayMethodTable : kMethodTable);
+      Write(offset + sizeof(uintptr_t), length);
+      ++(array ? arrays : objects);
+    }
+  }
+
+  // Gap of "size" bytes, stray words at the offsets given
+  void AddGap(size_t size, std::initializer_list<std::pair<size_t, uintptr_t>>
+                               strays = {}) {
+    auto offset = data.size();
+    data.resize(offset + size);
+    for (auto& stray : strays) {
+      Write(offset + stray.first, stray.second);
+    }
+  }
+
+  void AddGarbage(size_t size) { data.resize(data.size() + size, 0xCD); }
+};
+
+struct Result {
+  size_t objects;
+  size_t arrays;
+  uint64_t bytes_skipped;
+  int errors;
+};
+
+Result Walk(const Segment& segment, size_t window_size) {
+  FakeDac dac;
+  dac.AddRegion(kSegmentStart, segment.data.size()) = segment.data;
+  std::mutex dac_mutex;
+  MethodTableResolver resolver{nullptr, dac_mutex};
+  resolver.Add(kMethodTable, kObjectSize, 0);
+  resolver.Add(kArrayMethodTable, kObjectSize, 8);
+  HeapSnapshot heap{};
+  SegmentWalker walker{&dac, heap, resolver, window_size};
+  DacpGcHeapDetailsEx details{};
+  auto errors = Log::ErrorCount.load();
+  walker.WalkSegment<kAlignment>(kSegmentStart, segment.End(), &details, 2);
+  auto& counters = walker.GetCounters()[2];
+  auto objects = counters.Find(kMethodTable);
+  auto arrays = counters.Find(kArrayMethodTable);
+  return {objects ? objects->count : 0, arrays ? arrays->count : 0,
+          walker.BytesSkipped(), Log::ErrorCount.load() - errors};
+}
+
+void Check(const char* name, const Segment& segment, uint64_t bytes_skipped,
+           int errors) {
+  for (auto window_size : {size_t{4096}, size_t{1} << 20}) {
+    auto result = Walk(segment, window_size);
+    if (result.objects != segment.objects || result.arrays != segment.arrays ||
+        result.bytes_skipped != bytes_skipped || result.errors != errors) {
+      ++Failures();
+      std::cerr << name << ", " << window_size << "-byte window: "
+                << result.objects << " objects, " << result.arrays
+                << " arrays, " << result.bytes_skipped << " bytes skipped, "
+                << result.errors << " errors, expected " << segment.objects
+                << ", " << segment.arrays << ", " << bytes_skipped << ", "
+                << errors << '\n';
+    }
+  }
+}
+
+void TestGap() {
+  Segment segment;
+  segment.AddObjects(100);
+  segment.AddGap(4096);
+  segment.AddObjects(100);
+  Check("Zero gap", segment, 4096, 0);
+}
+
+// Words of unknown types, misaligned or not followed by objects are not
+// taken for objects
+void TestStrayWords() {
+  Segment segment;
+  segment.AddObjects(100);
+  segment.AddGap(1024, {{64, uintptr_t{0x4242}},
+                        {128, kMethodTable + 4},
+                        {256, uintptr_t{0x7f0000003000}},
+                        {512, kMethodTable},
+                        {512 + kObjectSize, uintptr_t{0x4242}}});
+  segment.AddObjects(100);
+  // Gap spanning a window boundary
+  auto size = 4096 - segment.data.size() % 4096 + 64;
+  segment.AddGap(size, {{8, uintptr_t{0x4242}}});
+  segment.AddObjects(100);
+  Check("Stray words in a gap", segment, 1024 + size, 0);
+}
+
+// Memory after a gap is skipped as a whole if no object is found within the
+// stray words allowed
+void TestNoObject() {
+  Segment segment;
+  segment.AddObjects(100);
+  auto offset = segment.data.size();
+  segment.AddGap(64);
+  segment.AddGarbage(1024);
+  Check("Garbage after a gap", segment, segment.data.size() - offset, 1);
+}
+
+}  // namespace
+
+int main() {
+  TestGap();
+  TestStrayWords();
+  TestNoObject();
+  return TestResult();
+}
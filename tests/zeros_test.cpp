@@ -0,0 +1,79 @@
+// FindNonZero implementations must agree at any alignment of the range ends
+// and never look beyond them.
+#include <vector>
+
+#include "test.h"
+#include "zeros.h"
+
+namespace {
+
+using Find = const BYTE* (*)(const BYTE*, const BYTE*);
+
+// Bytes around the range are not zero, reading them gives a wrong result
+void CheckRange(const std::vector<Find>& finds, std::vector<BYTE>& buffer,
+                size_t offset, size_t size) {
+  buffer.assign(buffer.size(), 0xFF);
+  auto first = &buffer[offset];
+  auto last = first + size;
+  std::fill(first, last, BYTE{0});
+  for (size_t i = 0; i <= size; ++i) {
+    // No non-zero byte if i == size
+    if (i < size) {
+      first[i] = 1;
+    }
+    for (auto find : finds) {
+      auto found = find(first, last);
+      if (found != first + i) {
+        ++Failures();
+        std::cerr << "Offset " << offset << ", size " << size
+                  << ", non-zero byte at " << i << ", found at "
+                  << found - first << '\n';
+        return;
+      }
+    }
+    if (i < size) {
+      first[i] = 0;
+    }
+  }
+}
+
+void TestUnaligned(const std::vector<Find>& finds) {
+  std::vector<BYTE> buffer(512);
+  for (size_t offset = 1; offset < 64; ++offset) {
+    for (size_t size = 0; size <= 300; ++size) {
+      CheckRange(finds, buffer, offset, size);
+    }
+  }
+}
+
+void TestLarge(const std::vector<Find>& finds) {
+  std::vector<BYTE> buffer((1 << 20) + 64);
+  for (auto offset : {0, 1, 31, 33}) {
+    auto first = &buffer[offset];
+    auto last = first + (1 << 20) - offset;
+    for (auto i : {size_t{0}, size_t{127}, size_t{128}, size_t{4095},
+                   size_t{65536 + 17}, static_cast<size_t>(last - first)}) {
+      std::fill(buffer.begin(), buffer.end(), BYTE{0});
+      if (first + i < last) {
+        first[i] = 0x80;
+      }
+      for (auto find : finds) {
+        CHECK_EQ(find(first, last) - first, static_cast<ptrdiff_t>(i));
+      }
+    }
+  }
+}
+
+}  // namespace
+
+int main() {
+  std::vector<Find> finds{FindNonZeroScalar, FindNonZeroSse2, FindNonZero};
+  if (IsAvx2Supported()) {
+    finds.push_back(FindNonZeroAvx2);
+  } else {
+    std::cerr << "AVX2 is not supported, not tested\n";
+  }
+  TestUnaligned(finds);
+  TestLarge(finds);
+  return TestResult();
+}